@@ -123,32 +123,21 @@ int bmp_save(const char *file, struct bitmap *bmp, const void *data)
 
 int bmp_image_save(struct smbrr *image, struct bitmap *bmp, const char *file)
 {
-	struct smbrr *i;
 	char filename[128];
 	void *buf;
-	float min, max;
 
-	i = smbrr_new(SMBRR_DATA_2D_FLOAT, image->width, image->height, 0, 0, NULL);
-	if (i == NULL)
-		return -ENOMEM;
-	smbrr_copy(i, image);
-
-	buf = calloc(1, smbrr_get_bytes(i));
+	buf = calloc(1, smbrr_get_bytes(image));
 	if (buf == NULL)
-		return -EINVAL;
+		return -ENOMEM;
 
 	if (strstr(file, ".bmp"))
 		snprintf(filename, sizeof(filename), "%s", file);
 	else
 		snprintf(filename, sizeof(filename), "%s.bmp", file);
-	smbrr_convert(i, SMBRR_DATA_2D_FLOAT);
-	smbrr_find_limits(i, &min, &max);
-	fprintf(stdout, "limit for %s are %f to %f\n", filename, min, max);
-	smbrr_normalise(i, 0.0, 250.0);
-	smbrr_get_data(i, SMBRR_SOURCE_UINT8, &buf);
+	smbrr_export(image, SMBRR_SOURCE_UINT8, SMBRR_STRETCH_LINEAR, 0.0, 100.0,
+				 250.0, buf);
 	bmp_save(filename, bmp, buf);
 	free(buf);
-	smbrr_free(i);
 
 	return 0;
 }
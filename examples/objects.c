@@ -218,12 +218,13 @@ int main(int argc, char *argv[])
 
 	print_timer(time, "ksigma clip");
 
-	/* Find all significant structures at each scale and save visualizations */
-	for (i = 0; i < scales - 1; i++) {
-		/* Identify continuous structures of significant pixels at the current scale */
-		structures = smbrr_wavelet_structure_find(w, i);
-		print_timer(time, "find structures");
+	/* Identify continuous structures of significant pixels at every scale */
+	smbrr_wavelet_structure_find_all(w);
+	print_timer(time, "find structures");
 
+	/* Save visualizations of the structures at each scale */
+	for (i = 0; i < scales - 1; i++) {
+		structures = smbrr_wavelet_get_num_structures(w, i);
 		fprintf(stdout, "Found %d structures at scale %d\n", structures, i);
 
 		/* Save each structure mask for visualisation */
@@ -41,6 +41,13 @@ def main():
     print("Starting USB camera object detection...")
     print("Press 'q' to quit.")
 
+    # Noise barely changes between frames so carry clipping state across them
+    noise_state = smbrr.smbrr.smbrr_noise_state_new()
+
+    # Keep object IDs across frames
+    tracker = smbrr.smbrr.smbrr_tracker_new(ctypes.c_float(8.0))
+    track = smbrr.SmbrrTrack()
+
     while True:
         ret, frame = cap.read()
         if not ret:
@@ -76,7 +83,7 @@ def main():
             smbrr.smbrr.smbrr_free(image)
             continue
 
-        smbrr.smbrr.smbrr_wavelet_ksigma_clip(w, k_sigma, ctypes.c_float(sigma_delta))
+        smbrr.smbrr.smbrr_wavelet_ksigma_clip_state(w, k_sigma, ctypes.c_float(sigma_delta), noise_state)
 
         # Find structures at each scale
         for i in range(scales - 1):
@@ -85,13 +92,16 @@ def main():
         # Connect structures into objects
         num_objects = smbrr.smbrr.smbrr_wavelet_structure_connect(w, 0, scales - 2)
 
-        # Draw objects on the original RGB frame
-        for i in range(num_objects):
-            obj_ptr = smbrr.smbrr.smbrr_wavelet_object_get(w, i)
-            if not obj_ptr:
+        # Match objects to the tracks of the previous frame
+        num_tracks = smbrr.smbrr.smbrr_tracker_update(tracker, w)
+
+        # Draw tracked objects on the original RGB frame
+        for i in range(max(num_tracks, 0)):
+            smbrr.smbrr.smbrr_tracker_get_track(tracker, i, ctypes.byref(track))
+            if not track.object:
                 continue
             
-            obj = obj_ptr.contents
+            obj = track.object.contents
             
             # Draw circle at center
             center = (int(obj.pos.x), int(obj.pos.y))
@@ -109,7 +119,7 @@ def main():
             color = colors[obj.scale % len(colors)]
             
             cv2.circle(frame, center, radius, color, 2)
-            cv2.putText(frame, f"ID:{obj.id} S:{obj.scale}", (center[0] + radius + 2, center[1]), 
+            cv2.putText(frame, f"ID:{track.id} S:{obj.scale}", (center[0] + radius + 2, center[1]), 
                         cv2.FONT_HERSHEY_SIMPLEX, 0.4, color, 1)
 
         # Display the frame
@@ -125,6 +135,8 @@ def main():
             break
 
     # Cleanup
+    smbrr.smbrr.smbrr_tracker_free(tracker)
+    smbrr.smbrr.smbrr_noise_state_free(noise_state)
     cap.release()
     cv2.destroyAllWindows()
 
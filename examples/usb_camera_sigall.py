@@ -46,6 +46,9 @@ def main():
     # Create a persistent numpy array for the output buffer
     out_buf = None
 
+    # Noise barely changes between frames so carry clipping state across them
+    noise_state = smbrr.smbrr.smbrr_noise_state_new()
+
     while True:
         ret, frame = cap.read()
         if not ret:
@@ -95,7 +98,7 @@ def main():
             smbrr.smbrr.smbrr_free(image)
             continue
 
-        smbrr.smbrr.smbrr_wavelet_ksigma_clip(w, k_sigma, ctypes.c_float(sigma_delta))
+        smbrr.smbrr.smbrr_wavelet_ksigma_clip_state(w, k_sigma, ctypes.c_float(sigma_delta), noise_state)
 
         res = smbrr.smbrr.smbrr_wavelet_significant_deconvolution(w, smbrr.SMBRR_CONV_ATROUS, smbrr.SMBRR_WAVELET_MASK_LINEAR, gain_strength)
         
@@ -134,6 +137,7 @@ def main():
             break
 
     # Cleanup
+    smbrr.smbrr.smbrr_noise_state_free(noise_state)
     cap.release()
     cv2.destroyAllWindows()
 
@@ -33,6 +33,7 @@ struct smbrr_cl_context {
 	cl_kernel k_find_limits;
 	cl_kernel k_normalise;
 	cl_kernel k_anscombe;
+	cl_kernel k_anscombe_inverse;
 	cl_kernel k_mult_add;
 	cl_kernel k_mult_subtract;
 	cl_kernel k_copy_sig;
@@ -0,0 +1,47 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Copyright (C) 2026 Liam Girdwood
+ */
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+/**
+ * \def HISTOGRAM_BINS
+ * \brief Default number of histogram bins used for data statistics.
+ */
+#define HISTOGRAM_BINS 4096
+
+/**
+ * \struct histogram
+ * \brief Fixed range histogram of float data elements.
+ */
+struct histogram {
+	unsigned int *bin; /**< Bin counts. */
+	unsigned int num_bins; /**< Number of bins. */
+	unsigned int count; /**< Total elements binned. */
+	float min; /**< Value at start of first bin. */
+	float max; /**< Value at end of last bin. */
+	float scale; /**< Bins per unit value. */
+};
+
+int histogram_init(struct histogram *h, unsigned int num_bins, float min,
+				   float max);
+void histogram_free(struct histogram *h);
+void histogram_add(struct histogram *h, const float *data, unsigned int elems);
+float histogram_get_percentile(struct histogram *h, float percentile);
+
+#endif
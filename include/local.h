@@ -41,10 +41,48 @@
 #define CPU_X86_AVX512 16 /**< AVX512 capability. */
 /** @} */
 
+/** \cond */
+struct object_grid;
+struct mesh_scratch;
+
+/** \endcond */
+
 int cpu_get_flags(void);
 void check_cpu_flags(void);
 void smbrr_cl_sync(struct smbrr *s);
 void smbrr_wavelet_cl_sync(struct smbrr_wavelet *w);
+int object_grid_build(struct smbrr_wavelet *w);
+void object_grid_free(struct smbrr_wavelet *w);
+int object_grid_range(const struct object_grid *g, float x, float y,
+					  float radius, int *cx0, int *cy0, int *cx1, int *cy1);
+int mesh_scratch_init(struct mesh_scratch *m, unsigned int width,
+					  unsigned int height, unsigned int mesh);
+void mesh_scratch_free(struct mesh_scratch *m);
+int mesh_noise_map(struct smbrr *data, struct smbrr *sigma,
+				   struct mesh_scratch *m);
+
+/**
+ * \struct structure_span
+ * \brief Run of structure pixels on a single row.
+ */
+struct structure_span {
+	unsigned int y; /**< Row. */
+	unsigned int x0; /**< X coord of first pixel in run. */
+	unsigned int x1; /**< X coord of last pixel in run. */
+};
+
+/**
+ * \struct structure_moments
+ * \brief Coefficient weighted pixel sums of a structure.
+ */
+struct structure_moments {
+	double i; /**< Sum of I. */
+	double ix; /**< Sum of I.x. */
+	double iy; /**< Sum of I.y. */
+	double ixx; /**< Sum of I.x^2. */
+	double iyy; /**< Sum of I.y^2. */
+	double ixy; /**< Sum of I.x.y. */
+};
 
 /**
  * \struct structure
@@ -66,7 +104,10 @@ struct structure {
 	struct smbrr_coord maxxY; /**< Maximum X, Y coord. */
 	float max_value; /**< Maximum pixel value. */
 	unsigned int root; /**< Root ID. */
-	unsigned int *branch; /**< Branch ID pointers. */
+	unsigned int *branch; /**< Branch IDs in the scale branch array. */
+	struct structure_span *span; /**< Pixel runs in raster order. */
+	unsigned int num_spans; /**< Number of pixel runs. */
+	struct structure_moments m; /**< Moment sums accumulated when labelling. */
 };
 
 /**
@@ -87,6 +128,18 @@ struct object {
 	struct smbrr *data; /**< Reconstructed output data. */
 };
 
+/**
+ * \struct object_grid
+ * \brief Uniform grid of object positions for spatial queries.
+ */
+struct object_grid {
+	unsigned int *cell; /**< Start of each cell in object, cells + 1 entries. */
+	unsigned int *object; /**< Object indexes grouped by cell. */
+	unsigned int cell_size; /**< Cell width and height in pixels. */
+	unsigned int nx; /**< Cells per row. */
+	unsigned int ny; /**< Cells per column. */
+};
+
 /**
  * \struct wavelet_mask
  * \brief Convolution mask definition.
@@ -162,12 +215,22 @@ struct smbrr_wavelet {
 								1]; /**< Computed structural quantities. */
 	struct structure
 		*structure[SMBRR_MAX_SCALES - 1]; /**< Allocated internal structures. */
+	struct structure_span
+		*spans[SMBRR_MAX_SCALES - 1]; /**< Structure pixel runs per scale. */
+	unsigned int
+		*branches[SMBRR_MAX_SCALES - 1]; /**< Branch IDs of roots per scale. */
+	enum smbrr_structure_engine structure_engine; /**< Labelling engine. */
 
 	/* objects */
 	struct object *objects; /**< Active identified objects. */
 	struct object **objects_sorted; /**< Sorted composite structures. */
 	unsigned int num_objects; /**< Number of detected elements. */
-	struct object **object_map; /**< Component mapping matrix. */
+	void *object_map; /**< Object index + 1 per pixel, 0 for none. */
+	unsigned int object_map_size; /**< Bytes per object map entry, 2 or 4. */
+	struct smbrr *object_data; /**< Object data planes carved from arena. */
+	float *object_adu; /**< Arena backing the object data planes. */
+	unsigned int num_object_data; /**< Number of arena object data planes. */
+	struct object_grid grid; /**< Spatial index of object positions. */
 
 	/* dark */
 	float dark; /**< Baseline dark value. */
@@ -177,6 +240,137 @@ struct smbrr_wavelet {
 	float gain; /**< Global gain setting. */
 	float bias; /**< Global bias configuration. */
 	float readout; /**< General readout value. */
+
+	/* noise */
+	enum smbrr_clip_engine clip_engine; /**< K-sigma clipping engine. */
+	unsigned int noise_mesh; /**< Noise mesh size or 0 for global noise. */
+};
+
+/**
+ * \def SMBRR_OMP_MIN_ELEMS
+ * \brief Minimum elements before a data_ops kernel is split across threads.
+ *
+ * Below this size the fork and join cost of a parallel region exceeds the
+ * time of a single threaded vectorised sweep.
+ */
+#define SMBRR_OMP_MIN_ELEMS (64 * 1024)
+
+/**
+ * \def SMBRR_EXPR_MAX_NODES
+ * \brief Maximum number of operations recorded in an expression.
+ */
+#define SMBRR_EXPR_MAX_NODES 48
+
+/**
+ * \def SMBRR_EXPR_BLOCK
+ * \brief Elements evaluated per expression block. Operand blocks and the
+ * accumulator stay resident in L1 cache whilst every node is applied.
+ */
+#define SMBRR_EXPR_BLOCK 1024
+
+/**
+ * \enum expr_op
+ * \brief Deferred elementwise expression operations on the accumulator.
+ */
+enum expr_op {
+	EXPR_LOAD = 0, /**< acc = data */
+	EXPR_ADD, /**< acc += data */
+	EXPR_SUBTRACT, /**< acc -= data */
+	EXPR_MULT_ADD, /**< acc += data * value */
+	EXPR_SIG_ADD, /**< acc += data if sig */
+	EXPR_ADD_VALUE, /**< acc += value */
+	EXPR_MULT_VALUE, /**< acc *= value */
+	EXPR_ZERO_NEGATIVE, /**< acc = max(acc, 0) */
+	EXPR_ABS, /**< acc = |acc| */
+	EXPR_SIG_MASK, /**< acc = 0 if not sig */
+	EXPR_SCALE, /**< data *= value, in place */
+	EXPR_STORE, /**< data = acc */
+};
+
+/**
+ * \struct expr_node
+ * \brief Single recorded expression operation.
+ */
+struct expr_node {
+	enum expr_op op; /**< Operation. */
+	struct smbrr *data; /**< Float operand or destination. */
+	struct smbrr *sig; /**< Significance operand. */
+	float value; /**< Scalar operand. */
+};
+
+/**
+ * \struct noise_scale
+ * \brief Saved clipping statistics for one wavelet scale.
+ */
+struct noise_scale {
+	float mean; /**< Plane mean when last fully clipped. */
+	float sigma; /**< Plane sigma about mean. */
+	unsigned int age; /**< Frames since last full clip. */
+	int valid; /**< Statistics are valid. */
+};
+
+/**
+ * \struct mesh_scratch
+ * \brief Noise map buffers reused across the scales of a wavelet.
+ */
+struct mesh_scratch {
+	unsigned int width; /**< Data width. */
+	unsigned int height; /**< Data height. */
+	unsigned int mesh; /**< Mesh size in pixels. */
+	int nx; /**< Mesh nodes per row. */
+	int ny; /**< Mesh nodes per column. */
+	int cx; /**< Cells per row, each half a mesh on a side. */
+	int cy; /**< Cells per column. */
+	unsigned int *hist; /**< Cell histograms of the cell rows held. */
+	float *node; /**< Node sigmas. */
+	float *filt; /**< Median filtered node sigmas. */
+	float *sample; /**< Samples for the global median and MAD. */
+	int *span; /**< Column past the last between each pair of nodes. */
+	float *frac; /**< Interpolation weight of each column. */
+};
+
+/**
+ * \struct smbrr_noise_state
+ * \brief Clipping statistics carried between consecutive frames.
+ */
+struct smbrr_noise_state {
+	float tolerance; /**< Relative plane sigma change allowed for reuse. */
+	unsigned int max_age; /**< Frames before a forced full clip. */
+	unsigned int elems; /**< Plane size the state was saved for. */
+	unsigned int num_scales; /**< Scales the state was saved for. */
+	struct noise_scale scale[SMBRR_MAX_SCALES - 1]; /**< Per scale state. */
+};
+
+/**
+ * \struct smbrr_tracker
+ * \brief Object tracks carried between consecutive frames.
+ */
+struct smbrr_tracker {
+	struct smbrr_track *track; /**< Live tracks in order of creation. */
+	unsigned int num_tracks; /**< Number of live tracks. */
+	unsigned int max_tracks; /**< Allocated tracks. */
+	unsigned int next_id; /**< ID of the next new track. */
+	float radius; /**< Match radius around predicted positions. */
+	float flux_weight; /**< Weight of flux change against distance. */
+	unsigned int max_missed; /**< Missed frames before a track is dropped. */
+	unsigned int width; /**< Frame width of the last full update. */
+	unsigned int height; /**< Frame height of the last full update. */
+
+	/* matching scratch */
+	int *candidate; /**< Best object index per track or -1. */
+	uint64_t *claim; /**< Best track score per object, two passes. */
+	unsigned int max_objects; /**< Objects allocated in claim. */
+};
+
+/**
+ * \struct smbrr_expr
+ * \brief Recorded chain of elementwise operations evaluated in one sweep.
+ */
+struct smbrr_expr {
+	const struct data_ops *ops; /**< Data ops of first operand. */
+	unsigned int elems; /**< Element count of all operands. */
+	unsigned int num_nodes; /**< Number of recorded nodes. */
+	struct expr_node node[SMBRR_EXPR_MAX_NODES]; /**< Recorded nodes. */
 };
 
 static inline int data_get_offset(struct smbrr *data, int offx, int offy)
@@ -209,6 +403,71 @@ static inline int wavelet_get_y(struct smbrr_wavelet *w, unsigned int pixel)
 	return pixel / w->width;
 }
 
+static inline void structure_moments_add(struct structure_moments *m,
+										 float adu, unsigned int x,
+										 unsigned int y)
+{
+	double ix = (double)adu * x, iy = (double)adu * y;
+
+	m->i += adu;
+	m->ix += ix;
+	m->iy += iy;
+	m->ixx += ix * x;
+	m->iyy += iy * y;
+	m->ixy += ix * y;
+}
+
+/* object index + 1 at pixel or 0 when there is no object */
+static inline uint32_t object_map_get(struct smbrr_wavelet *w,
+									  unsigned int pixel)
+{
+	if (!w->object_map)
+		return 0;
+	if (w->object_map_size == sizeof(uint16_t))
+		return __atomic_load_n((uint16_t *)w->object_map + pixel,
+							   __ATOMIC_RELAXED);
+	return __atomic_load_n((uint32_t *)w->object_map + pixel,
+						   __ATOMIC_RELAXED);
+}
+
+/*
+ * Objects are reconstructed in parallel so the pixel keeps the object starting
+ * at the lowest scale, the first object wins ties as in a serial pass.
+ */
+static inline void object_map_insert(struct smbrr_wavelet *w,
+									 struct object *object, unsigned int pixel)
+{
+	uint32_t id = object - w->objects + 1, cur;
+	uint16_t cur16;
+	struct object *o;
+
+	if (!w->object_map)
+		return;
+
+	cur = object_map_get(w, pixel);
+	for (;;) {
+		if (cur) {
+			o = &w->objects[cur - 1];
+			if (object->start_scale > o->start_scale ||
+				(object->start_scale == o->start_scale && id >= cur))
+				return;
+		}
+
+		if (w->object_map_size == sizeof(uint16_t)) {
+			cur16 = cur;
+			if (__atomic_compare_exchange_n((uint16_t *)w->object_map + pixel,
+											&cur16, id, 1, __ATOMIC_RELAXED,
+											__ATOMIC_RELAXED))
+				return;
+			cur = cur16;
+		} else if (__atomic_compare_exchange_n((uint32_t *)w->object_map +
+												   pixel,
+											   &cur, id, 1, __ATOMIC_RELAXED,
+											   __ATOMIC_RELAXED))
+			return;
+	}
+}
+
 static inline int y_boundary(unsigned int height, int offy)
 {
 	unsigned int uoffy = offy >= 0 ? offy : -offy;
@@ -105,6 +105,37 @@ static const float k_amp[5][8] = {
     {1.0, 1.0, 1.5, 2.0, 4.0, 4.0, 4.0, 8.0}, /* low-mid pass */
 };
 
+/*
+ * Standard deviation of each wavelet scale for unit variance white noise,
+ * used to propagate a noise sigma measured on one scale to every scale. Each
+ * value is the L2 norm of the equivalent a trous filter for that scale. The 1D
+ * a trous transform applies the first row of the 2D mask so the 1D tables are
+ * taken from that row.
+ */
+static const float linear_noise_2d[SMBRR_MAX_SCALES - 1] = {
+    0.80039053, 0.272878894, 0.119779282, 0.0577664785, 0.0286163283,
+    0.0142747506, 0.00713319703, 0.00356607618, 0.0017829728, 0.000891478237,
+    0.000445738098,
+};
+
+static const float bicubic_noise_2d[SMBRR_MAX_SCALES - 1] = {
+    0.89079631, 0.200663851, 0.0855075048, 0.0412174444, 0.0204249666,
+    0.0101897592, 0.00509204668, 0.00254566946, 0.0012727905, 0.000636389722,
+    0.00031819417,
+};
+
+static const float linear_noise_1d[SMBRR_MAX_SCALES - 1] = {
+    0.879452955, 0.131426593, 0.0220430729, 0.00384230731, 0.000676805133,
+    0.000119535952, 2.11264205e-05, 3.73444884e-06, 6.60154246e-07,
+    1.16699476e-07, 2.06297296e-08,
+};
+
+static const float bicubic_noise_1d[SMBRR_MAX_SCALES - 1] = {
+    0.976828089, 0.0315117454, 0.00132005466, 5.76513115e-05, 2.54052571e-06,
+    1.12196195e-07, 4.95753352e-09, 2.1908433e-10, 9.68214303e-12,
+    4.2789312e-13, 1.89103697e-14,
+};
+
 static inline int conv_mask_set_2d(struct smbrr_wavelet *w,
                                    enum smbrr_wavelet_mask mask) {
   switch (mask) {
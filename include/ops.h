@@ -22,6 +22,8 @@
 /** \cond */
 struct smbrr;
 struct smbrr_wavelet;
+struct smbrr_expr;
+struct structure_span;
 
 /** \endcond */
 
@@ -80,14 +82,36 @@ struct data_ops {
 	void (*anscombe)(
 		struct smbrr *data, float gain, float bias,
 		float readout); /**< Anscombe variance stabilization transform. */
+	void (*anscombe_inverse)(
+		struct smbrr *data, float gain, float bias,
+		float readout); /**< Inverse Anscombe transform. */
+	int (*anscombe_convert)(
+		struct smbrr *data, enum smbrr_source_type adu, const void *src,
+		float gain, float bias,
+		float readout); /**< Convert source data with Anscombe transform. */
 	void (*new_significance)(struct smbrr *a, struct smbrr *s,
 							 float sigma); /**< Generate new significance map. */
+	void (*new_significance_map)(
+		struct smbrr *a, struct smbrr *s,
+		struct smbrr *thresh); /**< Significance map from threshold map. */
+	unsigned int (*new_significance_runs)(
+		struct smbrr *a, struct smbrr *s, float sigma, unsigned int y,
+		struct structure_span *runs); /**< Threshold row and find its runs. */
+	unsigned int (*significance_runs)(
+		struct smbrr *s, unsigned int y,
+		struct structure_span *runs); /**< Find runs in significance row. */
 	void (*find_limits)(struct smbrr *data, float *min,
 						float *max); /**< Find min/max bounds. */
 	int (*get)(struct smbrr *data, enum smbrr_source_type adu,
 			   void **buf); /**< Extract backing array pointer. */
+	int (*quantise)(struct smbrr *data, enum smbrr_source_type adu,
+					enum smbrr_stretch stretch, float min, float max,
+					float range,
+					void *buf); /**< Stretch and quantise display data. */
 	int (*psf)(struct smbrr *src, struct smbrr *dest,
 			   enum smbrr_wavelet_mask mask); /**< Generate PSF mapping. */
+	void (*expr_eval)(
+		const struct smbrr_expr *expr); /**< Evaluate fused expression. */
 
 	/* conversion */
 	void (*uchar_to_float)(
@@ -170,4 +194,10 @@ extern const struct convolution_ops conv_ops_1d_opencl;
 extern const struct convolution_ops conv_ops_2d_opencl;
 #endif
 
+/* runtime dispatch tables, resolved once by backend.c */
+const struct data_ops *backend_get_1d_ops(void);
+const struct data_ops *backend_get_2d_ops(void);
+const struct convolution_ops *backend_get_1d_conv_ops(void);
+const struct convolution_ops *backend_get_2d_conv_ops(void);
+
 #endif
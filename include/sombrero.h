@@ -170,6 +170,34 @@ enum smbrr_clip {
 	SMBRR_CLIP_VVSTRONG = 5, /**< Very very strong clipping */
 };
 
+/** \enum smbrr_clip_engine
+ * \brief K-sigma clipping engine.
+ *
+ * Method used by the K-sigma clipping functions to set the threshold at each
+ * scale. The plane engine thresholds each scale at the clipping coefficient
+ * times the sigma of that scale. The MAD engine measures the noise once on scale 0 from the median absolute deviation
+ * and propagates it to every scale using the white noise response of the mask,
+ * giving a single pass threshold per scale.
+ */
+enum smbrr_clip_engine {
+	SMBRR_CLIP_ENGINE_PLANE = 0, /**< Plane sigma (default) */
+	SMBRR_CLIP_ENGINE_MAD = 1, /**< Scale 0 MAD noise, single pass */
+};
+
+/** \enum smbrr_structure_engine
+ * \brief Structure labelling engines.
+ *
+ * Method used to find connected structures in the significance map at each
+ * scale. The flood fill engine grows one structure at a time from a seed
+ * pixel. The union-find engine labels strips of rows in parallel with
+ * 4-connectivity, merges labels across the strip seams and numbers the
+ * structures in raster order of their first pixel.
+ */
+enum smbrr_structure_engine {
+	SMBRR_STRUCTURE_ENGINE_FLOODFILL = 0, /**< Scanline flood fill (default) */
+	SMBRR_STRUCTURE_ENGINE_UNION_FIND = 1, /**< Parallel two pass union-find */
+};
+
 /** \enum smbrr_gain
  * \brief Wavelet data gain strengths.
  *
@@ -196,6 +224,38 @@ enum smbrr_object_type {
 	SMBRR_OBJECT_EXTENDED = 1, /**< Exteded / Diffuse object detected */
 };
 
+/** \enum smbrr_stretch
+ * \brief Display stretch applied when exporting data.
+ *
+ * Intensity transfer function used to map clipped pixel values onto the 8 or
+ * 16 bit output range. Non linear stretches bring out faint detail whilst
+ * compressing bright sources.
+ */
+enum smbrr_stretch {
+	SMBRR_STRETCH_LINEAR = 0, /**< Linear stretch */
+	SMBRR_STRETCH_ASINH = 1, /**< Inverse hyperbolic sine stretch */
+	SMBRR_STRETCH_LOG = 2, /**< Logarithmic stretch */
+};
+
+/** \enum smbrr_backend
+ * \brief Processing backend
+ *
+ * Instruction set or accelerator used by data and wavelet operations. The
+ * best available backend is selected automatically unless forced by
+ * smbrr_backend_set() or the SMBRR_BACKEND environment variable, which takes
+ * the backend name e.g. SMBRR_BACKEND=avx2.
+ */
+enum smbrr_backend {
+	SMBRR_BACKEND_AUTO = 0, /**< Best available backend */
+	SMBRR_BACKEND_SCALAR = 1, /**< Generic C */
+	SMBRR_BACKEND_SSE42 = 2, /**< x86 SSE 4.2 */
+	SMBRR_BACKEND_AVX = 3, /**< x86 AVX */
+	SMBRR_BACKEND_AVX2 = 4, /**< x86 AVX2 */
+	SMBRR_BACKEND_FMA = 5, /**< x86 FMA */
+	SMBRR_BACKEND_AVX512 = 6, /**< x86 AVX-512 */
+	SMBRR_BACKEND_OPENCL = 7, /**< OpenCL device */
+};
+
 /** \struct smbrr
  * \brief Sombrero data context.
  *
@@ -206,6 +266,23 @@ enum smbrr_object_type {
  */
 struct smbrr;
 
+/** \struct smbrr_expr
+ * \brief Elementwise expression.
+ *
+ * A recorded chain of elementwise operations over data contexts of equal
+ * size. The chain is evaluated in a single cache blocked sweep so that
+ * intermediate results are never written back to memory.
+ */
+struct smbrr_expr;
+
+/** \struct smbrr_noise_state
+ * \brief Opaque per scale clipping statistics carried between frames.
+ *
+ * Lets consecutive video frames reuse the plane mean of each scale while the
+ * noise is unchanged.
+ */
+struct smbrr_noise_state;
+
 /** \struct smbrr_coord
  * \brief Coordinates.
  *
@@ -235,7 +312,7 @@ struct smbrr_object {
 	struct smbrr_coord minxY; /**< Object data min Y coordinate */
 	struct smbrr_coord maxXy; /**< Object data max X coordinate */
 	struct smbrr_coord maxxY; /**< Object data max Y coordinate */
-	float pa; /**< Position angle  */
+	float pa; /**< Position angle in radians from X towards Y */
 
 	/* object aperture */
 	float object_adu; /**< Sum of all object pixels values */
@@ -254,6 +331,15 @@ struct smbrr_object {
 	float sigma_adu; /**< Standard deviation of pixels */
 	float mag_delta; /**< Magnitude difference to brightest object */
 	unsigned int scale; /**< Object wavelet scale */
+
+	/* moments of the object structure coefficients */
+	float structure_adu; /**< Sum of structure coefficients */
+	float cx; /**< Coefficient weighted centroid X */
+	float cy; /**< Coefficient weighted centroid Y */
+	float mxx; /**< Second moment in X about the centroid */
+	float myy; /**< Second moment in Y about the centroid */
+	float mxy; /**< Cross moment about the centroid */
+	float ellipticity; /**< 1 - minor / major axis */
 };
 
 /** \struct smbrr_structure
@@ -268,6 +354,29 @@ struct smbrr_structure {
 	float max_value; /**< Maximum pixel value */
 };
 
+/** \struct smbrr_track
+ * \brief Object tracked across consecutive frames.
+ */
+struct smbrr_track {
+	unsigned int id; /**< Persistent track ID, starting at 1 */
+	float x; /**< Frame X coordinate */
+	float y; /**< Frame Y coordinate */
+	float vx; /**< X velocity in pixels per frame */
+	float vy; /**< Y velocity in pixels per frame */
+	float flux; /**< Smoothed object ADU */
+	unsigned int age; /**< Frames since the track was created */
+	unsigned int missed; /**< Consecutive frames without a match */
+	struct smbrr_object *object; /**< Object matched by the last update */
+};
+
+/** \struct smbrr_tracker
+ * \brief Opaque object tracker carried between consecutive frames.
+ *
+ * Matches the objects of each new frame to tracks from the previous frame so
+ * that objects keep a persistent ID in video streams.
+ */
+struct smbrr_tracker;
+
 /** \struct smbrr_clip_coeff
  * \brief Custom K-sigma cliping coefficients for each scale.
  *
@@ -330,9 +439,30 @@ struct smbrr *smbrr_new(enum smbrr_data_type type, unsigned int width,
 						unsigned int height, unsigned int stride,
 						enum smbrr_source_type adu, const void *data);
 
+/**
+ * \brief Create a new float data context from source data, applying the
+ * Anscombe variance stabilising transform whilst converting the source data.
+ * \param type The data type format, SMBRR_DATA_1D_FLOAT or SMBRR_DATA_2D_FLOAT.
+ * \param width The width of the data element in pixels.
+ * \param height The height of the data element in pixels.
+ * \param stride The stride size of the data elements.
+ * \param adu The source type adu format.
+ * \param data The pointer to the source array.
+ * \param gain CCD amplifier gain in photo-electrons per ADU.
+ * \param bias Image bias in ADUs.
+ * \param readout Readout noise in RMS electrons.
+ * \return struct smbrr* A pointer to the new context or NULL on failure.
+ * \ingroup noise
+ */
+struct smbrr *smbrr_new_anscombe(enum smbrr_data_type type, unsigned int width,
+								 unsigned int height, unsigned int stride,
+								 enum smbrr_source_type adu, const void *data,
+								 float gain, float bias, float readout);
+
 /**
  * \brief Extract a rectangular sub-region from a 2D source context and allocate
  * it into a new context, preserving the original data type.
+ * \return New context, or NULL if the area is empty or outside the source.
  * \ingroup process
  */
 struct smbrr *smbrr_new_from_area(struct smbrr *s, unsigned int x_start,
@@ -377,6 +507,49 @@ int smbrr_init_opencl(int device_index);
  */
 void smbrr_free_opencl(void);
 
+/**
+ * \brief Check whether a backend is built and supported by this machine.
+ * \param backend The backend.
+ * \return 1 if available, 0 otherwise.
+ * \ingroup process
+ */
+int smbrr_backend_available(enum smbrr_backend backend);
+
+/**
+ * \brief List the backends available on this machine.
+ * \param list Array to store available backends or NULL.
+ * \param size Number of entries in list.
+ * \return Number of available backends.
+ * \ingroup process
+ */
+int smbrr_backend_list(enum smbrr_backend *list, int size);
+
+/**
+ * \brief Get the backend used for new data and wavelet contexts.
+ * \return The backend, never SMBRR_BACKEND_AUTO.
+ * \ingroup process
+ */
+enum smbrr_backend smbrr_backend_get(void);
+
+/**
+ * \brief Force the backend used for new data and wavelet contexts. Existing
+ * contexts keep their backend. OpenCL may be forced before smbrr_init_opencl()
+ * and falls back to the CPU until a context exists.
+ * \param backend The backend or SMBRR_BACKEND_AUTO for the best available.
+ * \return 0 on success, -EINVAL if unknown or -ENODEV if unavailable.
+ * \ingroup process
+ */
+int smbrr_backend_set(enum smbrr_backend backend);
+
+/**
+ * \brief Get the backend name as used by the SMBRR_BACKEND environment
+ * variable.
+ * \param backend The backend.
+ * \return Backend name or NULL if unknown.
+ * \ingroup process
+ */
+const char *smbrr_backend_name(enum smbrr_backend backend);
+
 /*
  * Element information.
  */
@@ -392,6 +565,23 @@ void smbrr_free_opencl(void);
  */
 int smbrr_get_data(struct smbrr *s, enum smbrr_source_type adu, void **data);
 
+/**
+ * \brief Export the pixel data as 8 or 16 bit display data in a single pass,
+ * fusing percentile clipping, stretching, normalisation and quantisation.
+ * \param s The active data element context.
+ * \param adu Output format, SMBRR_SOURCE_UINT8 or SMBRR_SOURCE_UINT16.
+ * \param stretch Intensity stretch applied to the clipped data.
+ * \param clip_low Lower clipping percentile (0.0 for data minimum).
+ * \param clip_high Upper clipping percentile (100.0 for data maximum).
+ * \param range Maximum output value or 0.0 for the full output type range.
+ * \param buf Output buffer of at least stride * height output elements.
+ * \return 0 on success, <0 on error.
+ * \ingroup process
+ */
+int smbrr_export(struct smbrr *s, enum smbrr_source_type adu,
+				 enum smbrr_stretch stretch, float clip_low, float clip_high,
+				 float range, void *buf);
+
 /**
  * \brief Retrieve the total number of initialized elements (width * height) in
  * the data context.
@@ -625,6 +815,18 @@ void smbrr_mult_subtract(struct smbrr *dest, struct smbrr *a, struct smbrr *b,
  */
 void smbrr_anscombe(struct smbrr *s, float gain, float bias, float readout);
 
+/**
+ * \brief Apply the inverse Anscombe transformation to map variance stabilised
+ * data back to ADUs.
+ * \param s The active data element context.
+ * \param gain CCD amplifier gain in photo-electrons per ADU.
+ * \param bias Image bias in ADUs.
+ * \param readout Readout noise in RMS electrons.
+ * \ingroup noise
+ */
+void smbrr_anscombe_inverse(struct smbrr *s, float gain, float bias,
+							float readout);
+
 /**
  * \brief Generate a boolean significance map S by thresholding context A
  * against a given sigma value.
@@ -632,6 +834,27 @@ void smbrr_anscombe(struct smbrr *s, float gain, float bias, float readout);
  */
 void smbrr_significant_new(struct smbrr *a, struct smbrr *s, float sigma);
 
+/**
+ * \brief Generate a boolean significance map S by thresholding context A
+ * against the matching pixel of a threshold map.
+ * \param a The data context to threshold.
+ * \param s The significance context to write.
+ * \param thresh The threshold map with the same dimensions as A.
+ * \ingroup noise
+ */
+void smbrr_significant_new_map(struct smbrr *a, struct smbrr *s,
+							   struct smbrr *thresh);
+
+/**
+ * \brief Create a spatially varying noise (sigma) map for context A.
+ * \param a The data context to measure.
+ * \param sigma The float noise map to write, same dimensions as A.
+ * \param mesh The mesh size in pixels, at least 2.
+ * \return 0 on success, -EINVAL for bad arguments or -ENOMEM.
+ * \ingroup noise
+ */
+int smbrr_noise_map(struct smbrr *a, struct smbrr *sigma, unsigned int mesh);
+
 /**
  * \brief Apply a Point Spread Function (PSF) convolution to the source data to
  * simulate or correct optical blurring.
@@ -654,6 +877,146 @@ float smbrr_get_adu_at_posn(struct smbrr *s, int x, int y);
  */
 float smbrr_get_adu_at_offset(struct smbrr *s, int offset);
 
+/**
+ * \brief Create a new empty elementwise expression.
+ * \return Pointer to new expression or NULL on failure.
+ * \ingroup process
+ */
+struct smbrr_expr *smbrr_expr_new(void);
+
+/**
+ * \brief Free an elementwise expression. Operands are not freed.
+ * \param e The expression.
+ * \ingroup process
+ */
+void smbrr_expr_free(struct smbrr_expr *e);
+
+/**
+ * \brief Remove all recorded operations from an expression.
+ * \param e The expression.
+ * \ingroup process
+ */
+void smbrr_expr_reset(struct smbrr_expr *e);
+
+/**
+ * \brief Record accumulator = A.
+ * \param e The expression.
+ * \param a Float data context A.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_load(struct smbrr_expr *e, struct smbrr *a);
+
+/**
+ * \brief Record accumulator += A.
+ * \param e The expression.
+ * \param a Float data context A.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_add(struct smbrr_expr *e, struct smbrr *a);
+
+/**
+ * \brief Record accumulator -= A.
+ * \param e The expression.
+ * \param a Float data context A.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_subtract(struct smbrr_expr *e, struct smbrr *a);
+
+/**
+ * \brief Record accumulator += A * c.
+ * \param e The expression.
+ * \param a Float data context A.
+ * \param c Multiplier.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_mult_add(struct smbrr_expr *e, struct smbrr *a, float c);
+
+/**
+ * \brief Record accumulator += A for pixels that are significant in S.
+ * \param e The expression.
+ * \param a Float data context A.
+ * \param s Significance data context.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_significant_add(struct smbrr_expr *e, struct smbrr *a,
+							   struct smbrr *s);
+
+/**
+ * \brief Record accumulator += value.
+ * \param e The expression.
+ * \param value Value to add.
+ * \return 0 on success, -ENOSPC when full.
+ * \ingroup process
+ */
+int smbrr_expr_add_value(struct smbrr_expr *e, float value);
+
+/**
+ * \brief Record accumulator *= value.
+ * \param e The expression.
+ * \param value Multiplier.
+ * \return 0 on success, -ENOSPC when full.
+ * \ingroup process
+ */
+int smbrr_expr_mult_value(struct smbrr_expr *e, float value);
+
+/**
+ * \brief Record clearing negative accumulator values to zero.
+ * \param e The expression.
+ * \return 0 on success, -ENOSPC when full.
+ * \ingroup process
+ */
+int smbrr_expr_zero_negative(struct smbrr_expr *e);
+
+/**
+ * \brief Record accumulator = |accumulator|.
+ * \param e The expression.
+ * \return 0 on success, -ENOSPC when full.
+ * \ingroup process
+ */
+int smbrr_expr_abs(struct smbrr_expr *e);
+
+/**
+ * \brief Record clearing accumulator values not significant in S.
+ * \param e The expression.
+ * \param s Significance data context.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_significant_mask(struct smbrr_expr *e, struct smbrr *s);
+
+/**
+ * \brief Record A *= value in place, leaving the accumulator unchanged.
+ * \param e The expression.
+ * \param a Float data context A.
+ * \param value Multiplier.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_scale(struct smbrr_expr *e, struct smbrr *a, float value);
+
+/**
+ * \brief Record dest = accumulator.
+ * \param e The expression.
+ * \param dest Float destination data context.
+ * \return 0 on success, -ENOSPC when full or -EINVAL on size mismatch.
+ * \ingroup process
+ */
+int smbrr_expr_store(struct smbrr_expr *e, struct smbrr *dest);
+
+/**
+ * \brief Evaluate a recorded expression in a single fused pass. The
+ * expression is kept and may be evaluated again.
+ * \param e The expression.
+ * \return 0 on success or -EINVAL if no operation has an element context.
+ * \ingroup process
+ */
+int smbrr_expr_eval(struct smbrr_expr *e);
+
 /**
  * \brief Iteratively rebuild the data context using wavelet convolutions
  * targeting noise-free threshold limits.
@@ -799,19 +1162,19 @@ int smbrr_wavelet_new_significant(struct smbrr_wavelet *w,
 								  enum smbrr_clip sigma_clip);
 
 /**
- * \brief Iteratively threshold each wavelet scale using standard pre-calculated
- * K-sigma deviation coefficients until convergence.
+ * \brief Threshold each wavelet scale using standard pre-calculated K-sigma
+ * deviation coefficients times the sigma of the scale. sig_delta is unused.
  * \ingroup noise
  */
 int smbrr_wavelet_ksigma_clip(struct smbrr_wavelet *w, enum smbrr_clip clip,
 							  float sig_delta);
 
 /**
- * \brief Iteratively threshold each wavelet scale using user-supplied deviation
- * coefficients until convergence.
+ * \brief Threshold each wavelet scale using user-supplied deviation
+ * coefficients times the sigma of the scale.
  * \param w A pointer to the initialized wavelet context representation.
  * \param coeff A struct of coefficients representing thresholds for scaling.
- * \param sig_delta Signal delta parameters that is added.
+ * \param sig_delta Unused, the threshold is set in a single pass.
  * \return 0 on success.
  * \ingroup noise
  */
@@ -819,6 +1182,82 @@ int smbrr_wavelet_ksigma_clip_custom(struct smbrr_wavelet *w,
 									 struct smbrr_clip_coeff *coeff,
 									 float sig_delta);
 
+/**
+ * \brief Threshold each wavelet scale controlling the false discovery rate
+ * with the Benjamini-Hochberg procedure.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param alpha The expected fraction of false detections, between 0 and 1.
+ * \return 0 on success, -EINVAL for a bad alpha or -ENOMEM.
+ * \ingroup noise
+ */
+int smbrr_wavelet_fdr_clip(struct smbrr_wavelet *w, float alpha);
+
+/**
+ * \brief Select the engine used by the K-sigma clipping functions.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param engine The clipping engine.
+ * \return 0 on success, -EINVAL for an unknown engine.
+ * \ingroup noise
+ */
+int smbrr_wavelet_set_clip_engine(struct smbrr_wavelet *w,
+								  enum smbrr_clip_engine engine);
+
+/**
+ * \brief Threshold wavelet scales against local noise maps measured on a mesh
+ * rather than a single sigma per scale.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param mesh The mesh size in pixels or 0 for a global sigma per scale.
+ * \return 0 on success, -EINVAL for a mesh size of 1.
+ * \ingroup noise
+ */
+int smbrr_wavelet_set_noise_mesh(struct smbrr_wavelet *w, unsigned int mesh);
+
+/**
+ * \brief Create a noise state that carries per scale clipping statistics
+ * between consecutive frames.
+ * \return Pointer to the new noise state or NULL on failure.
+ * \ingroup noise
+ */
+struct smbrr_noise_state *smbrr_noise_state_new(void);
+
+/**
+ * \brief Free a noise state.
+ * \param state The noise state to free.
+ * \ingroup noise
+ */
+void smbrr_noise_state_free(struct smbrr_noise_state *state);
+
+/**
+ * \brief Forget saved statistics so the next frame is fully clipped.
+ * \param state The noise state to reset.
+ * \ingroup noise
+ */
+void smbrr_noise_state_reset(struct smbrr_noise_state *state);
+
+/**
+ * \brief Set when saved statistics are reused or refreshed.
+ * \param state The noise state.
+ * \param tolerance Relative plane sigma change allowed before a full clip.
+ * \param max_age Frames a scale reuses saved statistics before a full clip.
+ * \return 0 on success, -EINVAL for a negative tolerance.
+ * \ingroup noise
+ */
+int smbrr_noise_state_set_tolerance(struct smbrr_noise_state *state,
+									float tolerance, unsigned int max_age);
+
+/**
+ * \brief Threshold each wavelet scale reusing the mean of the previous frame.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param clip The clipping strength.
+ * \param sig_delta Unused, kept to match smbrr_wavelet_ksigma_clip().
+ * \param state The noise state carried between frames.
+ * \return Number of scales that reused the saved mean or negative error.
+ * \ingroup noise
+ */
+int smbrr_wavelet_ksigma_clip_state(struct smbrr_wavelet *w,
+									enum smbrr_clip clip, float sig_delta,
+									struct smbrr_noise_state *state);
+
 /**
  * \brief Perform a connected-component analysis on the significance map at a
  * specific scale to logically group contiguous structural pixels.
@@ -826,6 +1265,37 @@ int smbrr_wavelet_ksigma_clip_custom(struct smbrr_wavelet *w,
  */
 int smbrr_wavelet_structure_find(struct smbrr_wavelet *w, unsigned int scale);
 
+/**
+ * \brief Find structures at every scale concurrently, syncing device buffers
+ * once.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \return Total number of structures over all scales or negative error.
+ * \ingroup object
+ */
+int smbrr_wavelet_structure_find_all(struct smbrr_wavelet *w);
+
+/**
+ * \brief Threshold the wavelet coefficients of a scale straight into runs of
+ * significant pixels and find structures from the runs.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param scale The wavelet scale.
+ * \param sigma The significance threshold.
+ * \return Number of structures found or negative error.
+ * \ingroup object
+ */
+int smbrr_wavelet_structure_find_threshold(struct smbrr_wavelet *w,
+										   unsigned int scale, float sigma);
+
+/**
+ * \brief Select the engine used to find structures at each scale.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param engine The structure labelling engine.
+ * \return 0 on success, -EINVAL for an unknown engine.
+ * \ingroup object
+ */
+int smbrr_wavelet_set_structure_engine(struct smbrr_wavelet *w,
+									   enum smbrr_structure_engine engine);
+
 /**
  * \brief Get the number of structures found at a specific scale.
  * \ingroup object
@@ -850,6 +1320,47 @@ int smbrr_wavelet_structure_connect(struct smbrr_wavelet *w,
 									unsigned int start_scale,
 									unsigned int end_scale);
 
+/**
+ * \brief Connect structures into objects and hand each measured object to a
+ * callback instead of keeping the reconstructed data of every object.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param start_scale Starting wavelet scale.
+ * \param end_scale Last wavelet scale.
+ * \param cb Callback for each object, data is NULL unless with_data is set
+ * and is only valid during the call. A negative return stops the stream.
+ * \param priv Private data passed to cb.
+ * \param with_data Pass the reconstructed object data to cb.
+ * \return Number of objects, negative error or the negative return of cb.
+ * \ingroup object
+ */
+int smbrr_wavelet_structure_connect_stream(struct smbrr_wavelet *w,
+										   unsigned int start_scale,
+										   unsigned int end_scale,
+										   int (*cb)(struct smbrr_wavelet *w,
+													 struct smbrr_object *object,
+													 struct smbrr *data,
+													 void *priv),
+										   void *priv, int with_data);
+
+/**
+ * \brief Connect structures and measure only the brightest objects.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param start_scale Starting wavelet scale.
+ * \param end_scale Last wavelet scale.
+ * \param count Number of brightest objects to keep.
+ * \return Number of objects kept, at most count, or a negative error.
+ *
+ * Objects are ranked on their peak structure and only a few times count
+ * candidates, plus the objects around their background annulus, are
+ * reconstructed. The kept objects are measured as by
+ * smbrr_wavelet_structure_connect() and no object data is kept.
+ * \ingroup object
+ */
+int smbrr_wavelet_structure_connect_top(struct smbrr_wavelet *w,
+										unsigned int start_scale,
+										unsigned int end_scale,
+										unsigned int count);
+
 /**
  * \brief Access the classification and boundary parameter data for a globally
  * identified structural object by its ID.
@@ -874,6 +1385,18 @@ int smbrr_wavelet_object_get_data(struct smbrr_wavelet *w,
 								  struct smbrr_object *object,
 								  struct smbrr **data);
 
+/**
+ * \brief Reconstruct the data of several objects in parallel.
+ * \param w A pointer to the initialized wavelet context representation.
+ * \param objects Objects to reconstruct, or NULL for every object.
+ * \param count Number of objects, ignored when objects is NULL.
+ * \return 0 on success or a negative error.
+ * \ingroup object
+ */
+int smbrr_wavelet_object_get_data_batch(struct smbrr_wavelet *w,
+										struct smbrr_object **objects,
+										unsigned int count);
+
 /**
  * \brief Identify and return the highest-priority object whose bounding
  * constraints overlap the given 2D coordinates.
@@ -882,6 +1405,127 @@ int smbrr_wavelet_object_get_data(struct smbrr_wavelet *w,
 struct smbrr_object *smbrr_wavelet_get_object_at_posn(struct smbrr_wavelet *w,
 													  int x, int y);
 
+/**
+ * \brief Find the objects whose position lies within an inclusive box.
+ * \return Number of objects in the box, at most size are stored.
+ * \ingroup object
+ */
+int smbrr_wavelet_object_find_box(struct smbrr_wavelet *w, int x0, int y0,
+								  int x1, int y1,
+								  struct smbrr_object **objects,
+								  unsigned int size);
+
+/**
+ * \brief Find the objects whose position lies within radius of (x,y).
+ * \return Number of objects within radius, at most size are stored.
+ * \ingroup object
+ */
+int smbrr_wavelet_object_find_radius(struct smbrr_wavelet *w, float x, float y,
+									 float radius,
+									 struct smbrr_object **objects,
+									 unsigned int size);
+
+/**
+ * \brief Find the k objects nearest to (x,y) in ascending order of distance.
+ * \return Number of objects found or -ENOMEM.
+ * \ingroup object
+ */
+int smbrr_wavelet_object_find_nearest(struct smbrr_wavelet *w, float x,
+									  float y, unsigned int k,
+									  struct smbrr_object **objects);
+
+/**
+ * \brief Cross match external catalogue positions to the nearest detected
+ * object within radius.
+ * \return Number of matched positions or -EINVAL.
+ * \ingroup object
+ */
+int smbrr_wavelet_object_match(struct smbrr_wavelet *w, const float *x,
+							   const float *y, unsigned int count,
+							   float radius, struct smbrr_object **match);
+
+/**
+ * \brief Create a tracker that keeps object IDs across consecutive frames.
+ * \param radius Match radius in pixels around predicted positions.
+ * \return Pointer to the new tracker or NULL on failure.
+ * \ingroup object
+ */
+struct smbrr_tracker *smbrr_tracker_new(float radius);
+
+/**
+ * \brief Free a tracker.
+ * \param t The tracker to free.
+ * \ingroup object
+ */
+void smbrr_tracker_free(struct smbrr_tracker *t);
+
+/**
+ * \brief Drop all tracks, for example on a scene change.
+ * \param t The tracker to reset.
+ * \ingroup object
+ */
+void smbrr_tracker_reset(struct smbrr_tracker *t);
+
+/**
+ * \brief Set how objects are scored against tracks.
+ * \param t The tracker.
+ * \param flux_weight Weight of the squared log flux ratio.
+ * \param max_missed Consecutive missed frames before a track is dropped.
+ * \return 0 on success, -EINVAL for a negative flux weight.
+ * \ingroup object
+ */
+int smbrr_tracker_set_matching(struct smbrr_tracker *t, float flux_weight,
+							   unsigned int max_missed);
+
+/**
+ * \brief Match the connected objects of the next frame to the tracks.
+ * \param t The tracker.
+ * \param w Wavelet with connected objects of the next frame.
+ * \return Number of live tracks or negative error.
+ * \ingroup object
+ */
+int smbrr_tracker_update(struct smbrr_tracker *t, struct smbrr_wavelet *w);
+
+/**
+ * \brief Match objects detected in an area of the next frame to the tracks
+ * predicted inside the area.
+ * \param t The tracker.
+ * \param w Wavelet with connected objects of the area.
+ * \param x_start Frame X coordinate of the area origin.
+ * \param y_start Frame Y coordinate of the area origin.
+ * \return Number of live tracks or negative error.
+ * \ingroup object
+ */
+int smbrr_tracker_update_area(struct smbrr_tracker *t, struct smbrr_wavelet *w,
+							  unsigned int x_start, unsigned int y_start);
+
+/**
+ * \brief Get the frame area around the predicted position of every track.
+ * \param t The tracker.
+ * \param margin Margin in pixels around the predicted positions.
+ * \param start Area start coordinate.
+ * \param end Area end coordinate, exclusive.
+ * \return 0 on success, -ENODATA when there is nothing to predict.
+ * \ingroup object
+ */
+int smbrr_tracker_predict_area(struct smbrr_tracker *t, unsigned int margin,
+							   struct smbrr_coord *start,
+							   struct smbrr_coord *end);
+
+/**
+ * \brief Get the number of live tracks.
+ * \ingroup object
+ */
+unsigned int smbrr_tracker_get_num_tracks(struct smbrr_tracker *t);
+
+/**
+ * \brief Get a live track by index, tracks are in order of creation.
+ * \return 0 on success, -EINVAL for an invalid index.
+ * \ingroup object
+ */
+int smbrr_tracker_get_track(struct smbrr_tracker *t, unsigned int index,
+							struct smbrr_track *track);
+
 /**
  * 	float dark);
  * \brief Manually inject a static background dark noise mean to calibrate
@@ -1,7 +1,7 @@
 import ctypes
 import os
 import sys
-from ctypes import POINTER, c_int, c_uint, c_float, c_void_p, Structure, byref
+from ctypes import CFUNCTYPE, POINTER, c_int, c_uint, c_float, c_void_p, c_char_p, Structure, byref
 
 # Helper to find and load the library
 def _load_libsombrero():
@@ -51,6 +51,23 @@ SMBRR_CLIP_STRONG = 3
 SMBRR_CLIP_VSTRONG = 4
 SMBRR_CLIP_VVSTRONG = 5
 
+# enum smbrr_backend
+SMBRR_BACKEND_AUTO = 0
+SMBRR_BACKEND_SCALAR = 1
+SMBRR_BACKEND_SSE42 = 2
+SMBRR_BACKEND_AVX = 3
+SMBRR_BACKEND_AVX2 = 4
+SMBRR_BACKEND_FMA = 5
+SMBRR_BACKEND_AVX512 = 6
+SMBRR_BACKEND_OPENCL = 7
+
+# enum smbrr_clip_engine
+SMBRR_CLIP_ENGINE_PLANE = 0
+SMBRR_CLIP_ENGINE_MAD = 1
+
+SMBRR_STRUCTURE_ENGINE_FLOODFILL = 0
+SMBRR_STRUCTURE_ENGINE_UNION_FIND = 1
+
 # enum smbrr_gain
 SMBRR_GAIN_NONE = 0
 SMBRR_GAIN_LOW = 1
@@ -62,6 +79,11 @@ SMBRR_GAIN_LOWMID = 4
 SMBRR_OBJECT_POINT = 0
 SMBRR_OBJECT_EXTENDED = 1
 
+# enum smbrr_stretch
+SMBRR_STRETCH_LINEAR = 0
+SMBRR_STRETCH_ASINH = 1
+SMBRR_STRETCH_LOG = 2
+
 # --- Structures ---
 class SmbrrCoord(Structure):
     _fields_ = [
@@ -90,7 +112,14 @@ class SmbrrObject(Structure):
         ("mean_adu", c_float),
         ("sigma_adu", c_float),
         ("mag_delta", c_float),
-        ("scale", c_uint)
+        ("scale", c_uint),
+        ("structure_adu", c_float),
+        ("cx", c_float),
+        ("cy", c_float),
+        ("mxx", c_float),
+        ("myy", c_float),
+        ("mxy", c_float),
+        ("ellipticity", c_float)
     ]
 
 class SmbrrStructure(Structure):
@@ -103,6 +132,19 @@ class SmbrrStructure(Structure):
         ("max_value", c_float)
     ]
 
+class SmbrrTrack(Structure):
+    _fields_ = [
+        ("id", c_uint),
+        ("x", c_float),
+        ("y", c_float),
+        ("vx", c_float),
+        ("vy", c_float),
+        ("flux", c_float),
+        ("age", c_uint),
+        ("missed", c_uint),
+        ("object", POINTER(SmbrrObject))
+    ]
+
 class SmbrrClipCoeff(Structure):
     _fields_ = [
         ("coeff", c_float * (SMBRR_MAX_SCALES - 1))
@@ -118,6 +160,9 @@ smbrr_wavelet_p = c_void_p
 smbrr.smbrr_new.argtypes = [c_int, c_uint, c_uint, c_uint, c_int, c_void_p]
 smbrr.smbrr_new.restype = smbrr_p
 
+smbrr.smbrr_new_anscombe.argtypes = [c_int, c_uint, c_uint, c_uint, c_int, c_void_p, c_float, c_float, c_float]
+smbrr.smbrr_new_anscombe.restype = smbrr_p
+
 smbrr.smbrr_new_from_area.argtypes = [smbrr_p, c_uint, c_uint, c_uint, c_uint]
 smbrr.smbrr_new_from_area.restype = smbrr_p
 
@@ -138,10 +183,28 @@ if hasattr(smbrr, 'smbrr_free_opencl'):
     smbrr.smbrr_free_opencl.argtypes = []
     smbrr.smbrr_free_opencl.restype = None
 
+smbrr.smbrr_backend_available.argtypes = [c_int]
+smbrr.smbrr_backend_available.restype = c_int
+
+smbrr.smbrr_backend_list.argtypes = [POINTER(c_int), c_int]
+smbrr.smbrr_backend_list.restype = c_int
+
+smbrr.smbrr_backend_get.argtypes = []
+smbrr.smbrr_backend_get.restype = c_int
+
+smbrr.smbrr_backend_set.argtypes = [c_int]
+smbrr.smbrr_backend_set.restype = c_int
+
+smbrr.smbrr_backend_name.argtypes = [c_int]
+smbrr.smbrr_backend_name.restype = c_char_p
+
 # Element Information
 smbrr.smbrr_get_data.argtypes = [smbrr_p, c_int, POINTER(c_void_p)]
 smbrr.smbrr_get_data.restype = c_int
 
+smbrr.smbrr_export.argtypes = [smbrr_p, c_int, c_int, c_float, c_float, c_float, c_void_p]
+smbrr.smbrr_export.restype = c_int
+
 smbrr.smbrr_get_size.argtypes = [smbrr_p]
 smbrr.smbrr_get_size.restype = c_int
 
@@ -239,9 +302,66 @@ smbrr.smbrr_mult_subtract.restype = None
 smbrr.smbrr_anscombe.argtypes = [smbrr_p, c_float, c_float, c_float]
 smbrr.smbrr_anscombe.restype = None
 
+smbrr.smbrr_anscombe_inverse.argtypes = [smbrr_p, c_float, c_float, c_float]
+smbrr.smbrr_anscombe_inverse.restype = None
+
+smbrr.smbrr_expr_new.argtypes = []
+smbrr.smbrr_expr_new.restype = c_void_p
+
+smbrr.smbrr_expr_free.argtypes = [c_void_p]
+smbrr.smbrr_expr_free.restype = None
+
+smbrr.smbrr_expr_reset.argtypes = [c_void_p]
+smbrr.smbrr_expr_reset.restype = None
+
+smbrr.smbrr_expr_load.argtypes = [c_void_p, smbrr_p]
+smbrr.smbrr_expr_load.restype = c_int
+
+smbrr.smbrr_expr_add.argtypes = [c_void_p, smbrr_p]
+smbrr.smbrr_expr_add.restype = c_int
+
+smbrr.smbrr_expr_subtract.argtypes = [c_void_p, smbrr_p]
+smbrr.smbrr_expr_subtract.restype = c_int
+
+smbrr.smbrr_expr_mult_add.argtypes = [c_void_p, smbrr_p, c_float]
+smbrr.smbrr_expr_mult_add.restype = c_int
+
+smbrr.smbrr_expr_significant_add.argtypes = [c_void_p, smbrr_p, smbrr_p]
+smbrr.smbrr_expr_significant_add.restype = c_int
+
+smbrr.smbrr_expr_add_value.argtypes = [c_void_p, c_float]
+smbrr.smbrr_expr_add_value.restype = c_int
+
+smbrr.smbrr_expr_mult_value.argtypes = [c_void_p, c_float]
+smbrr.smbrr_expr_mult_value.restype = c_int
+
+smbrr.smbrr_expr_zero_negative.argtypes = [c_void_p]
+smbrr.smbrr_expr_zero_negative.restype = c_int
+
+smbrr.smbrr_expr_abs.argtypes = [c_void_p]
+smbrr.smbrr_expr_abs.restype = c_int
+
+smbrr.smbrr_expr_significant_mask.argtypes = [c_void_p, smbrr_p]
+smbrr.smbrr_expr_significant_mask.restype = c_int
+
+smbrr.smbrr_expr_scale.argtypes = [c_void_p, smbrr_p, c_float]
+smbrr.smbrr_expr_scale.restype = c_int
+
+smbrr.smbrr_expr_store.argtypes = [c_void_p, smbrr_p]
+smbrr.smbrr_expr_store.restype = c_int
+
+smbrr.smbrr_expr_eval.argtypes = [c_void_p]
+smbrr.smbrr_expr_eval.restype = c_int
+
 smbrr.smbrr_significant_new.argtypes = [smbrr_p, smbrr_p, c_float]
 smbrr.smbrr_significant_new.restype = None
 
+smbrr.smbrr_significant_new_map.argtypes = [smbrr_p, smbrr_p, smbrr_p]
+smbrr.smbrr_significant_new_map.restype = None
+
+smbrr.smbrr_noise_map.argtypes = [smbrr_p, smbrr_p, c_uint]
+smbrr.smbrr_noise_map.restype = c_int
+
 smbrr.smbrr_psf.argtypes = [smbrr_p, smbrr_p, c_int]
 smbrr.smbrr_psf.restype = c_int
 
@@ -312,10 +432,43 @@ smbrr.smbrr_wavelet_ksigma_clip.restype = c_int
 smbrr.smbrr_wavelet_ksigma_clip_custom.argtypes = [smbrr_wavelet_p, POINTER(SmbrrClipCoeff), c_float]
 smbrr.smbrr_wavelet_ksigma_clip_custom.restype = c_int
 
+smbrr.smbrr_wavelet_fdr_clip.argtypes = [smbrr_wavelet_p, c_float]
+smbrr.smbrr_wavelet_fdr_clip.restype = c_int
+
+smbrr.smbrr_wavelet_set_clip_engine.argtypes = [smbrr_wavelet_p, c_int]
+smbrr.smbrr_wavelet_set_clip_engine.restype = c_int
+
+smbrr.smbrr_wavelet_set_noise_mesh.argtypes = [smbrr_wavelet_p, c_uint]
+smbrr.smbrr_wavelet_set_noise_mesh.restype = c_int
+
+smbrr.smbrr_noise_state_new.argtypes = []
+smbrr.smbrr_noise_state_new.restype = c_void_p
+
+smbrr.smbrr_noise_state_free.argtypes = [c_void_p]
+smbrr.smbrr_noise_state_free.restype = None
+
+smbrr.smbrr_noise_state_reset.argtypes = [c_void_p]
+smbrr.smbrr_noise_state_reset.restype = None
+
+smbrr.smbrr_noise_state_set_tolerance.argtypes = [c_void_p, c_float, c_uint]
+smbrr.smbrr_noise_state_set_tolerance.restype = c_int
+
+smbrr.smbrr_wavelet_ksigma_clip_state.argtypes = [smbrr_wavelet_p, c_int, c_float, c_void_p]
+smbrr.smbrr_wavelet_ksigma_clip_state.restype = c_int
+
 # Object Finding
 smbrr.smbrr_wavelet_structure_find.argtypes = [smbrr_wavelet_p, c_uint]
 smbrr.smbrr_wavelet_structure_find.restype = c_int
 
+smbrr.smbrr_wavelet_structure_find_all.argtypes = [smbrr_wavelet_p]
+smbrr.smbrr_wavelet_structure_find_all.restype = c_int
+
+smbrr.smbrr_wavelet_structure_find_threshold.argtypes = [smbrr_wavelet_p, c_uint, c_float]
+smbrr.smbrr_wavelet_structure_find_threshold.restype = c_int
+
+smbrr.smbrr_wavelet_set_structure_engine.argtypes = [smbrr_wavelet_p, c_int]
+smbrr.smbrr_wavelet_set_structure_engine.restype = c_int
+
 smbrr.smbrr_wavelet_get_num_structures.argtypes = [smbrr_wavelet_p, c_uint]
 smbrr.smbrr_wavelet_get_num_structures.restype = c_uint
 
@@ -325,6 +478,15 @@ smbrr.smbrr_wavelet_get_structure.restype = c_int
 smbrr.smbrr_wavelet_structure_connect.argtypes = [smbrr_wavelet_p, c_uint, c_uint]
 smbrr.smbrr_wavelet_structure_connect.restype = c_int
 
+# int (*cb)(struct smbrr_wavelet *w, struct smbrr_object *object, struct smbrr *data, void *priv)
+SmbrrObjectCb = CFUNCTYPE(c_int, smbrr_wavelet_p, POINTER(SmbrrObject), smbrr_p, c_void_p)
+
+smbrr.smbrr_wavelet_structure_connect_stream.argtypes = [smbrr_wavelet_p, c_uint, c_uint, SmbrrObjectCb, c_void_p, c_int]
+smbrr.smbrr_wavelet_structure_connect_stream.restype = c_int
+
+smbrr.smbrr_wavelet_structure_connect_top.argtypes = [smbrr_wavelet_p, c_uint, c_uint, c_uint]
+smbrr.smbrr_wavelet_structure_connect_top.restype = c_int
+
 smbrr.smbrr_wavelet_object_get.argtypes = [smbrr_wavelet_p, c_uint]
 smbrr.smbrr_wavelet_object_get.restype = POINTER(SmbrrObject)
 
@@ -334,9 +496,51 @@ smbrr.smbrr_wavelet_object_free_all.restype = None
 smbrr.smbrr_wavelet_object_get_data.argtypes = [smbrr_wavelet_p, POINTER(SmbrrObject), POINTER(smbrr_p)]
 smbrr.smbrr_wavelet_object_get_data.restype = c_int
 
+smbrr.smbrr_wavelet_object_get_data_batch.argtypes = [smbrr_wavelet_p, POINTER(POINTER(SmbrrObject)), c_uint]
+smbrr.smbrr_wavelet_object_get_data_batch.restype = c_int
+
 smbrr.smbrr_wavelet_get_object_at_posn.argtypes = [smbrr_wavelet_p, c_int, c_int]
 smbrr.smbrr_wavelet_get_object_at_posn.restype = POINTER(SmbrrObject)
 
+smbrr.smbrr_wavelet_object_find_box.argtypes = [smbrr_wavelet_p, c_int, c_int, c_int, c_int, POINTER(POINTER(SmbrrObject)), c_uint]
+smbrr.smbrr_wavelet_object_find_box.restype = c_int
+
+smbrr.smbrr_wavelet_object_find_radius.argtypes = [smbrr_wavelet_p, c_float, c_float, c_float, POINTER(POINTER(SmbrrObject)), c_uint]
+smbrr.smbrr_wavelet_object_find_radius.restype = c_int
+
+smbrr.smbrr_wavelet_object_find_nearest.argtypes = [smbrr_wavelet_p, c_float, c_float, c_uint, POINTER(POINTER(SmbrrObject))]
+smbrr.smbrr_wavelet_object_find_nearest.restype = c_int
+
+smbrr.smbrr_wavelet_object_match.argtypes = [smbrr_wavelet_p, POINTER(c_float), POINTER(c_float), c_uint, c_float, POINTER(POINTER(SmbrrObject))]
+smbrr.smbrr_wavelet_object_match.restype = c_int
+
+smbrr.smbrr_tracker_new.argtypes = [c_float]
+smbrr.smbrr_tracker_new.restype = c_void_p
+
+smbrr.smbrr_tracker_free.argtypes = [c_void_p]
+smbrr.smbrr_tracker_free.restype = None
+
+smbrr.smbrr_tracker_reset.argtypes = [c_void_p]
+smbrr.smbrr_tracker_reset.restype = None
+
+smbrr.smbrr_tracker_set_matching.argtypes = [c_void_p, c_float, c_uint]
+smbrr.smbrr_tracker_set_matching.restype = c_int
+
+smbrr.smbrr_tracker_update.argtypes = [c_void_p, smbrr_wavelet_p]
+smbrr.smbrr_tracker_update.restype = c_int
+
+smbrr.smbrr_tracker_update_area.argtypes = [c_void_p, smbrr_wavelet_p, c_uint, c_uint]
+smbrr.smbrr_tracker_update_area.restype = c_int
+
+smbrr.smbrr_tracker_predict_area.argtypes = [c_void_p, c_uint, POINTER(SmbrrCoord), POINTER(SmbrrCoord)]
+smbrr.smbrr_tracker_predict_area.restype = c_int
+
+smbrr.smbrr_tracker_get_num_tracks.argtypes = [c_void_p]
+smbrr.smbrr_tracker_get_num_tracks.restype = c_uint
+
+smbrr.smbrr_tracker_get_track.argtypes = [c_void_p, c_uint, POINTER(SmbrrTrack)]
+smbrr.smbrr_tracker_get_track.restype = c_int
+
 smbrr.smbrr_wavelet_set_dark_mean.argtypes = [smbrr_wavelet_p, c_float]
 smbrr.smbrr_wavelet_set_dark_mean.restype = c_int
 
@@ -0,0 +1,302 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Copyright (C) 2026 Liam Girdwood
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "local.h"
+#include "ops.h"
+#include "sombrero.h"
+
+#define BACKEND_NUM (SMBRR_BACKEND_OPENCL + 1)
+
+struct backend {
+	unsigned int cpu_flags; /* CPU capability required by backend */
+	const struct data_ops *ops_1d;
+	const struct data_ops *ops_2d;
+	const struct convolution_ops *conv_1d;
+	const struct convolution_ops *conv_2d;
+};
+
+static const char *backend_names[BACKEND_NUM] = {
+	[SMBRR_BACKEND_AUTO] = "auto",
+	[SMBRR_BACKEND_SCALAR] = "scalar",
+	[SMBRR_BACKEND_SSE42] = "sse42",
+	[SMBRR_BACKEND_AVX] = "avx",
+	[SMBRR_BACKEND_AVX2] = "avx2",
+	[SMBRR_BACKEND_FMA] = "fma",
+	[SMBRR_BACKEND_AVX512] = "avx512",
+	[SMBRR_BACKEND_OPENCL] = "opencl",
+};
+
+/* backends that are not built have NULL ops */
+static const struct backend backends[BACKEND_NUM] = {
+	[SMBRR_BACKEND_SCALAR] = { 0, &data_ops_1d, &data_ops_2d, &conv_ops_1d,
+							   &conv_ops_2d },
+#if defined HAVE_SSE42
+	[SMBRR_BACKEND_SSE42] = { CPU_X86_SSE4_2, &data_ops_1d_sse42,
+							  &data_ops_2d_sse42, &conv_ops_1d_sse42,
+							  &conv_ops_2d_sse42 },
+#endif
+#if defined HAVE_AVX
+	[SMBRR_BACKEND_AVX] = { CPU_X86_AVX, &data_ops_1d_avx, &data_ops_2d_avx,
+							&conv_ops_1d_avx, &conv_ops_2d_avx },
+#endif
+#if defined HAVE_AVX2
+	[SMBRR_BACKEND_AVX2] = { CPU_X86_AVX2, &data_ops_1d_avx2, &data_ops_2d_avx2,
+							 &conv_ops_1d_avx2, &conv_ops_2d_avx2 },
+#endif
+#if defined HAVE_FMA
+	[SMBRR_BACKEND_FMA] = { CPU_X86_FMA, &data_ops_1d_fma, &data_ops_2d_fma,
+							&conv_ops_1d_fma, &conv_ops_2d_fma },
+#endif
+#if defined HAVE_AVX512
+	[SMBRR_BACKEND_AVX512] = { CPU_X86_AVX512, &data_ops_1d_avx512,
+							   &data_ops_2d_avx512, &conv_ops_1d_avx512,
+							   &conv_ops_2d_avx512 },
+#endif
+#ifdef HAVE_OPENCL
+	[SMBRR_BACKEND_OPENCL] = { 0, &data_ops_1d_opencl, &data_ops_2d_opencl,
+							   &conv_ops_1d_opencl, &conv_ops_2d_opencl },
+#endif
+};
+
+/* CPU backends in order of preference for automatic selection */
+static const enum smbrr_backend backend_priority[] = {
+	SMBRR_BACKEND_AVX512,
+	SMBRR_BACKEND_FMA,
+	SMBRR_BACKEND_AVX2,
+	SMBRR_BACKEND_AVX,
+	SMBRR_BACKEND_SSE42,
+};
+
+/*
+ * Dispatch state is resolved once on first use. Every entry point runs
+ * backend_init() through pthread_once() so the environment override is applied
+ * before any smbrr_backend_set() and concurrent first callers are serialised.
+ */
+static pthread_once_t backend_once = PTHREAD_ONCE_INIT;
+static unsigned int backend_cpu_flags;
+static enum smbrr_backend backend_cpu = SMBRR_BACKEND_SCALAR;
+static enum smbrr_backend backend_selected = SMBRR_BACKEND_AUTO;
+
+static int backend_opencl_ready(void)
+{
+#ifdef HAVE_OPENCL
+	return g_cl_ctx != NULL;
+#else
+	return 0;
+#endif
+}
+
+static int backend_is_available(enum smbrr_backend backend)
+{
+	const struct backend *b;
+
+	if (backend == SMBRR_BACKEND_AUTO)
+		return 1;
+
+	b = &backends[backend];
+	if (b->ops_1d == NULL)
+		return 0;
+
+	if (backend == SMBRR_BACKEND_OPENCL)
+		return backend_opencl_ready();
+
+	return (backend_cpu_flags & b->cpu_flags) == b->cpu_flags;
+}
+
+/* OpenCL can be forced before its context exists and falls back to CPU */
+static int backend_can_force(enum smbrr_backend backend)
+{
+	if (backends[backend].ops_1d == NULL && backend != SMBRR_BACKEND_AUTO)
+		return 0;
+
+	return backend == SMBRR_BACKEND_OPENCL || backend_is_available(backend);
+}
+
+static int backend_from_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < BACKEND_NUM; i++) {
+		if (!strcmp(name, backend_names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+static void backend_init(void)
+{
+	enum smbrr_backend backend = SMBRR_BACKEND_SCALAR;
+	const char *env;
+	int i, forced;
+
+	backend_cpu_flags = cpu_get_flags();
+
+	for (i = 0; i < sizeof(backend_priority) / sizeof(backend_priority[0]);
+		 i++) {
+		if (backends[backend_priority[i]].ops_1d &&
+			backend_is_available(backend_priority[i])) {
+			backend = backend_priority[i];
+			break;
+		}
+	}
+	backend_cpu = backend;
+
+	/* unknown or unsupported overrides are ignored */
+	env = getenv("SMBRR_BACKEND");
+	if (env) {
+		forced = backend_from_name(env);
+		if (forced >= 0 && backend_can_force(forced))
+			backend_selected = forced;
+	}
+}
+
+static const struct backend *backend_current(void)
+{
+	pthread_once(&backend_once, backend_init);
+
+	switch (backend_selected) {
+	case SMBRR_BACKEND_AUTO:
+		if (backend_opencl_ready())
+			return &backends[SMBRR_BACKEND_OPENCL];
+		return &backends[backend_cpu];
+	case SMBRR_BACKEND_OPENCL:
+		/* forced OpenCL falls back to CPU until a context exists */
+		if (!backend_opencl_ready())
+			return &backends[backend_cpu];
+		return &backends[SMBRR_BACKEND_OPENCL];
+	default:
+		return &backends[backend_selected];
+	}
+}
+
+const struct data_ops *backend_get_1d_ops(void)
+{
+	return backend_current()->ops_1d;
+}
+
+const struct data_ops *backend_get_2d_ops(void)
+{
+	return backend_current()->ops_2d;
+}
+
+const struct convolution_ops *backend_get_1d_conv_ops(void)
+{
+	return backend_current()->conv_1d;
+}
+
+const struct convolution_ops *backend_get_2d_conv_ops(void)
+{
+	return backend_current()->conv_2d;
+}
+
+/**
+ * \param backend Backend
+ * \return 1 if backend is built and supported by this machine, 0 otherwise.
+ *
+ * Check whether a backend can be selected. OpenCL is only available after
+ * smbrr_init_opencl() succeeds.
+ */
+int smbrr_backend_available(enum smbrr_backend backend)
+{
+	if ((int)backend < 0 || backend >= BACKEND_NUM)
+		return 0;
+
+	pthread_once(&backend_once, backend_init);
+
+	return backend_is_available(backend);
+}
+
+/**
+ * \param list Array to store available backends or NULL.
+ * \param size Number of entries in list.
+ * \return Number of available backends.
+ *
+ * List the backends that can be selected on this machine, excluding
+ * SMBRR_BACKEND_AUTO.
+ */
+int smbrr_backend_list(enum smbrr_backend *list, int size)
+{
+	int i, count = 0;
+
+	for (i = SMBRR_BACKEND_SCALAR; i < BACKEND_NUM; i++) {
+		if (!smbrr_backend_available(i))
+			continue;
+		if (list && count < size)
+			list[count] = i;
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * \return Backend used for new data and wavelet contexts.
+ *
+ * Get the backend that is currently used. This is never SMBRR_BACKEND_AUTO.
+ */
+enum smbrr_backend smbrr_backend_get(void)
+{
+	const struct backend *b = backend_current();
+
+	return b - backends;
+}
+
+/**
+ * \param backend Backend or SMBRR_BACKEND_AUTO for best available.
+ * \return 0 on success, -EINVAL for unknown backend or -ENODEV if backend is
+ * not available.
+ *
+ * Force the backend used by data and wavelet contexts created after this call.
+ * Existing contexts keep their backend. This overrides the SMBRR_BACKEND
+ * environment variable. Like the environment variable, OpenCL can be forced
+ * before smbrr_init_opencl() and the CPU backend is used until a context
+ * exists.
+ */
+int smbrr_backend_set(enum smbrr_backend backend)
+{
+	if ((int)backend < 0 || backend >= BACKEND_NUM)
+		return -EINVAL;
+
+	pthread_once(&backend_once, backend_init);
+	if (!backend_can_force(backend))
+		return -ENODEV;
+
+	backend_selected = backend;
+	return 0;
+}
+
+/**
+ * \param backend Backend
+ * \return Backend name or NULL for unknown backend.
+ *
+ * Get the backend name as used by the SMBRR_BACKEND environment variable.
+ */
+const char *smbrr_backend_name(enum smbrr_backend backend)
+{
+	if ((int)backend < 0 || backend >= BACKEND_NUM)
+		return NULL;
+
+	return backend_names[backend];
+}
@@ -142,6 +142,8 @@ int smbrr_init_opencl(int device_index)
 		clCreateKernel(g_cl_ctx->program, "normalise_k", &err);
 	g_cl_ctx->k_anscombe =
 		clCreateKernel(g_cl_ctx->program, "anscombe_k", &err);
+	g_cl_ctx->k_anscombe_inverse =
+		clCreateKernel(g_cl_ctx->program, "anscombe_inverse_k", &err);
 	g_cl_ctx->k_mult_add =
 		clCreateKernel(g_cl_ctx->program, "mult_add_k", &err);
 	g_cl_ctx->k_mult_subtract =
@@ -213,6 +215,8 @@ void smbrr_free_opencl(void)
 		clReleaseKernel(g_cl_ctx->k_normalise);
 	if (g_cl_ctx->k_anscombe)
 		clReleaseKernel(g_cl_ctx->k_anscombe);
+	if (g_cl_ctx->k_anscombe_inverse)
+		clReleaseKernel(g_cl_ctx->k_anscombe_inverse);
 	if (g_cl_ctx->k_mult_add)
 		clReleaseKernel(g_cl_ctx->k_mult_add);
 	if (g_cl_ctx->k_mult_subtract)
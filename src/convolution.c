@@ -29,27 +29,37 @@
 #include "mask.h"
 #include "config.h"
 
+/* scales are summed in a single fused pass so C0 is only written once */
 static void atrous_deconv(struct smbrr_wavelet *wavelet)
 {
+	struct smbrr_expr e;
 	int scale;
 
+	smbrr_expr_reset(&e);
+
 	/* set initial starting data as C[scales - 1] */
-	smbrr_copy(wavelet->c[0], wavelet->c[wavelet->num_scales - 1]);
+	smbrr_expr_load(&e, wavelet->c[wavelet->num_scales - 1]);
 
 	/* add each wavelet scale */
 	for (scale = wavelet->num_scales - 2; scale > 0; scale--)
-		smbrr_add(wavelet->c[0], wavelet->c[0], wavelet->w[scale]);
+		smbrr_expr_add(&e, wavelet->w[scale]);
+
+	smbrr_expr_store(&e, wavelet->c[0]);
+	smbrr_expr_eval(&e);
 }
 
 /* C0 = C(scale - 1) + sum of wavelets if W(pixel) is significant; */
 static void atrous_deconv_sig(struct smbrr_wavelet *wavelet,
 	enum smbrr_gain gain)
 {
+	struct smbrr_expr e;
 	int scale;
 
+	smbrr_expr_reset(&e);
+
 	/* set initial starting data as significant C[scales - 1] */
-	smbrr_significant_copy(wavelet->c[0], wavelet->c[wavelet->num_scales - 1],
-		wavelet->s[wavelet->num_scales - 1]);
+	smbrr_expr_load(&e, wavelet->c[wavelet->num_scales - 1]);
+	smbrr_expr_significant_mask(&e, wavelet->s[wavelet->num_scales - 1]);
 
 	/* add each wavelet scale */
 	for (scale = wavelet->num_scales - 2; scale > 0; scale--) {
@@ -59,10 +69,12 @@ static void atrous_deconv_sig(struct smbrr_wavelet *wavelet,
 			continue;
 
 		if (gain != SMBRR_GAIN_NONE)
-			smbrr_mult_value(wavelet->w[scale], k_amp[gain][scale]);
-		smbrr_significant_add(wavelet->c[0], wavelet->c[0],
-			wavelet->w[scale], wavelet->s[scale]);
+			smbrr_expr_scale(&e, wavelet->w[scale], k_amp[gain][scale]);
+		smbrr_expr_significant_add(&e, wavelet->w[scale], wavelet->s[scale]);
 	}
+
+	smbrr_expr_store(&e, wavelet->c[0]);
+	smbrr_expr_eval(&e);
 }
 
 /**
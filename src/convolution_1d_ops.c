@@ -138,28 +138,15 @@ static void atrous_conv_sig(struct smbrr_wavelet *wavelet) {
                    wavelet->c[scale]);
 }
 
-static void insert_object(struct smbrr_wavelet *w, struct object *object,
-                          unsigned int pixel) {
-  /* insert object if none or current object at higher scale */
-  if (w->object_map[pixel] == NULL || w->object_map[pixel] == object)
-    w->object_map[pixel] = object;
-  else {
-    /* other objects exists */
-    struct object *o = w->object_map[pixel];
-
-    /* add if new object starts at lower scale */
-    if (object->start_scale < o->start_scale)
-      w->object_map[pixel] = object;
-  }
-}
-
 /* C0 = C(scale - 1) + sum of wavelets; */
 static void atrous_deconv_object(struct smbrr_wavelet *w,
                                  struct smbrr_object *object) {
   struct structure *s;
+  struct structure_span *span;
   struct object *o = (struct object *)object;
   struct smbrr *data = o->data, *sdata, *wdata;
-  int scale, x, id, ix, ipixel, start, end;
+  int scale, x, x0, x1, id, ix, ipixel, start, end;
+  unsigned int i;
 
   ix = object->minXy.x;
   start = o->start_scale;
@@ -173,12 +160,18 @@ static void atrous_deconv_object(struct smbrr_wavelet *w,
     sdata = w->s[scale];
     wdata = w->w[scale];
 
-    for (x = s->minXy.x; x <= s->maxXy.x; x++) {
-
-      if (sdata->s[x] == id) {
-        ipixel = x - ix;
-        data->adu[ipixel] += wdata->adu[x];
-        insert_object(w, o, x);
+    /* visit structure pixels only, within the object bounds */
+    for (i = 0; i < s->num_spans; i++) {
+      span = &s->span[i];
+      x0 = span->x0 > s->minXy.x ? span->x0 : s->minXy.x;
+      x1 = span->x1 < s->maxXy.x ? span->x1 : s->maxXy.x;
+
+      for (x = x0; x <= x1; x++) {
+        if (sdata->s[x] == id) {
+          ipixel = x - ix;
+          data->adu[ipixel] += wdata->adu[x];
+          object_map_insert(w, o, x);
+        }
       }
     }
   }
@@ -52,6 +52,7 @@ static void uchar_to_float_1d(struct smbrr *i, const unsigned char *c)
 	int x;
 	float *f = i->adu;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		f[x] = (float)c[x];
 }
@@ -61,6 +62,7 @@ static void ushort_to_float_1d(struct smbrr *i, const unsigned short *c)
 	int x;
 	float *f = i->adu;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		f[x] = (float)c[x];
 }
@@ -70,6 +72,7 @@ static void uint_to_float_1d(struct smbrr *i, const unsigned int *c)
 	int x;
 	float *f = i->adu;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		f[x] = (float)c[x];
 }
@@ -79,6 +82,7 @@ static void float_to_uchar_1d(struct smbrr *i, unsigned char *c)
 	int x;
 	float *f = i->adu;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		c[x] = (unsigned char)f[x];
 }
@@ -88,6 +92,7 @@ static void float_to_ushort_1d(struct smbrr *i, unsigned short *c)
 	int x;
 	float *f = i->adu;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		c[x] = (unsigned short)f[x];
 }
@@ -97,6 +102,7 @@ static void uint_to_uint_1d(struct smbrr *i, const unsigned int *c)
 	int x;
 	uint32_t *f = i->s;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		f[x] = (uint32_t)c[x];
 }
@@ -106,6 +112,7 @@ static void ushort_to_uint_1d(struct smbrr *i, const unsigned short *c)
 	int x;
 	uint32_t *f = i->s;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		f[x] = (uint32_t)c[x];
 }
@@ -115,6 +122,7 @@ static void uchar_to_uint_1d(struct smbrr *i, const unsigned char *c)
 	int x;
 	uint32_t *f = i->s;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		f[x] = (uint32_t)c[x];
 }
@@ -124,6 +132,7 @@ static void float_to_uint_1d(struct smbrr *i, const float *c)
 	int x;
 	uint32_t *f = i->s;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		f[x] = (uint32_t)c[x];
 }
@@ -140,6 +149,7 @@ static void uint_to_uchar_1d(struct smbrr *i, unsigned char *c)
 	int x;
 	uint32_t *f = i->s;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		c[x] = (unsigned char)f[x];
 }
@@ -149,49 +159,53 @@ static void uint_to_ushort_1d(struct smbrr *i, unsigned short *c)
 	int x;
 	uint32_t *f = i->s;
 
+#pragma omp parallel for if (i->width >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (x = 0; x < i->width; x++)
 		c[x] = (unsigned short)f[x];
 }
 
 static void uchar_to_float_2d(struct smbrr *i, const unsigned char *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	float *f = i->adu;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = (float)c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = (float)c[coffset + x];
 	}
 }
 
 static void ushort_to_float_2d(struct smbrr *i, const unsigned short *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	float *f = i->adu;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = (float)c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = (float)c[coffset + x];
 	}
 }
 
 static void uint_to_float_2d(struct smbrr *i, const unsigned int *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	float *f = i->adu;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = (float)c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = (float)c[coffset + x];
 	}
 }
 
@@ -200,12 +214,13 @@ static void float_to_uchar_2d(struct smbrr *i, unsigned char *c)
 	int x, y, coffset, foffset;
 	float *f = i->adu;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			c[coffset] = (unsigned char)f[foffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			c[coffset + x] = (unsigned char)f[foffset + x];
 	}
 }
 
@@ -214,82 +229,88 @@ static void float_to_ushort_2d(struct smbrr *i, unsigned short *c)
 	int x, y, coffset, foffset;
 	float *f = i->adu;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			c[coffset] = (unsigned short)f[foffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			c[coffset + x] = (unsigned short)f[foffset + x];
 	}
 }
 
 static void uint_to_uint_2d(struct smbrr *i, const unsigned int *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	uint32_t *f = i->s;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = (uint32_t)c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = (uint32_t)c[coffset + x];
 	}
 }
 
 static void ushort_to_uint_2d(struct smbrr *i, const unsigned short *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	uint32_t *f = i->s;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = (uint32_t)c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = (uint32_t)c[coffset + x];
 	}
 }
 
 static void uchar_to_uint_2d(struct smbrr *i, const unsigned char *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	uint32_t *f = i->s;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = (uint32_t)c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = (uint32_t)c[coffset + x];
 	}
 }
 
 static void float_to_uint_2d(struct smbrr *i, const float *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	uint32_t *f = i->s;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = (uint32_t)c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = (uint32_t)c[coffset + x];
 	}
 }
 
 static void float_to_float_2d(struct smbrr *i, const float *c)
 {
-	int x, y, foffset, coffset;
+	int x, y, coffset, foffset;
 	float *f = i->adu;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			f[foffset] = c[coffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			f[foffset + x] = c[coffset + x];
 	}
 }
 
@@ -298,12 +319,13 @@ static void uint_to_uchar_2d(struct smbrr *i, unsigned char *c)
 	int x, y, coffset, foffset;
 	uint32_t *f = i->s;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			c[coffset] = (unsigned char)f[foffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			c[coffset + x] = (unsigned char)f[foffset + x];
 	}
 }
 
@@ -312,12 +334,13 @@ static void uint_to_ushort_2d(struct smbrr *i, unsigned short *c)
 	int x, y, coffset, foffset;
 	uint32_t *f = i->s;
 
-	for (x = 0; x < i->width; x++) {
-		for (y = 0; y < i->height; y++) {
-			coffset = y * i->stride + x;
-			foffset = y * i->width + x;
-			c[coffset] = (unsigned short)f[foffset];
-		}
+#pragma omp parallel for private(x, coffset, foffset)                          \
+	if (i->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < i->height; y++) {
+		coffset = y * i->stride;
+		foffset = y * i->width;
+		for (x = 0; x < i->width; x++)
+			c[coffset + x] = (unsigned short)f[foffset + x];
 	}
 }
 
@@ -404,6 +427,129 @@ static int get(struct smbrr *data, enum smbrr_source_type adu, void **buf)
 	return 0;
 }
 
+/*
+ * Non linear stretches are both evaluated as log(a * t + sqrt(b * t * t + 1))
+ * for normalised t in [0, 1] so that each row is a single vectorised loop.
+ * asinh(beta * t) uses a = beta, b = beta^2 and log(1 + alpha * t) uses
+ * a = alpha, b = 0.
+ */
+#define STRETCH_ASINH_BETA 10.0f
+#define STRETCH_LOG_ALPHA 1000.0f
+
+static void quantise_uchar(struct smbrr *data, float min, float factor,
+						   float range, float a, float b, float norm,
+						   unsigned char *c)
+{
+	const float *f;
+	unsigned char *dst;
+	float v;
+	int x, y;
+
+#pragma omp parallel for private(f, dst, v, x)                                 \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < data->height; y++) {
+		f = data->adu + y * data->width;
+		dst = c + y * data->stride;
+
+		if (norm == 0.0f) {
+			for (x = 0; x < data->width; x++) {
+				v = (f[x] - min) * factor;
+				v = v < 0.0f ? 0.0f : v;
+				v = v > range ? range : v;
+				dst[x] = (unsigned char)v;
+			}
+		} else {
+			for (x = 0; x < data->width; x++) {
+				v = (f[x] - min) * factor;
+				v = v < 0.0f ? 0.0f : v;
+				v = v > 1.0f ? 1.0f : v;
+				v = norm * logf(a * v + sqrtf(b * v * v + 1.0f));
+				dst[x] = (unsigned char)v;
+			}
+		}
+	}
+}
+
+static void quantise_ushort(struct smbrr *data, float min, float factor,
+							float range, float a, float b, float norm,
+							unsigned short *c)
+{
+	const float *f;
+	unsigned short *dst;
+	float v;
+	int x, y;
+
+#pragma omp parallel for private(f, dst, v, x)                                 \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < data->height; y++) {
+		f = data->adu + y * data->width;
+		dst = c + y * data->stride;
+
+		if (norm == 0.0f) {
+			for (x = 0; x < data->width; x++) {
+				v = (f[x] - min) * factor;
+				v = v < 0.0f ? 0.0f : v;
+				v = v > range ? range : v;
+				dst[x] = (unsigned short)v;
+			}
+		} else {
+			for (x = 0; x < data->width; x++) {
+				v = (f[x] - min) * factor;
+				v = v < 0.0f ? 0.0f : v;
+				v = v > 1.0f ? 1.0f : v;
+				v = norm * logf(a * v + sqrtf(b * v * v + 1.0f));
+				dst[x] = (unsigned short)v;
+			}
+		}
+	}
+}
+
+static int quantise(struct smbrr *data, enum smbrr_source_type adu,
+					enum smbrr_stretch stretch, float min, float max,
+					float range, void *buf)
+{
+	float factor, a = 0.0f, b = 0.0f, norm = 0.0f;
+
+	if (buf == NULL)
+		return -EINVAL;
+
+	/* flat data maps to 0 */
+	if (max > min)
+		factor = stretch == SMBRR_STRETCH_LINEAR ? range / (max - min) :
+												   1.0f / (max - min);
+	else
+		factor = 0.0f;
+
+	switch (stretch) {
+	case SMBRR_STRETCH_LINEAR:
+		break;
+	case SMBRR_STRETCH_ASINH:
+		a = STRETCH_ASINH_BETA;
+		b = STRETCH_ASINH_BETA * STRETCH_ASINH_BETA;
+		norm = range / logf(a + sqrtf(b + 1.0f));
+		break;
+	case SMBRR_STRETCH_LOG:
+		a = STRETCH_LOG_ALPHA;
+		norm = range / logf(a + 1.0f);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (adu) {
+	case SMBRR_SOURCE_UINT8:
+		quantise_uchar(data, min, factor, range, a, b, norm, buf);
+		break;
+	case SMBRR_SOURCE_UINT16:
+		quantise_ushort(data, min, factor, range, a, b, norm, buf);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int convert(struct smbrr *data, enum smbrr_data_type type)
 {
 	int offset;
@@ -476,6 +622,9 @@ static void find_limits(struct smbrr *data, float *min, float *max)
 	_min = 1.0e6;
 	_max = -1.0e6;
 
+	/* min and max are order independent so the reduction is deterministic */
+#pragma omp parallel for reduction(min : _min) reduction(max : _max)           \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++) {
 		if (adu[offset] > _max)
 			_max = adu[offset];
@@ -500,6 +649,8 @@ static void normalise(struct smbrr *data, float min, float max)
 	range = max - min;
 	factor = range / _range;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		adu[offset] = (adu[offset] - _min) * factor;
 }
@@ -512,6 +663,7 @@ static void add(struct smbrr *a, struct smbrr *b, struct smbrr *c)
 	size_t offset;
 
 	/* A = B + C */
+#pragma omp parallel for if (a->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < a->elems; offset++)
 		A[offset] = B[offset] + C[offset];
 }
@@ -526,6 +678,7 @@ static void add_sig(struct smbrr *a, struct smbrr *b, struct smbrr *c,
 	int offset;
 
 	/* iff S then A = B + C */
+#pragma omp parallel for if (a->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < a->elems; offset++) {
 		if (S[offset])
 			A[offset] = B[offset] + C[offset];
@@ -541,6 +694,8 @@ static void mult_add(struct smbrr *dest, struct smbrr *a, struct smbrr *b,
 	size_t offset;
 
 	/* dest = a + b * c */
+#pragma omp parallel for                                                       \
+	if (dest->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < dest->elems; offset++)
 		D[offset] = A[offset] + B[offset] * c;
 }
@@ -554,6 +709,8 @@ static void mult_subtract(struct smbrr *dest, struct smbrr *a, struct smbrr *b,
 	size_t offset;
 
 	/* dest = a - b * c */
+#pragma omp parallel for                                                       \
+	if (dest->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < dest->elems; offset++)
 		D[offset] = A[offset] - B[offset] * c;
 }
@@ -566,6 +723,7 @@ static void subtract(struct smbrr *a, struct smbrr *b, struct smbrr *c)
 	size_t offset;
 
 	/* A = B - C */
+#pragma omp parallel for if (a->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < a->elems; offset++)
 		A[offset] = B[offset] - C[offset];
 }
@@ -578,6 +736,7 @@ static void subtract_sig(struct smbrr *a, struct smbrr *b, struct smbrr *c,
 	int offset;
 
 	/* iff S then A = B - C */
+#pragma omp parallel for if (a->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < a->elems; offset++) {
 		if (S[offset])
 			A[offset] = B[offset] - C[offset];
@@ -591,6 +750,8 @@ static void add_value(struct smbrr *data, float value)
 	size_t offset;
 	float *adu = data->adu;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		adu[offset] += value;
 }
@@ -600,6 +761,8 @@ static void add_value_sig(struct smbrr *data, struct smbrr *sdata, float value)
 	float *adu = data->adu;
 	int offset;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++) {
 		if (sdata->s[offset])
 			adu[offset] += value;
@@ -611,6 +774,8 @@ static void subtract_value(struct smbrr *data, float value)
 	size_t offset;
 	float *adu = data->adu;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		adu[offset] -= value;
 }
@@ -620,6 +785,8 @@ static void mult_value(struct smbrr *data, float value)
 	size_t offset;
 	float *adu = data->adu;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		adu[offset] *= value;
 }
@@ -629,6 +796,8 @@ static void reset_value(struct smbrr *data, float value)
 	float *adu = data->adu;
 	int offset;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		adu[offset] = value;
 }
@@ -638,6 +807,8 @@ static void set_sig_value(struct smbrr *data, uint32_t value)
 	uint32_t *adu = data->s;
 	int offset;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		adu[offset] = value;
 
@@ -654,6 +825,8 @@ static void set_value_sig(struct smbrr *data, struct smbrr *sdata,
 	uint32_t *sig = sdata->s;
 	int offset;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++) {
 		if (sig[offset])
 			adu[offset] = sig_value;
@@ -665,6 +838,8 @@ static void clear_negative(struct smbrr *data)
 	float *i = data->adu;
 	int offset;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		if (i[offset] < 0.0)
 			i[offset] = 0.0;
@@ -675,65 +850,132 @@ static void sabs(struct smbrr *data)
 	float *i = data->adu;
 	int offset;
 
+#pragma omp parallel for                                                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (offset = 0; offset < data->elems; offset++)
 		i[offset] = fabs(i[offset]);
 }
 
+/*
+ * Reductions sum fixed chunks of the data and then add the chunk sums in
+ * order. The chunking does not depend on the number of threads so results
+ * are reproducible whether or not the reduction runs in parallel.
+ */
+#define REDUCE_CHUNKS 256
+
+static inline void reduce_chunk(unsigned int elems, int chunk,
+								unsigned int *start, unsigned int *end)
+{
+	*start = (unsigned int)((uint64_t)elems * chunk / REDUCE_CHUNKS);
+	*end = (unsigned int)((uint64_t)elems * (chunk + 1) / REDUCE_CHUNKS);
+}
+
 static float get_mean(struct smbrr *data)
 {
-	float mean = 0.0;
-	int i;
+	double partial[REDUCE_CHUNKS], mean = 0.0;
+	const float *f = data->adu;
+	unsigned int i, start, end;
+	float sum;
+	int c;
+
+#pragma omp parallel for private(i, start, end, sum)                           \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (c = 0; c < REDUCE_CHUNKS; c++) {
+		reduce_chunk(data->elems, c, &start, &end);
+		sum = 0.0f;
+		for (i = start; i < end; i++)
+			sum += f[i];
+		partial[c] = sum;
+	}
 
-	for (i = 0; i < data->elems; i++)
-		mean += data->adu[i];
+	for (c = 0; c < REDUCE_CHUNKS; c++)
+		mean += partial[c];
 
-	mean /= (float)data->elems;
-	return mean;
+	return mean / data->elems;
 }
 
 static float get_mean_sig(struct smbrr *data, struct smbrr *sdata)
 {
-	float mean_sig = 0.0;
-	int i, ssize = 0;
+	double partial[REDUCE_CHUNKS], mean_sig = 0.0;
+	unsigned int count[REDUCE_CHUNKS], ssize = 0;
+	const float *f = data->adu;
+	const uint32_t *S = sdata->s;
+	unsigned int i, start, end, n;
+	float sum;
+	int c;
 
 	if (data->height != sdata->height || data->width != sdata->width)
 		return 0.0;
 
-	for (i = 0; i < data->elems; i++) {
-		if (!sdata->s[i])
-			continue;
+#pragma omp parallel for private(i, start, end, sum, n)                        \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (c = 0; c < REDUCE_CHUNKS; c++) {
+		reduce_chunk(data->elems, c, &start, &end);
+		sum = 0.0f;
+		n = 0;
+		for (i = start; i < end; i++) {
+			sum += S[i] ? f[i] : 0.0f;
+			n += S[i] ? 1 : 0;
+		}
+		partial[c] = sum;
+		count[c] = n;
+	}
 
-		mean_sig += data->adu[i];
-		ssize++;
+	for (c = 0; c < REDUCE_CHUNKS; c++) {
+		mean_sig += partial[c];
+		ssize += count[c];
 	}
 
-	mean_sig /= (float)ssize;
-	return mean_sig;
+	return mean_sig / (float)ssize;
 }
 
 static float get_sigma(struct smbrr *data, float mean)
 {
-	float t, sigma = 0.0;
-	int i;
-
-	for (i = 0; i < data->elems; i++) {
-		t = data->adu[i] - mean;
-		t *= t;
-		sigma += t;
+	double partial[REDUCE_CHUNKS], sigma = 0.0;
+	const float *f = data->adu;
+	unsigned int i, start, end;
+	float t, sum;
+	int c;
+
+#pragma omp parallel for private(i, start, end, t, sum)                        \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (c = 0; c < REDUCE_CHUNKS; c++) {
+		reduce_chunk(data->elems, c, &start, &end);
+		sum = 0.0f;
+		for (i = start; i < end; i++) {
+			t = f[i] - mean;
+			sum += t * t;
+		}
+		partial[c] = sum;
 	}
 
+	for (c = 0; c < REDUCE_CHUNKS; c++)
+		sigma += partial[c];
+
 	sigma /= (float)data->elems;
-	sigma = sqrtf(sigma);
-	return sigma;
+	return sqrtf(sigma);
 }
 
 static float get_norm(struct smbrr *data)
 {
-	float norm = 0.0;
-	int i;
+	double partial[REDUCE_CHUNKS], norm = 0.0;
+	const float *f = data->adu;
+	unsigned int i, start, end;
+	float sum;
+	int c;
+
+#pragma omp parallel for private(i, start, end, sum)                           \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (c = 0; c < REDUCE_CHUNKS; c++) {
+		reduce_chunk(data->elems, c, &start, &end);
+		sum = 0.0f;
+		for (i = start; i < end; i++)
+			sum += f[i] * f[i];
+		partial[c] = sum;
+	}
 
-	for (i = 0; i < data->elems; i++)
-		norm += data->adu[i] * data->adu[i];
+	for (c = 0; c < REDUCE_CHUNKS; c++)
+		norm += partial[c];
 
 	return sqrtf(norm);
 }
@@ -748,6 +990,8 @@ static void copy_sig(struct smbrr *dest, struct smbrr *src, struct smbrr *sig)
 		return;
 	}
 
+#pragma omp parallel for                                                       \
+	if (dest->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (i = 0; i < dest->elems; i++) {
 		if (sig->s[i])
 			dest->adu[i] = src->adu[i];
@@ -763,6 +1007,7 @@ static int sign(struct smbrr *s, struct smbrr *n)
 	if (s->elems != n->elems)
 		return -EINVAL;
 
+#pragma omp parallel for if (s->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (i = 0; i < s->elems; i++) {
 		if (n->adu[i] < 0.0)
 			s->adu[i] = -s->adu[i];
@@ -774,55 +1019,365 @@ static int sign(struct smbrr *s, struct smbrr *n)
 static float get_sigma_sig(struct smbrr *data, struct smbrr *sdata,
 						   float mean_sig)
 {
-	float t, sigma_sig = 0.0;
-	int i, ssize = 0;
-
-	for (i = 0; i < data->elems; i++) {
-		if (!sdata->s[i])
-			continue;
+	double partial[REDUCE_CHUNKS], sigma_sig = 0.0;
+	unsigned int count[REDUCE_CHUNKS], ssize = 0;
+	const float *f = data->adu;
+	const uint32_t *S = sdata->s;
+	unsigned int i, start, end, n;
+	float t, sum;
+	int c;
+
+#pragma omp parallel for private(i, start, end, t, sum, n)                     \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (c = 0; c < REDUCE_CHUNKS; c++) {
+		reduce_chunk(data->elems, c, &start, &end);
+		sum = 0.0f;
+		n = 0;
+		for (i = start; i < end; i++) {
+			t = f[i] - mean_sig;
+			sum += S[i] ? t * t : 0.0f;
+			n += S[i] ? 1 : 0;
+		}
+		partial[c] = sum;
+		count[c] = n;
+	}
 
-		t = data->adu[i] - mean_sig;
-		t *= t;
-		sigma_sig += t;
-		ssize++;
+	for (c = 0; c < REDUCE_CHUNKS; c++) {
+		sigma_sig += partial[c];
+		ssize += count[c];
 	}
 
 	sigma_sig /= (float)ssize;
-	sigma_sig = sqrtf(sigma_sig);
-	return sigma_sig;
+	return sqrtf(sigma_sig);
+}
+
+/*
+ * Generalised Anscombe transform for mixed Poisson-Gaussian noise, HAIP Equ
+ * 18.9 :-
+ *
+ * t = 2 / gain * sqrt(gain * (adu - bias) + 3 / 8 * gain^2 + readout^2)
+ */
+static void anscombe_elems(float *f, unsigned int elems, float gain, float bias,
+						   float readout)
+{
+	float scale, offset, t;
+	int i;
+
+	scale = 2.0f / gain;
+	offset = 0.375f * gain * gain + readout * readout - gain * bias;
+
+#pragma omp parallel for private(t) if (elems >= SMBRR_OMP_MIN_ELEMS)          \
+	schedule(static)
+	for (i = 0; i < elems; i++) {
+		t = gain * f[i] + offset;
+		t = t > 0.0f ? t : 0.0f;
+		f[i] = scale * sqrtf(t);
+	}
 }
 
 static void anscombe(struct smbrr *data, float gain, float bias, float readout)
 {
-	float hgain, cgain, r;
+	anscombe_elems(data->adu, data->elems, gain, bias, readout);
+}
+
+/* algebraic inverse of anscombe_elems() */
+static void anscombe_inverse(struct smbrr *data, float gain, float bias,
+							 float readout)
+{
+	float *f = data->adu, scale, offset, t;
 	int i;
 
-	/* HAIP Equ 18.9 */
-	hgain = gain / 2.0;
-	cgain = (gain * gain) * 0.375;
-	r = readout * readout;
-	r += cgain;
+	scale = gain * 0.5f;
+	offset = bias - 0.375f * gain - readout * readout / gain;
+
+#pragma omp parallel for private(t)                                            \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (i = 0; i < data->elems; i++) {
+		t = f[i] * scale;
+		f[i] = t * t / gain + offset;
+	}
+}
+
+/*
+ * Convert source data to float and stabilise each row whilst it is still in
+ * cache so ingest is a single pass over memory.
+ */
+static int anscombe_convert(struct smbrr *data, enum smbrr_source_type adu,
+							const void *src, float gain, float bias,
+							float readout)
+{
+	float *f;
+	int x, y;
+
+	switch (adu) {
+	case SMBRR_SOURCE_UINT8:
+	case SMBRR_SOURCE_UINT16:
+	case SMBRR_SOURCE_UINT32:
+	case SMBRR_SOURCE_FLOAT:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+#pragma omp parallel for private(f, x)                                         \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < data->height; y++) {
+		f = data->adu + y * data->width;
+
+		switch (adu) {
+		case SMBRR_SOURCE_UINT8: {
+			const unsigned char *c =
+				(const unsigned char *)src + y * data->stride;
+			for (x = 0; x < data->width; x++)
+				f[x] = (float)c[x];
+			break;
+		}
+		case SMBRR_SOURCE_UINT16: {
+			const unsigned short *c =
+				(const unsigned short *)src + y * data->stride;
+			for (x = 0; x < data->width; x++)
+				f[x] = (float)c[x];
+			break;
+		}
+		case SMBRR_SOURCE_UINT32: {
+			const unsigned int *c = (const unsigned int *)src + y * data->stride;
+			for (x = 0; x < data->width; x++)
+				f[x] = (float)c[x];
+			break;
+		}
+		default: {
+			const float *c = (const float *)src + y * data->stride;
+			memcpy(f, c, data->width * sizeof(float));
+			break;
+		}
+		}
+
+		anscombe_elems(f, data->width, gain, bias, readout);
+	}
 
-	for (i = 0; i < data->elems; i++)
-		data->adu[i] = hgain * sqrtf(gain * (data->adu[i] - bias) + r);
+	return 0;
 }
 
 static void new_significance(struct smbrr *data, struct smbrr *sdata,
 							 float sigma)
 {
+	unsigned int sig_pixels = 0;
 	int i;
 
 	if (data->height != sdata->height || data->width != sdata->width)
 		return;
 
-	/* clear the old significance data */
-	bzero(sdata->s, sizeof(uint32_t) * sdata->elems);
-	sdata->sig_pixels = 0;
+	/* overwrite the old significance data in the same pass */
+#pragma omp parallel for reduction(+ : sig_pixels)                             \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (i = 0; i < data->elems; i++) {
+		sdata->s[i] = data->adu[i] >= sigma;
+		sig_pixels += sdata->s[i];
+	}
+
+	sdata->sig_pixels = sig_pixels;
+}
+
+static void new_significance_map(struct smbrr *data, struct smbrr *sdata,
+								 struct smbrr *thresh)
+{
+	unsigned int sig_pixels = 0;
+	int i;
+
+	if (data->height != sdata->height || data->width != sdata->width ||
+		data->elems != thresh->elems)
+		return;
 
+#pragma omp parallel for reduction(+ : sig_pixels)                             \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
 	for (i = 0; i < data->elems; i++) {
-		if (data->adu[i] >= sigma) {
-			sdata->s[i] = 1;
-			sdata->sig_pixels++;
+		sdata->s[i] = data->adu[i] >= thresh->adu[i];
+		sig_pixels += sdata->s[i];
+	}
+
+	sdata->sig_pixels = sig_pixels;
+}
+
+/* pixels thresholded into each run detection mask */
+#define RUN_BLOCK 64
+
+/*
+ * Append the runs of set bits in a block mask. Bit 0 is pixel x and a run
+ * still open at the end of the previous block is extended when bit 0 is set.
+ */
+static inline unsigned int mask_runs(uint64_t mask, unsigned int x,
+									 unsigned int y,
+									 struct structure_span *runs,
+									 unsigned int n, int *open)
+{
+	unsigned int start, end;
+	uint64_t rest;
+
+	if (mask == 0) {
+		*open = 0;
+		return n;
+	}
+
+	while (mask) {
+		start = __builtin_ctzll(mask);
+		rest = ~(mask >> start);
+		end = rest ? start + __builtin_ctzll(rest) : RUN_BLOCK;
+
+		if (start == 0 && *open) {
+			runs[n - 1].x1 = x + end - 1;
+		} else {
+			runs[n].y = y;
+			runs[n].x0 = x + start;
+			runs[n].x1 = x + end - 1;
+			n++;
+		}
+
+		*open = end == RUN_BLOCK;
+		if (end == RUN_BLOCK)
+			break;
+		mask &= ~0ULL << end;
+	}
+
+	return n;
+}
+
+/*
+ * Threshold row y of data into sdata and return the runs of significant
+ * pixels. The compare for each block of pixels is packed into a bit mask so
+ * run boundaries are found a word at a time with a bit scan.
+ */
+static unsigned int new_significance_runs(struct smbrr *data,
+										  struct smbrr *sdata, float sigma,
+										  unsigned int y,
+										  struct structure_span *runs)
+{
+	const float *adu = data->adu + y * data->width;
+	uint32_t *s = sdata->s + y * sdata->width;
+	unsigned int x, i, len, n = 0;
+	uint64_t mask;
+	int open = 0;
+
+	for (x = 0; x < data->width; x += RUN_BLOCK) {
+		len = data->width - x < RUN_BLOCK ? data->width - x : RUN_BLOCK;
+
+		mask = 0;
+		for (i = 0; i < len; i++) {
+			s[x + i] = adu[x + i] >= sigma;
+			mask |= (uint64_t)s[x + i] << i;
+		}
+
+		n = mask_runs(mask, x, y, runs, n, &open);
+	}
+
+	return n;
+}
+
+/* return the runs of significant pixels in row y of sdata */
+static unsigned int significance_runs(struct smbrr *sdata, unsigned int y,
+									  struct structure_span *runs)
+{
+	const uint32_t *s = sdata->s + y * sdata->width;
+	unsigned int x, i, len, n = 0;
+	uint64_t mask;
+	int open = 0;
+
+	for (x = 0; x < sdata->width; x += RUN_BLOCK) {
+		len = sdata->width - x < RUN_BLOCK ? sdata->width - x : RUN_BLOCK;
+
+		mask = 0;
+		for (i = 0; i < len; i++)
+			mask |= (uint64_t)(s[x + i] != 0) << i;
+
+		n = mask_runs(mask, x, y, runs, n, &open);
+	}
+
+	return n;
+}
+
+/*
+ * Evaluate a recorded expression one cache sized block at a time. Each node is
+ * a simple vectorisable loop over the block so the whole chain costs a single
+ * pass over each operand in memory.
+ */
+static void expr_eval(const struct smbrr_expr *e)
+{
+	int block, num_blocks;
+
+	num_blocks = (e->elems + SMBRR_EXPR_BLOCK - 1) / SMBRR_EXPR_BLOCK;
+
+#pragma omp parallel for if (e->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (block = 0; block < num_blocks; block++) {
+		float acc[SMBRR_EXPR_BLOCK] __attribute__((aligned(32)));
+		const struct expr_node *n;
+		unsigned int start, len;
+		const uint32_t *S;
+		float *D, v;
+		int i, j;
+
+		start = block * SMBRR_EXPR_BLOCK;
+		len = e->elems - start;
+		if (len > SMBRR_EXPR_BLOCK)
+			len = SMBRR_EXPR_BLOCK;
+
+		for (j = 0; j < len; j++)
+			acc[j] = 0.0f;
+
+		for (i = 0; i < e->num_nodes; i++) {
+			n = &e->node[i];
+			D = n->data ? n->data->adu + start : NULL;
+			S = n->sig ? n->sig->s + start : NULL;
+			v = n->value;
+
+			switch (n->op) {
+			case EXPR_LOAD:
+				for (j = 0; j < len; j++)
+					acc[j] = D[j];
+				break;
+			case EXPR_ADD:
+				for (j = 0; j < len; j++)
+					acc[j] += D[j];
+				break;
+			case EXPR_SUBTRACT:
+				for (j = 0; j < len; j++)
+					acc[j] -= D[j];
+				break;
+			case EXPR_MULT_ADD:
+				for (j = 0; j < len; j++)
+					acc[j] = acc[j] + D[j] * v;
+				break;
+			case EXPR_SIG_ADD:
+				for (j = 0; j < len; j++)
+					acc[j] = S[j] ? acc[j] + D[j] : acc[j];
+				break;
+			case EXPR_ADD_VALUE:
+				for (j = 0; j < len; j++)
+					acc[j] += v;
+				break;
+			case EXPR_MULT_VALUE:
+				for (j = 0; j < len; j++)
+					acc[j] *= v;
+				break;
+			case EXPR_ZERO_NEGATIVE:
+				for (j = 0; j < len; j++)
+					acc[j] = acc[j] < 0.0f ? 0.0f : acc[j];
+				break;
+			case EXPR_ABS:
+				for (j = 0; j < len; j++)
+					acc[j] = fabsf(acc[j]);
+				break;
+			case EXPR_SIG_MASK:
+				for (j = 0; j < len; j++)
+					acc[j] = S[j] ? acc[j] : 0.0f;
+				break;
+			case EXPR_SCALE:
+				for (j = 0; j < len; j++)
+					D[j] *= v;
+				break;
+			case EXPR_STORE:
+				for (j = 0; j < len; j++)
+					D[j] = acc[j];
+				break;
+			}
 		}
 	}
 }
@@ -947,10 +1502,17 @@ const struct data_ops OPS(data_ops_1d) = {
 	.mult_add = mult_add,
 	.mult_subtract = mult_subtract,
 	.anscombe = anscombe,
+	.anscombe_inverse = anscombe_inverse,
+	.anscombe_convert = anscombe_convert,
 	.new_significance = new_significance,
+	.new_significance_map = new_significance_map,
+	.new_significance_runs = new_significance_runs,
+	.significance_runs = significance_runs,
 	.copy_sig = copy_sig,
 	.get = get,
+	.quantise = quantise,
 	.psf = psf_1d,
+	.expr_eval = expr_eval,
 
 	.uchar_to_float = uchar_to_float_1d,
 	.ushort_to_float = ushort_to_float_1d,
@@ -990,10 +1552,17 @@ const struct data_ops OPS(data_ops_2d) = {
 	.mult_add = mult_add,
 	.mult_subtract = mult_subtract,
 	.anscombe = anscombe,
+	.anscombe_inverse = anscombe_inverse,
+	.anscombe_convert = anscombe_convert,
 	.new_significance = new_significance,
+	.new_significance_map = new_significance_map,
+	.new_significance_runs = new_significance_runs,
+	.significance_runs = significance_runs,
 	.copy_sig = copy_sig,
 	.get = get,
+	.quantise = quantise,
 	.psf = psf_2d,
+	.expr_eval = expr_eval,
 
 	.uchar_to_float = uchar_to_float_2d,
 	.ushort_to_float = ushort_to_float_2d,
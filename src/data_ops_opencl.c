@@ -285,6 +285,22 @@ static void cl_anscombe(struct smbrr *data, float gain, float bias,
 	mark_gpu_modified(data);
 }
 
+static void cl_anscombe_inverse(struct smbrr *data, float gain, float bias,
+								float readout)
+{
+	clSetKernelArg(g_cl_ctx->k_anscombe_inverse, 0, sizeof(cl_mem),
+				   &data->cl_adu);
+	clSetKernelArg(g_cl_ctx->k_anscombe_inverse, 1, sizeof(float), &gain);
+	clSetKernelArg(g_cl_ctx->k_anscombe_inverse, 2, sizeof(float), &bias);
+	clSetKernelArg(g_cl_ctx->k_anscombe_inverse, 3, sizeof(float), &readout);
+	clSetKernelArg(g_cl_ctx->k_anscombe_inverse, 4, sizeof(int), &data->elems);
+	size_t global_item_size = data->elems;
+	clEnqueueNDRangeKernel(g_cl_ctx->command_queue,
+						   g_cl_ctx->k_anscombe_inverse, 1, NULL,
+						   &global_item_size, NULL, 0, NULL, NULL);
+	mark_gpu_modified(data);
+}
+
 static void cl_normalise(struct smbrr *data, float min, float max)
 {
 	clSetKernelArg(g_cl_ctx->k_normalise, 0, sizeof(cl_mem), &data->cl_adu);
@@ -471,6 +487,42 @@ static int cl_get_data_ops_2d(struct smbrr *data, enum smbrr_source_type adu,
 	return data_ops_2d.get(data, adu, buf);
 }
 
+static int cl_quantise_data_ops_1d(struct smbrr *data,
+								   enum smbrr_source_type adu,
+								   enum smbrr_stretch stretch, float min,
+								   float max, float range, void *buf)
+{
+	sync_to_cpu(data);
+	return data_ops_1d.quantise(data, adu, stretch, min, max, range, buf);
+}
+
+static int cl_quantise_data_ops_2d(struct smbrr *data,
+								   enum smbrr_source_type adu,
+								   enum smbrr_stretch stretch, float min,
+								   float max, float range, void *buf)
+{
+	sync_to_cpu(data);
+	return data_ops_2d.quantise(data, adu, stretch, min, max, range, buf);
+}
+
+static int cl_anscombe_convert_data_ops_1d(struct smbrr *s,
+										   enum smbrr_source_type adu,
+										   const void *c, float gain,
+										   float bias, float readout)
+{
+	sync_to_cpu(s);
+	return data_ops_1d.anscombe_convert(s, adu, c, gain, bias, readout);
+}
+
+static int cl_anscombe_convert_data_ops_2d(struct smbrr *s,
+										   enum smbrr_source_type adu,
+										   const void *c, float gain,
+										   float bias, float readout)
+{
+	sync_to_cpu(s);
+	return data_ops_2d.anscombe_convert(s, adu, c, gain, bias, readout);
+}
+
 static int cl_psf_data_ops_1d(struct smbrr *src, struct smbrr *dest,
 							  enum smbrr_wavelet_mask mask)
 {
@@ -485,6 +537,122 @@ static int cl_psf_data_ops_2d(struct smbrr *src, struct smbrr *dest,
 	return data_ops_2d.psf(src, dest, mask);
 }
 
+/*
+ * Expressions are evaluated on the CPU, destinations are written back so the
+ * GPU copy stays valid for subsequent kernels.
+ */
+static void cl_new_significance_map_data_ops(const struct data_ops *ops,
+											 struct smbrr *data,
+											 struct smbrr *sdata,
+											 struct smbrr *thresh)
+{
+	sync_to_cpu(data);
+	sync_to_cpu(thresh);
+
+	ops->new_significance_map(data, sdata, thresh);
+
+	clEnqueueWriteBuffer(g_cl_ctx->command_queue, sdata->cl_adu, CL_TRUE, 0,
+						 sdata->elems * sizeof(uint32_t), sdata->s, 0, NULL,
+						 NULL);
+	sdata->cl_state = 2;
+}
+
+static void cl_new_significance_map_data_ops_1d(struct smbrr *data,
+												struct smbrr *sdata,
+												struct smbrr *thresh)
+{
+	cl_new_significance_map_data_ops(&data_ops_1d, data, sdata, thresh);
+}
+
+static void cl_new_significance_map_data_ops_2d(struct smbrr *data,
+												struct smbrr *sdata,
+												struct smbrr *thresh)
+{
+	cl_new_significance_map_data_ops(&data_ops_2d, data, sdata, thresh);
+}
+
+/* runs are found on the host, callers write the labelled plane back */
+static unsigned int cl_new_significance_runs_data_ops(
+	const struct data_ops *ops, struct smbrr *data, struct smbrr *sdata,
+	float sigma, unsigned int y, struct structure_span *runs)
+{
+	sync_to_cpu(data);
+	sync_to_cpu(sdata);
+
+	return ops->new_significance_runs(data, sdata, sigma, y, runs);
+}
+
+static unsigned int
+cl_new_significance_runs_data_ops_1d(struct smbrr *data, struct smbrr *sdata,
+									 float sigma, unsigned int y,
+									 struct structure_span *runs)
+{
+	return cl_new_significance_runs_data_ops(&data_ops_1d, data, sdata, sigma,
+											 y, runs);
+}
+
+static unsigned int
+cl_new_significance_runs_data_ops_2d(struct smbrr *data, struct smbrr *sdata,
+									 float sigma, unsigned int y,
+									 struct structure_span *runs)
+{
+	return cl_new_significance_runs_data_ops(&data_ops_2d, data, sdata, sigma,
+											 y, runs);
+}
+
+static unsigned int cl_significance_runs_data_ops_1d(struct smbrr *sdata,
+													 unsigned int y,
+													 struct structure_span *runs)
+{
+	sync_to_cpu(sdata);
+	return data_ops_1d.significance_runs(sdata, y, runs);
+}
+
+static unsigned int cl_significance_runs_data_ops_2d(struct smbrr *sdata,
+													 unsigned int y,
+													 struct structure_span *runs)
+{
+	sync_to_cpu(sdata);
+	return data_ops_2d.significance_runs(sdata, y, runs);
+}
+
+static void cl_expr_eval_data_ops(const struct data_ops *ops,
+								  const struct smbrr_expr *e)
+{
+	const struct expr_node *n;
+	int i;
+
+	for (i = 0; i < e->num_nodes; i++) {
+		n = &e->node[i];
+		if (n->data)
+			sync_to_cpu(n->data);
+		if (n->sig)
+			sync_to_cpu(n->sig);
+	}
+
+	ops->expr_eval(e);
+
+	for (i = 0; i < e->num_nodes; i++) {
+		n = &e->node[i];
+		if (n->op != EXPR_STORE && n->op != EXPR_SCALE)
+			continue;
+		clEnqueueWriteBuffer(g_cl_ctx->command_queue, n->data->cl_adu, CL_TRUE,
+							 0, n->data->elems * sizeof(float), n->data->adu,
+							 0, NULL, NULL);
+		n->data->cl_state = 2;
+	}
+}
+
+static void cl_expr_eval_data_ops_1d(const struct smbrr_expr *e)
+{
+	cl_expr_eval_data_ops(&data_ops_1d, e);
+}
+
+static void cl_expr_eval_data_ops_2d(const struct smbrr_expr *e)
+{
+	cl_expr_eval_data_ops(&data_ops_2d, e);
+}
+
 static void cl_uchar_to_float_data_ops_1d(struct smbrr *s,
 										  const unsigned char *c)
 {
@@ -639,10 +807,17 @@ const struct data_ops data_ops_1d_opencl = {
 	.mult_add = cl_mult_add,
 	.mult_subtract = cl_mult_subtract,
 	.anscombe = cl_anscombe,
+	.anscombe_inverse = cl_anscombe_inverse,
+	.anscombe_convert = cl_anscombe_convert_data_ops_1d,
 	.new_significance = cl_new_significance,
+	.new_significance_map = cl_new_significance_map_data_ops_1d,
+	.new_significance_runs = cl_new_significance_runs_data_ops_1d,
+	.significance_runs = cl_significance_runs_data_ops_1d,
 	.copy_sig = cl_copy_sig,
 	.get = cl_get_data_ops_1d,
+	.quantise = cl_quantise_data_ops_1d,
 	.psf = cl_psf_data_ops_1d,
+	.expr_eval = cl_expr_eval_data_ops_1d,
 
 	/* Ignore type conversions for GPU for now, CPU fallback */
 	.uchar_to_float = cl_uchar_to_float_data_ops_1d,
@@ -683,10 +858,17 @@ const struct data_ops data_ops_2d_opencl = {
 	.mult_add = cl_mult_add,
 	.mult_subtract = cl_mult_subtract,
 	.anscombe = cl_anscombe,
+	.anscombe_inverse = cl_anscombe_inverse,
+	.anscombe_convert = cl_anscombe_convert_data_ops_2d,
 	.new_significance = cl_new_significance,
+	.new_significance_map = cl_new_significance_map_data_ops_2d,
+	.new_significance_runs = cl_new_significance_runs_data_ops_2d,
+	.significance_runs = cl_significance_runs_data_ops_2d,
 	.copy_sig = cl_copy_sig,
 	.get = cl_get_data_ops_2d,
+	.quantise = cl_quantise_data_ops_2d,
 	.psf = cl_psf_data_ops_2d,
+	.expr_eval = cl_expr_eval_data_ops_2d,
 
 	.uchar_to_float = cl_uchar_to_float_data_ops_2d,
 	.ushort_to_float = cl_ushort_to_float_data_ops_2d,
@@ -0,0 +1,288 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Copyright (C) 2026 Liam Girdwood
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "local.h"
+#include "ops.h"
+#include "sombrero.h"
+
+static int is_float(struct smbrr *s)
+{
+	return s->type == SMBRR_DATA_1D_FLOAT || s->type == SMBRR_DATA_2D_FLOAT;
+}
+
+static int is_sig(struct smbrr *s)
+{
+	return s->type == SMBRR_DATA_1D_UINT32 || s->type == SMBRR_DATA_2D_UINT32;
+}
+
+/* all operands must match the element count of the first operand */
+static int expr_check_operand(struct smbrr_expr *e, struct smbrr *s)
+{
+	if (e->ops == NULL) {
+		e->ops = s->ops;
+		e->elems = s->elems;
+		return 0;
+	}
+
+	if (s->elems != e->elems)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int expr_add_node(struct smbrr_expr *e, enum expr_op op,
+						 struct smbrr *data, struct smbrr *sig, float value)
+{
+	struct expr_node *n;
+	int ret;
+
+	if (e->num_nodes >= SMBRR_EXPR_MAX_NODES)
+		return -ENOSPC;
+
+	if (data) {
+		if (!is_float(data))
+			return -EINVAL;
+		ret = expr_check_operand(e, data);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (sig) {
+		if (!is_sig(sig))
+			return -EINVAL;
+		ret = expr_check_operand(e, sig);
+		if (ret < 0)
+			return ret;
+	}
+
+	n = &e->node[e->num_nodes++];
+	n->op = op;
+	n->data = data;
+	n->sig = sig;
+	n->value = value;
+	return 0;
+}
+
+/**
+ * \return Pointer to new expression or NULL on failure.
+ *
+ * Create a new empty expression. Operations are recorded against an implicit
+ * per element accumulator that starts at zero and nothing is computed until
+ * smbrr_expr_eval() is called.
+ */
+struct smbrr_expr *smbrr_expr_new(void)
+{
+	return calloc(1, sizeof(struct smbrr_expr));
+}
+
+/**
+ * \param e expression
+ *
+ * Free expression. Operands are not freed.
+ */
+void smbrr_expr_free(struct smbrr_expr *e)
+{
+	free(e);
+}
+
+/**
+ * \param e expression
+ *
+ * Remove all recorded operations so the expression can be reused.
+ */
+void smbrr_expr_reset(struct smbrr_expr *e)
+{
+	memset(e, 0, sizeof(*e));
+}
+
+/**
+ * \param e expression
+ * \param a element context A
+ * \return 0 on success.
+ *
+ * Record accumulator = A.
+ */
+int smbrr_expr_load(struct smbrr_expr *e, struct smbrr *a)
+{
+	return expr_add_node(e, EXPR_LOAD, a, NULL, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \param a element context A
+ * \return 0 on success.
+ *
+ * Record accumulator += A.
+ */
+int smbrr_expr_add(struct smbrr_expr *e, struct smbrr *a)
+{
+	return expr_add_node(e, EXPR_ADD, a, NULL, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \param a element context A
+ * \return 0 on success.
+ *
+ * Record accumulator -= A.
+ */
+int smbrr_expr_subtract(struct smbrr_expr *e, struct smbrr *a)
+{
+	return expr_add_node(e, EXPR_SUBTRACT, a, NULL, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \param a element context A
+ * \param c value C
+ * \return 0 on success.
+ *
+ * Record accumulator += A * C.
+ */
+int smbrr_expr_mult_add(struct smbrr_expr *e, struct smbrr *a, float c)
+{
+	return expr_add_node(e, EXPR_MULT_ADD, a, NULL, c);
+}
+
+/**
+ * \param e expression
+ * \param a element context A
+ * \param s Significant data.
+ * \return 0 on success.
+ *
+ * Record accumulator += A for significant pixels.
+ */
+int smbrr_expr_significant_add(struct smbrr_expr *e, struct smbrr *a,
+							   struct smbrr *s)
+{
+	return expr_add_node(e, EXPR_SIG_ADD, a, s, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \param value Value
+ * \return 0 on success.
+ *
+ * Record accumulator += value.
+ */
+int smbrr_expr_add_value(struct smbrr_expr *e, float value)
+{
+	return expr_add_node(e, EXPR_ADD_VALUE, NULL, NULL, value);
+}
+
+/**
+ * \param e expression
+ * \param value Value
+ * \return 0 on success.
+ *
+ * Record accumulator *= value.
+ */
+int smbrr_expr_mult_value(struct smbrr_expr *e, float value)
+{
+	return expr_add_node(e, EXPR_MULT_VALUE, NULL, NULL, value);
+}
+
+/**
+ * \param e expression
+ * \return 0 on success.
+ *
+ * Record clearing negative accumulator values to zero.
+ */
+int smbrr_expr_zero_negative(struct smbrr_expr *e)
+{
+	return expr_add_node(e, EXPR_ZERO_NEGATIVE, NULL, NULL, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \return 0 on success.
+ *
+ * Record accumulator = |accumulator|.
+ */
+int smbrr_expr_abs(struct smbrr_expr *e)
+{
+	return expr_add_node(e, EXPR_ABS, NULL, NULL, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \param s Significant data.
+ * \return 0 on success.
+ *
+ * Record clearing accumulator values that are not significant. A NULL
+ * significance context keeps all values.
+ */
+int smbrr_expr_significant_mask(struct smbrr_expr *e, struct smbrr *s)
+{
+	/* scales without significance data keep all pixels */
+	if (s == NULL)
+		return 0;
+
+	return expr_add_node(e, EXPR_SIG_MASK, NULL, s, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \param a element context A
+ * \param value Value
+ * \return 0 on success.
+ *
+ * Record A *= value in place. The accumulator is unchanged and later
+ * operations on A see the scaled values.
+ */
+int smbrr_expr_scale(struct smbrr_expr *e, struct smbrr *a, float value)
+{
+	return expr_add_node(e, EXPR_SCALE, a, NULL, value);
+}
+
+/**
+ * \param e expression
+ * \param dest Destination element context
+ * \return 0 on success.
+ *
+ * Record dest = accumulator. An expression can store to several destinations.
+ */
+int smbrr_expr_store(struct smbrr_expr *e, struct smbrr *dest)
+{
+	return expr_add_node(e, EXPR_STORE, dest, NULL, 0.0f);
+}
+
+/**
+ * \param e expression
+ * \return 0 on success or -EINVAL if no operation has an element context.
+ *
+ * Evaluate all recorded operations in a single fused sweep over the operands.
+ * The expression is kept so iterative algorithms can evaluate it again after
+ * operand data changes. Scalar only operations have no elements to sweep.
+ */
+int smbrr_expr_eval(struct smbrr_expr *e)
+{
+	if (e->num_nodes == 0)
+		return 0;
+
+	if (e->ops == NULL)
+		return -EINVAL;
+
+	e->ops->expr_eval(e);
+	return 0;
+}
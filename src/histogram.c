@@ -0,0 +1,127 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Copyright (C) 2026 Liam Girdwood
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "histogram.h"
+
+/**
+ * \param h histogram
+ * \param num_bins number of bins
+ * \param min value at start of first bin
+ * \param max value at end of last bin
+ * \return 0 on success.
+ *
+ * Initialise an empty histogram covering min to max.
+ */
+int histogram_init(struct histogram *h, unsigned int num_bins, float min,
+				   float max)
+{
+	if (num_bins == 0)
+		return -EINVAL;
+
+	h->bin = calloc(num_bins, sizeof(unsigned int));
+	if (h->bin == NULL)
+		return -ENOMEM;
+
+	h->num_bins = num_bins;
+	h->count = 0;
+	h->min = min;
+	h->max = max;
+
+	/* all data falls into bin 0 when there is no range */
+	if (max > min)
+		h->scale = (float)num_bins / (max - min);
+	else
+		h->scale = 0.0f;
+
+	return 0;
+}
+
+/**
+ * \param h histogram
+ *
+ * Free histogram bins.
+ */
+void histogram_free(struct histogram *h)
+{
+	free(h->bin);
+	h->bin = NULL;
+}
+
+/**
+ * \param h histogram
+ * \param data data elements
+ * \param elems number of data elements
+ *
+ * Add data elements to histogram. Elements outside the histogram range are
+ * counted in the first or last bin.
+ */
+void histogram_add(struct histogram *h, const float *data, unsigned int elems)
+{
+	int last = h->num_bins - 1, i, idx;
+
+	for (i = 0; i < elems; i++) {
+		idx = (int)((data[i] - h->min) * h->scale);
+		if (idx < 0)
+			idx = 0;
+		else if (idx > last)
+			idx = last;
+		h->bin[idx]++;
+	}
+
+	h->count += elems;
+}
+
+/**
+ * \param h histogram
+ * \param percentile percentile between 0 and 100
+ * \return value at percentile
+ *
+ * Get the data value at percentile. The value is linearly interpolated
+ * within the bin containing the percentile.
+ */
+float histogram_get_percentile(struct histogram *h, float percentile)
+{
+	float target, frac;
+	unsigned int cum = 0;
+	int i;
+
+	if (h->count == 0 || h->scale == 0.0f)
+		return h->min;
+
+	if (percentile <= 0.0f)
+		percentile = 0.0f;
+	if (percentile >= 100.0f)
+		percentile = 100.0f;
+
+	target = percentile * 0.01f * h->count;
+
+	for (i = 0; i < h->num_bins; i++) {
+		if (cum + h->bin[i] >= target && h->bin[i]) {
+			frac = (target - cum) / h->bin[i];
+			return h->min + ((float)i + frac) / h->scale;
+		}
+		cum += h->bin[i];
+	}
+
+	return h->max;
+}
@@ -69,8 +69,15 @@ const char *opencl_source_string =
 	"__kernel void anscombe_k(__global float *a, float gain, float bias, float readout, int elems) {\n"
 	"    int i = get_global_id(0);\n"
 	"    if (i < elems) {\n"
-	"        float tmp = gain * (a[i] - bias) + (3.0f/8.0f) + readout*readout;\n"
-	"        a[i] = (tmp > 0.0f) ? 2.0f * sqrt(tmp) : 0.0f;\n"
+	"        float tmp = gain * (a[i] - bias) + 0.375f * gain * gain + readout * readout;\n"
+	"        a[i] = (tmp > 0.0f) ? (2.0f / gain) * sqrt(tmp) : 0.0f;\n"
+	"    }\n"
+	"}\n"
+	"__kernel void anscombe_inverse_k(__global float *a, float gain, float bias, float readout, int elems) {\n"
+	"    int i = get_global_id(0);\n"
+	"    if (i < elems) {\n"
+	"        float t = a[i] * gain * 0.5f;\n"
+	"        a[i] = bias + (t * t - 0.375f * gain * gain - readout * readout) / gain;\n"
 	"    }\n"
 	"}\n"
 	"__kernel void normalise_k(__global float *a, float min, float max, int elems) {\n"
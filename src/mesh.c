@@ -0,0 +1,445 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Copyright (C) 2026 Liam Girdwood
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "local.h"
+#include "ops.h"
+#include "sombrero.h"
+
+/* histogram bins per cell, spanning MESH_RANGE global sigmas either side */
+#define MESH_BINS 128
+#define MESH_RANGE 8.0f
+
+/* pixels sampled for the global median and MAD that place the bins */
+#define MESH_SAMPLES 4096
+#define MESH_MAD_SIGMA 1.4826f
+
+/* clipping passes over each window and the clip in window sigmas */
+#define MESH_CLIP_ITER 3
+#define MESH_CLIP_K 3.0f
+
+/* cells histogrammed per thread */
+#define MESH_CELL_COLS 16
+
+/* cell rows held at once, the windows of a node row span four */
+#define MESH_ROWS 4
+
+/* node position and bilinear weight for pixel p on a mesh of n nodes */
+static inline void mesh_node(int p, unsigned int mesh, int n, int *node,
+							 float *frac)
+{
+	float f = (p + 0.5f) / mesh - 0.5f;
+
+	if (f <= 0.0f) {
+		*node = 0;
+		*frac = 0.0f;
+	} else if (f >= n - 1) {
+		*node = n > 1 ? n - 2 : 0;
+		*frac = n > 1 ? 1.0f : 0.0f;
+	} else {
+		*node = (int)f;
+		*frac = f - *node;
+	}
+}
+
+/**
+ * \param m scratch buffers
+ * \param width data width
+ * \param height data height
+ * \param mesh mesh size in pixels
+ * \return 0 on success.
+ *
+ * Allocate the buffers used to measure noise maps of one geometry so that
+ * each wavelet scale can reuse them.
+ */
+int mesh_scratch_init(struct mesh_scratch *m, unsigned int width,
+					  unsigned int height, unsigned int mesh)
+{
+	size_t nodes;
+	int i, x;
+
+	if (mesh < 2)
+		return -EINVAL;
+
+	m->width = width;
+	m->height = height;
+	m->mesh = mesh;
+	m->nx = (width + mesh - 1) / mesh;
+	m->ny = (height + mesh - 1) / mesh;
+	m->cx = (2 * width + mesh - 1) / mesh;
+	m->cy = (2 * height + mesh - 1) / mesh;
+	nodes = (size_t)m->nx * m->ny;
+
+	m->hist = malloc((size_t)MESH_ROWS * m->cx * MESH_BINS * sizeof(*m->hist));
+	m->node = malloc(2 * nodes * sizeof(float));
+	m->sample = malloc(MESH_SAMPLES * sizeof(float));
+	m->span = malloc(m->nx * sizeof(*m->span));
+	m->frac = malloc(width * sizeof(*m->frac));
+	if (m->hist == NULL || m->node == NULL || m->sample == NULL ||
+		m->span == NULL || m->frac == NULL) {
+		mesh_scratch_free(m);
+		return -ENOMEM;
+	}
+	m->filt = m->node + nodes;
+
+	/* the interpolation weights of each column are the same on every row */
+	for (i = 0; i < m->nx; i++)
+		m->span[i] = width;
+	for (x = width - 1; x >= 0; x--) {
+		mesh_node(x, mesh, m->nx, &i, &m->frac[x]);
+		if (i > 0)
+			m->span[i - 1] = x;
+	}
+
+	return 0;
+}
+
+/**
+ * \param m scratch buffers
+ *
+ * Free noise map scratch buffers.
+ */
+void mesh_scratch_free(struct mesh_scratch *m)
+{
+	free(m->hist);
+	free(m->node);
+	free(m->sample);
+	free(m->span);
+	free(m->frac);
+	m->hist = NULL;
+	m->node = NULL;
+	m->sample = NULL;
+	m->span = NULL;
+	m->frac = NULL;
+}
+
+static int mesh_cmp(const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+ * Histogram bin origin and bins per unit value from the median and MAD of a
+ * sample of the data, so objects covering much of the frame do not widen the
+ * bins. Returns 0 if the data has no spread.
+ */
+static int mesh_range(struct smbrr *data, float *sample, float *lo,
+					  float *scale)
+{
+	unsigned int i, n = 0, step = data->elems / MESH_SAMPLES + 1;
+	float median, sigma;
+
+	for (i = 0; i < data->elems; i += step)
+		sample[n++] = data->adu[i];
+
+	qsort(sample, n, sizeof(float), mesh_cmp);
+	median = sample[n / 2];
+
+	for (i = 0; i < n; i++)
+		sample[i] = fabsf(sample[i] - median);
+
+	qsort(sample, n, sizeof(float), mesh_cmp);
+	sigma = MESH_MAD_SIGMA * sample[n / 2];
+
+	/* mostly flat data, fall back to the plane statistics */
+	if (sigma <= 0.0f) {
+		median = smbrr_get_mean(data);
+		sigma = smbrr_get_sigma(data, median);
+	}
+	if (sigma <= 0.0f)
+		return 0;
+
+	*lo = median - MESH_RANGE * sigma;
+	*scale = MESH_BINS / (2.0f * MESH_RANGE * sigma);
+	return 1;
+}
+
+/*
+ * Histogram each cell of cell row c into its slot. Cells are half a mesh on a
+ * side so pixel p lies in cell 2p / mesh, and values beyond the bin range are
+ * counted in the end bins.
+ */
+static void mesh_cell_row(struct smbrr *data, struct mesh_scratch *m, int c,
+						  float lo, float scale)
+{
+	unsigned int *row = m->hist + (size_t)(c % MESH_ROWS) * m->cx * MESH_BINS;
+	int y0 = (c * m->mesh + 1) / 2, y1 = ((c + 1) * m->mesh + 1) / 2;
+	int i, i0, i1, x, y, x0, x1;
+	float f;
+
+	y1 = y1 > (int)m->height ? (int)m->height : y1;
+
+	/* a block of cells per thread, read a row at a time */
+#pragma omp parallel for private(i, i1, x, y, x0, x1, f)                       \
+	if (data->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (i0 = 0; i0 < m->cx; i0 += MESH_CELL_COLS) {
+		i1 = i0 + MESH_CELL_COLS < m->cx ? i0 + MESH_CELL_COLS : m->cx;
+
+		memset(row + (size_t)i0 * MESH_BINS, 0,
+			   (size_t)(i1 - i0) * MESH_BINS * sizeof(*row));
+
+		for (y = y0; y < y1; y++) {
+			const float *adu = data->adu + (size_t)y * m->width;
+
+			for (i = i0; i < i1; i++) {
+				unsigned int *hist = row + (size_t)i * MESH_BINS;
+
+				x0 = (i * m->mesh + 1) / 2;
+				x1 = ((i + 1) * m->mesh + 1) / 2;
+				x1 = x1 > (int)m->width ? (int)m->width : x1;
+
+				for (x = x0; x < x1; x++) {
+					f = (adu[x] - lo) * scale;
+					f = f > 0.0f ? f : 0.0f;
+					f = f < MESH_BINS - 1 ? f : MESH_BINS - 1;
+					hist[(int)f]++;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Sigma in bins of a window histogram. Clipping starts from the median and MAD
+ * of the window and keeps the bins within MESH_CLIP_K sigma of the mean, so
+ * stars and nebulosity inside the window do not inflate its sigma. The end
+ * bins hold out of range values and are always clipped.
+ */
+static float mesh_window_sigma(const unsigned int *hist)
+{
+	unsigned int n = 0, half, acc;
+	uint64_t num, sum, sum2;
+	double mean, sigma, var;
+	int i, med, d, iter, lo, hi;
+
+	for (i = 0; i < MESH_BINS; i++)
+		n += hist[i];
+	if (n == 0)
+		return 0.0f;
+	half = (n + 1) / 2;
+
+	for (i = 0, acc = 0; acc + hist[i] < half; i++)
+		acc += hist[i];
+	med = i;
+
+	/* widen a band about the median bin until it holds half the pixels */
+	for (d = 0, acc = hist[med]; acc < half; d++) {
+		if (med - d - 1 >= 0)
+			acc += hist[med - d - 1];
+		if (med + d + 1 < MESH_BINS)
+			acc += hist[med + d + 1];
+	}
+
+	mean = med + 0.5;
+	sigma = MESH_MAD_SIGMA * (d + 0.5);
+
+	for (iter = 0; iter < MESH_CLIP_ITER; iter++) {
+		/* bins whose centre lies within the clip */
+		lo = (int)ceil(mean - MESH_CLIP_K * sigma - 0.5);
+		hi = (int)floor(mean + MESH_CLIP_K * sigma - 0.5);
+		lo = lo < 1 ? 1 : lo;
+		hi = hi > MESH_BINS - 2 ? MESH_BINS - 2 : hi;
+
+		num = sum = sum2 = 0;
+		for (i = lo; i <= hi; i++) {
+			num += hist[i];
+			sum += (uint64_t)hist[i] * i;
+			sum2 += (uint64_t)hist[i] * i * i;
+		}
+
+		/* a window clipped empty keeps its previous statistics */
+		if (num < 2)
+			break;
+
+		mean = (double)sum / num + 0.5;
+		var = (double)sum2 / num - (mean - 0.5) * (mean - 0.5);
+		sigma = var > 0.0 ? sqrt(var) : 0.0;
+	}
+
+	return sigma;
+}
+
+/* median of each node and its neighbours rejects nodes holding objects */
+static void mesh_median_filter(const float *in, float *out, int nx, int ny)
+{
+	float v[9];
+	int i, j, di, dj, n;
+
+	for (j = 0; j < ny; j++) {
+		for (i = 0; i < nx; i++) {
+			n = 0;
+			for (dj = j - 1; dj <= j + 1; dj++) {
+				if (dj < 0 || dj >= ny)
+					continue;
+				for (di = i - 1; di <= i + 1; di++) {
+					if (di >= 0 && di < nx)
+						v[n++] = in[dj * nx + di];
+				}
+			}
+
+			qsort(v, n, sizeof(float), mesh_cmp);
+			out[j * nx + i] = n & 1 ? v[n / 2] :
+									  0.5f * (v[n / 2 - 1] + v[n / 2]);
+		}
+	}
+}
+
+/* bilinear interpolation of the node values to every pixel */
+static void mesh_interp(const float *node, const struct mesh_scratch *m,
+						struct smbrr *out)
+{
+	unsigned int width = out->width, height = out->height;
+	int nx = m->nx, ny = m->ny, x, y, ix, iy;
+	float fy, v0, v1;
+
+#pragma omp parallel for private(x, ix, iy, fy, v0, v1)                    \
+	if (out->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (y = 0; y < height; y++) {
+		const float *n0, *n1;
+		float *adu = out->adu + (size_t)y * width;
+
+		mesh_node(y, m->mesh, ny, &iy, &fy);
+		n0 = node + iy * nx;
+		n1 = ny > 1 ? n0 + nx : n0;
+
+		if (nx == 1) {
+			for (x = 0; x < width; x++)
+				adu[x] = n0[0] + fy * (n1[0] - n0[0]);
+			continue;
+		}
+
+		/* columns between a pair of nodes share the node values */
+		for (x = 0, ix = 0; ix < nx - 1; ix++) {
+			v0 = n0[ix] + fy * (n1[ix] - n0[ix]);
+			v1 = n0[ix + 1] + fy * (n1[ix + 1] - n0[ix + 1]);
+
+			for (; x < m->span[ix]; x++)
+				adu[x] = v0 + m->frac[x] * (v1 - v0);
+		}
+	}
+}
+
+/**
+ * \param data Image
+ * \param sigma Noise map with the same dimensions as data
+ * \param m scratch buffers for the geometry of data
+ * \return 0 on success.
+ *
+ * Measure a noise map into sigma with the buffers in m. The data is read once
+ * to histogram cells half a mesh on a side, and the window of each node is
+ * the 4 x 4 cells around it. Only the cell rows of the current node row are
+ * held.
+ */
+int mesh_noise_map(struct smbrr *data, struct smbrr *sigma,
+				   struct mesh_scratch *m)
+{
+	unsigned int win[MESH_BINS];
+	int nx = m->nx, ny = m->ny, cx = m->cx, cy = m->cy;
+	int i, j, k, b, c, c0, c1, k0, k1, next = 0;
+	float lo, scale;
+
+	if (data->width != m->width || data->height != m->height ||
+		sigma->width != m->width || sigma->height != m->height)
+		return -EINVAL;
+
+	smbrr_cl_sync(data);
+
+	if (!mesh_range(data, m->sample, &lo, &scale)) {
+		memset(sigma->adu, 0, sigma->elems * sizeof(float));
+		goto out;
+	}
+
+	for (j = 0; j < ny; j++) {
+		/* cell rows 2j - 1 to 2j + 2 hold the windows of this node row */
+		c0 = 2 * j - 1 < 0 ? 0 : 2 * j - 1;
+		c1 = 2 * j + 3 > cy ? cy : 2 * j + 3;
+		for (; next < c1; next++)
+			mesh_cell_row(data, m, next, lo, scale);
+
+		for (i = 0; i < nx; i++) {
+			k0 = 2 * i - 1 < 0 ? 0 : 2 * i - 1;
+			k1 = 2 * i + 3 > cx ? cx : 2 * i + 3;
+
+			memset(win, 0, sizeof(win));
+			for (c = c0; c < c1; c++) {
+				for (k = k0; k < k1; k++) {
+					const unsigned int *hist =
+						m->hist +
+						((size_t)(c % MESH_ROWS) * cx + k) * MESH_BINS;
+
+					for (b = 0; b < MESH_BINS; b++)
+						win[b] += hist[b];
+				}
+			}
+
+			m->node[j * nx + i] = mesh_window_sigma(win) / scale;
+		}
+	}
+
+	mesh_median_filter(m->node, m->filt, nx, ny);
+	mesh_interp(m->filt, m, sigma);
+
+out:
+#ifdef HAVE_OPENCL
+	if (g_cl_ctx) {
+		clEnqueueWriteBuffer(g_cl_ctx->command_queue, sigma->cl_adu, CL_TRUE, 0,
+							 sigma->elems * sizeof(float), sigma->adu, 0, NULL,
+							 NULL);
+	}
+#endif
+
+	return 0;
+}
+
+/**
+ * \param data Image
+ * \param sigma Noise map with the same dimensions as data
+ * \param mesh Mesh size in pixels
+ * \return 0 on success.
+ *
+ * Create a spatially varying noise map for data. The standard deviation is
+ * measured at mesh nodes spaced mesh pixels apart, each over a window of twice
+ * the mesh size. Windows are sigma clipped on pixel histograms so stars and
+ * nebulosity inside a window do not inflate its sigma. A median filter over
+ * the neighbouring nodes rejects nodes dominated by objects and the node
+ * values are bilinearly interpolated to every pixel.
+ */
+int smbrr_noise_map(struct smbrr *data, struct smbrr *sigma, unsigned int mesh)
+{
+	struct mesh_scratch m;
+	int ret;
+
+	if (sigma->type != SMBRR_DATA_1D_FLOAT &&
+		sigma->type != SMBRR_DATA_2D_FLOAT)
+		return -EINVAL;
+
+	ret = mesh_scratch_init(&m, data->width, data->height, mesh);
+	if (ret < 0)
+		return ret;
+
+	ret = mesh_noise_map(data, sigma, &m);
+	mesh_scratch_free(&m);
+	return ret;
+}
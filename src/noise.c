@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "config.h"
+#include "histogram.h"
 #include "local.h"
 #include "mask.h"
 #include "ops.h"
@@ -94,6 +95,20 @@ void smbrr_anscombe(struct smbrr *data, float gain, float bias, float readout) {
   data->ops->anscombe(data, gain, bias, readout);
 }
 
+/**
+ * \param data Image
+ * \param gain CCD amplifier gain in photo-electrons per ADU
+ * \param bias Image bias in ADUs
+ * \param readout Readout noise in RMS electrons.
+ *
+ * Convert Anscombe transformed data back to ADUs. This is the algebraic
+ * inverse of smbrr_anscombe() using the same CCD parameters.
+ */
+void smbrr_anscombe_inverse(struct smbrr *data, float gain, float bias,
+                            float readout) {
+  data->ops->anscombe_inverse(data, gain, bias, readout);
+}
+
 /**
  * \param data Image
  * \param sdata Significant data
@@ -106,6 +121,19 @@ void smbrr_significant_new(struct smbrr *data, struct smbrr *sdata,
   data->ops->new_significance(data, sdata, sigma);
 }
 
+/**
+ * \param data Image
+ * \param sdata Significant data
+ * \param thresh Threshold for each pixel
+ *
+ * Create new significance data from data for pixels at or above the
+ * threshold of the same pixel in thresh.
+ */
+void smbrr_significant_new_map(struct smbrr *data, struct smbrr *sdata,
+                               struct smbrr *thresh) {
+  data->ops->new_significance_map(data, sdata, thresh);
+}
+
 /**
  * \def D1(x)
  * \brief Calculate inverse K-sigma coefficient.
@@ -154,11 +182,176 @@ static const struct smbrr_clip_coeff k_sigma[6] = {
     },
 };
 
+/**
+ * \def FDR_HISTOGRAM_BINS
+ * \brief Number of bins used by FDR thresholding.
+ */
+#define FDR_HISTOGRAM_BINS 65536
+
+/**
+ * \def NOISE_STATE_TOLERANCE
+ * \brief Default relative plane sigma change for reusing a noise state.
+ */
+#define NOISE_STATE_TOLERANCE 0.05f
+
+/**
+ * \def NOISE_STATE_MAX_AGE
+ * \brief Default frames a noise state is reused before a full clip.
+ */
+#define NOISE_STATE_MAX_AGE 30
+
+/**
+ * \def MAD_SIGMA
+ * \brief Ratio of Gaussian sigma to the median absolute deviation.
+ */
+#define MAD_SIGMA 1.4826f
+
+/**
+ * \def FDR_SIGMA_RANGE
+ * \brief Sigmas either side of the median spanned by the FDR histogram.
+ */
+#define FDR_SIGMA_RANGE 16.0f
+
+/* k-th smallest value in linear time, reorders v */
+static float mad_select(float *v, int n, int k) {
+  int lo = 0, hi = n - 1, i, j;
+  float pivot, tmp;
+
+  while (lo < hi) {
+    pivot = v[lo + (hi - lo) / 2];
+    i = lo;
+    j = hi;
+
+    while (i <= j) {
+      while (v[i] < pivot)
+        i++;
+      while (v[j] > pivot)
+        j--;
+      if (i <= j) {
+        tmp = v[i];
+        v[i++] = v[j];
+        v[j--] = tmp;
+      }
+    }
+
+    if (k <= j)
+      hi = j;
+    else if (k >= i)
+      lo = i;
+    else
+      break;
+  }
+
+  return v[k];
+}
+
+/* median and Gaussian sigma of a plane from its median absolute deviation */
+static int mad_sigma(struct smbrr *data, float *median, float *sigma) {
+  unsigned int i, n = data->elems;
+  float *v;
+
+  v = malloc(n * sizeof(float));
+  if (v == NULL)
+    return -ENOMEM;
+
+  smbrr_cl_sync(data);
+  memcpy(v, data->adu, n * sizeof(float));
+  *median = mad_select(v, n, n / 2);
+
+  for (i = 0; i < n; i++)
+    v[i] = fabsf(v[i] - *median);
+
+  *sigma = MAD_SIGMA * mad_select(v, n, n / 2);
+  free(v);
+  return 0;
+}
+
+static const float *mad_noise_table(struct smbrr_wavelet *w) {
+  int is_1d = w->w[0]->type == SMBRR_DATA_1D_FLOAT;
+
+  if (w->mask_type == SMBRR_WAVELET_MASK_BICUBIC)
+    return is_1d ? bicubic_noise_1d : bicubic_noise_2d;
+
+  return is_1d ? linear_noise_1d : linear_noise_2d;
+}
+
+/*
+ * Measure the noise once on scale 0 and propagate it to every scale through
+ * the white noise response of the mask, so each scale is thresholded in a
+ * single pass without iterating.
+ */
+static int clip_scales_mad(struct smbrr_wavelet *w,
+                           const struct smbrr_clip_coeff *coeff) {
+  const float *table = mad_noise_table(w);
+  float median, sigma;
+  int i, ret;
+
+  ret = mad_sigma(w->w[0], &median, &sigma);
+  if (ret < 0)
+    return ret;
+
+  /* image noise sigma */
+  sigma /= table[0];
+
+#pragma omp parallel for firstprivate(w, coeff, table, sigma)                  \
+    schedule(dynamic, 1) if (w->w[0]->elems < SMBRR_OMP_MIN_ELEMS)
+  for (i = 0; i < w->num_scales - 1; i++)
+    smbrr_significant_new(w->w[i], w->s[i],
+                          coeff->coeff[i] * sigma * table[i]);
+
+  return 0;
+}
+
+/*
+ * Threshold each scale against its local noise map. Scales are processed one
+ * at a time so the map kernels use all threads, and a single map and set of
+ * mesh buffers are reused for every scale.
+ */
+static int clip_scales_mesh(struct smbrr_wavelet *w,
+                            const struct smbrr_clip_coeff *coeff) {
+  struct mesh_scratch mesh;
+  struct smbrr *map;
+  int i, ret;
+
+  map = smbrr_new(w->w[0]->type, w->width, w->height, 0, 0, NULL);
+  if (map == NULL)
+    return -ENOMEM;
+
+  ret = mesh_scratch_init(&mesh, w->width, w->height, w->noise_mesh);
+  if (ret < 0) {
+    smbrr_free(map);
+    return ret;
+  }
+
+  for (i = 0; i < w->num_scales - 1; i++) {
+    ret = mesh_noise_map(w->w[i], map, &mesh);
+    if (ret < 0)
+      break;
+
+    smbrr_mult_value(map, coeff->coeff[i]);
+    smbrr_significant_new_map(w->w[i], w->s[i], map);
+  }
+
+  mesh_scratch_free(&mesh);
+  smbrr_free(map);
+  return ret;
+}
+
+/*
+ * Clip a scale from scratch. The plane mean and sigma are saved in ns when it
+ * is not NULL so later frames can reuse the mean.
+ *
+ * The original clipping loop never updated its sigma from the significant
+ * pixels so it always stopped after the first pass, and iterating on that
+ * sigma does not converge on real images. The plane engine therefore
+ * thresholds at the clipping coefficient times the plane sigma, which takes
+ * one pass for the plane statistics and one to write the significance map.
+ */
 static void clip_scale(struct smbrr_wavelet *w, int scale,
-                       const struct smbrr_clip_coeff *c, float sig_delta) {
+                       const struct smbrr_clip_coeff *c,
+                       struct noise_scale *ns) {
   struct smbrr *data, *sdata;
   float mean, sigma;
-  float mean_sig, sigma_sig, sigma_sig_old = 0.0;
 
   data = smbrr_wavelet_get_wavelet(w, scale);
   sdata = smbrr_wavelet_get_significant(w, scale);
@@ -166,44 +359,109 @@ static void clip_scale(struct smbrr_wavelet *w, int scale,
   mean = smbrr_get_mean(data);
   sigma = smbrr_get_sigma(data, mean);
 
-  sigma_sig = sigma;
+  smbrr_significant_new(data, sdata, c->coeff[scale] * sigma);
+
+  if (ns) {
+    ns->mean = mean;
+    ns->sigma = sigma;
+    ns->age = 0;
+    ns->valid = 1;
+  }
+}
 
-  /* clip scale until sigma is less than delta */
-  do {
-    sigma_sig_old = sigma_sig;
+/*
+ * Reuse the plane mean of the previous frame and threshold at the sigma about
+ * that mean when it is within tolerance of the saved sigma. This saves the mean
+ * pass of a full clip, leaving one pass to measure the sigma and one to write
+ * the significance map. A mean shift also raises the sigma about the old mean
+ * so scene changes fail the check.
+ */
+static int clip_scale_warm(struct smbrr_wavelet *w, int scale,
+                           const struct smbrr_clip_coeff *c,
+                           struct noise_scale *ns, float tolerance) {
+  struct smbrr *data, *sdata;
+  float sigma;
+
+  data = smbrr_wavelet_get_wavelet(w, scale);
+  sdata = smbrr_wavelet_get_significant(w, scale);
 
-    /* create new sig pixel data for scale */
-    smbrr_significant_new(data, sdata, c->coeff[scale] * sigma_sig_old);
+  sigma = smbrr_get_sigma(data, ns->mean);
+  if (fabsf(sigma - ns->sigma) > tolerance * ns->sigma)
+    return 0;
+
+  /* follow slow drift in the noise level */
+  ns->sigma = sigma;
+  ns->age++;
+
+  smbrr_significant_new(data, sdata, c->coeff[scale] * sigma);
+  return 1;
+}
+
+/*
+ * Large planes are clipped one scale at a time so that all threads share each
+ * plane through the parallel data_ops kernels and reductions. Planes below the
+ * data_ops threading threshold are clipped a scale per thread instead, where
+ * the per plane kernels then run single threaded.
+ */
+static int clip_scales(struct smbrr_wavelet *w,
+                       const struct smbrr_clip_coeff *coeff,
+                       struct smbrr_noise_state *state) {
+  struct noise_scale *ns;
+  int i, per_scale, warm = 0;
+
+  /* global thresholds are used if the mesh or MAD paths run out of memory */
+  if (w->noise_mesh && clip_scales_mesh(w, coeff) == 0)
+    return 0;
+
+  if (w->clip_engine == SMBRR_CLIP_ENGINE_MAD &&
+      clip_scales_mad(w, coeff) == 0)
+    return 0;
+
+  /* saved state is only valid for the same frame geometry */
+  if (state && (state->elems != w->w[0]->elems ||
+                state->num_scales != w->num_scales)) {
+    smbrr_noise_state_reset(state);
+    state->elems = w->w[0]->elems;
+    state->num_scales = w->num_scales;
+  }
+
+  per_scale = w->w[0]->elems < SMBRR_OMP_MIN_ELEMS;
+
+#pragma omp parallel for firstprivate(w, coeff, state) private(ns)             \
+    reduction(+ : warm) schedule(dynamic, 1) if (per_scale)
+  for (i = 0; i < w->num_scales - 1; i++) {
+    ns = state ? &state->scale[i] : NULL;
 
-    /* calculate new mean and sigma for sig pixels */
-    mean_sig = smbrr_significant_get_mean(data, sdata);
-    smbrr_significant_get_sigma(data, sdata, mean_sig);
+    if (ns && ns->valid && ns->age < state->max_age &&
+        clip_scale_warm(w, i, coeff, ns, state->tolerance))
+      warm++;
+    else
+      clip_scale(w, i, coeff, ns);
+  }
 
-    /* keep going if sigma difference is above delta */
-  } while (fabsf(sigma_sig - sigma_sig_old) > sig_delta);
+  return warm;
 }
 
 /**
  * \param w wavelet
  * \param clip clipping strength
- * \param sig_delta clipping sigma delta
+ * \param sig_delta unused
  *
- * Clip each wavelet scale based on strength until sigma for each scale is less
- * than sig_delta.
+ * Clip each wavelet scale at the clipping coefficient of each scale times the
+ * sigma of that scale. The threshold is set in a single pass so sig_delta is
+ * not used.
  */
 int smbrr_wavelet_ksigma_clip(struct smbrr_wavelet *w, enum smbrr_clip clip,
                               float sig_delta) {
   const struct smbrr_clip_coeff *coeff;
-  int i;
 
   if (clip < SMBRR_CLIP_VGENTLE || clip > SMBRR_CLIP_VVSTRONG)
     return -EINVAL;
 
+  (void)sig_delta;
+
   coeff = &k_sigma[clip];
-#pragma omp parallel for firstprivate(w, clip, sig_delta, coeff)               \
-    schedule(dynamic, 1)
-  for (i = 0; i < w->num_scales - 1; i++)
-    clip_scale(w, i, coeff, sig_delta);
+  clip_scales(w, coeff, NULL);
 
   return 0;
 }
@@ -211,20 +469,228 @@ int smbrr_wavelet_ksigma_clip(struct smbrr_wavelet *w, enum smbrr_clip clip,
 /*
  * \param w wavelet
  * \param clip clipping strength
- * \param sig_delta clipping sigma delta
+ * \param sig_delta unused
  *
- * Clip each wavelet scale based on strength until sigma for each scale is less
- * than sig_delta.
+ * Clip each wavelet scale at the clipping coefficient of each scale times the
+ * sigma of that scale. The threshold is set in a single pass so sig_delta is
+ * not used.
  */
 int smbrr_wavelet_ksigma_clip_custom(struct smbrr_wavelet *w,
                                      struct smbrr_clip_coeff *coeff,
                                      float sig_delta) {
-  int i;
+  (void)sig_delta;
 
-#pragma omp parallel for firstprivate(w, sig_delta, coeff) schedule(dynamic, 1)
-  for (i = 0; i < w->num_scales - 1; i++)
-    clip_scale(w, i, coeff, sig_delta);
+  clip_scales(w, coeff, NULL);
+  return 0;
+}
+
+/*
+ * Benjamini-Hochberg on a histogram. The median and sigma come from the median
+ * absolute deviation and the histogram spans FDR_SIGMA_RANGE sigma either side
+ * of the median. Scanning bins from the top, k counts the pixels at or above
+ * the lower edge of the bin and the one sided Gaussian p-value of that edge
+ * above the median is compared against alpha * k / n. The lowest passing edge
+ * is the largest k that controls the false discovery rate.
+ */
+static int fdr_threshold(struct smbrr *data, float alpha, float *thresh) {
+  struct histogram h;
+  float median, sigma, edge;
+  double k = 0.0, n = data->elems;
+  int b, ret;
+
+  *thresh = HUGE_VALF;
+
+  ret = mad_sigma(data, &median, &sigma);
+  if (ret < 0)
+    return ret;
+
+  /* flat plane has nothing significant */
+  if (!(sigma > 0.0f))
+    return 0;
+
+  /* pixels beyond the range are counted in the first or last bin */
+  ret = histogram_init(&h, FDR_HISTOGRAM_BINS,
+                       median - FDR_SIGMA_RANGE * sigma,
+                       median + FDR_SIGMA_RANGE * sigma);
+  if (ret < 0)
+    return ret;
+
+  histogram_add(&h, data->adu, data->elems);
+
+  for (b = h.num_bins - 1; b >= 0; b--) {
+    k += h.bin[b];
+    if (h.bin[b] == 0)
+      continue;
+
+    edge = h.min + b / h.scale;
+    if (0.5 * erfc((edge - median) / (sigma * M_SQRT2)) <= alpha * k / n)
+      *thresh = edge;
+  }
 
+  histogram_free(&h);
+  return 0;
+}
+
+static int fdr_scale(struct smbrr_wavelet *w, int scale, float alpha) {
+  struct smbrr *data, *sdata;
+  float thresh;
+  int ret;
+
+  data = smbrr_wavelet_get_wavelet(w, scale);
+  sdata = smbrr_wavelet_get_significant(w, scale);
+
+  smbrr_cl_sync(data);
+  ret = fdr_threshold(data, alpha, &thresh);
+  if (ret < 0)
+    return ret;
+
+  smbrr_significant_new(data, sdata, thresh);
+  return 0;
+}
+
+/**
+ * \param w wavelet
+ * \param alpha false discovery rate
+ * \return 0 on success.
+ *
+ * Threshold each wavelet scale so that the expected fraction of false
+ * detections among significant pixels is at most alpha. The noise median and
+ * sigma of each scale come from its median absolute deviation and p-values
+ * from a histogram around the median, so the cost is linear with no sort.
+ */
+int smbrr_wavelet_fdr_clip(struct smbrr_wavelet *w, float alpha) {
+  int i, err, ret = 0;
+
+  if (!(alpha > 0.0f && alpha < 1.0f))
+    return -EINVAL;
+
+  /* selection and histogram scans are serial so each thread takes a scale */
+#pragma omp parallel for firstprivate(w, alpha) private(err)                   \
+    reduction(min : ret) schedule(dynamic, 1)
+  for (i = 0; i < w->num_scales - 1; i++) {
+    err = fdr_scale(w, i, alpha);
+    if (err < ret)
+      ret = err;
+  }
+
+  return ret;
+}
+
+/**
+ * \return Pointer to new noise state or NULL on failure.
+ *
+ * Create a noise state that carries the plane mean and sigma of each scale
+ * from one frame to the next. The default tolerance is 5% and each scale is
+ * fully clipped again at least every 30 frames.
+ */
+struct smbrr_noise_state *smbrr_noise_state_new(void) {
+  struct smbrr_noise_state *state;
+
+  state = calloc(1, sizeof(*state));
+  if (state == NULL)
+    return NULL;
+
+  state->tolerance = NOISE_STATE_TOLERANCE;
+  state->max_age = NOISE_STATE_MAX_AGE;
+  return state;
+}
+
+/**
+ * \param state noise state
+ *
+ * Free noise state.
+ */
+void smbrr_noise_state_free(struct smbrr_noise_state *state) { free(state); }
+
+/**
+ * \param state noise state
+ *
+ * Forget the saved statistics so the next frame is fully clipped. Use this on
+ * a known scene change such as a new exposure or camera setting.
+ */
+void smbrr_noise_state_reset(struct smbrr_noise_state *state) {
+  memset(state->scale, 0, sizeof(state->scale));
+}
+
+/**
+ * \param state noise state
+ * \param tolerance relative plane sigma change allowed for reuse
+ * \param max_age frames a scale can reuse its state before a full clip
+ * \return 0 on success.
+ *
+ * Set how far the plane sigma of a scale can move from the saved value before
+ * the scale is treated as a scene change and fully clipped again, and how many
+ * frames the saved mean can be reused before it is refreshed.
+ */
+int smbrr_noise_state_set_tolerance(struct smbrr_noise_state *state,
+                                    float tolerance, unsigned int max_age) {
+  if (tolerance < 0.0f)
+    return -EINVAL;
+
+  state->tolerance = tolerance;
+  state->max_age = max_age;
+  return 0;
+}
+
+/**
+ * \param w wavelet
+ * \param clip clipping strength
+ * \param sig_delta unused
+ * \param state noise state from the previous frame
+ * \return Number of scales thresholded from the saved state or negative error.
+ *
+ * Clip each wavelet scale like smbrr_wavelet_ksigma_clip() but reuse the plane
+ * mean of the previous frame in state. Scales whose sigma about that mean is
+ * unchanged within the state tolerance skip the mean pass and are thresholded
+ * at that sigma. Other scales are fully clipped and saved to state.
+ */
+int smbrr_wavelet_ksigma_clip_state(struct smbrr_wavelet *w,
+                                    enum smbrr_clip clip, float sig_delta,
+                                    struct smbrr_noise_state *state) {
+  if (clip < SMBRR_CLIP_VGENTLE || clip > SMBRR_CLIP_VVSTRONG)
+    return -EINVAL;
+
+  (void)sig_delta;
+
+  return clip_scales(w, &k_sigma[clip], state);
+}
+
+/**
+ * \param w wavelet
+ * \param engine clipping engine
+ * \return 0 on success.
+ *
+ * Select the engine used to set the K-sigma clipping threshold at each scale.
+ * The plane engine measures the sigma of every scale. The MAD engine measures
+ * the noise once on scale 0 and thresholds every scale in one pass.
+ */
+int smbrr_wavelet_set_clip_engine(struct smbrr_wavelet *w,
+                                  enum smbrr_clip_engine engine) {
+  switch (engine) {
+  case SMBRR_CLIP_ENGINE_PLANE:
+  case SMBRR_CLIP_ENGINE_MAD:
+    w->clip_engine = engine;
+    return 0;
+  default:
+    return -EINVAL;
+  }
+}
+
+/**
+ * \param w wavelet
+ * \param mesh mesh size in pixels or 0 for global thresholds
+ * \return 0 on success.
+ *
+ * Threshold each scale against a spatially varying noise map measured on a
+ * mesh of the given size instead of a single sigma per scale. This follows
+ * gradients and vignetting in wide field data. The clipping engine is not
+ * used while a mesh is set.
+ */
+int smbrr_wavelet_set_noise_mesh(struct smbrr_wavelet *w, unsigned int mesh) {
+  if (mesh == 1)
+    return -EINVAL;
+
+  w->noise_mesh = mesh;
   return 0;
 }
 
@@ -247,6 +713,12 @@ int smbrr_wavelet_new_significant(struct smbrr_wavelet *w,
 
   c = &k_sigma[sigma_clip];
 
+  if (w->noise_mesh && clip_scales_mesh(w, c) == 0)
+    return 0;
+
+  if (w->clip_engine == SMBRR_CLIP_ENGINE_MAD && clip_scales_mad(w, c) == 0)
+    return 0;
+
   for (i = 0; i < w->num_scales - 1; i++) {
     W = smbrr_wavelet_get_wavelet(w, i);
     S = smbrr_wavelet_get_significant(w, i);
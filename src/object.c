@@ -18,10 +18,13 @@
 
 #include <errno.h> // IWYU pragma: keep
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "config.h"
 #include "local.h"
+#include "mask.h"
 #include "ops.h"
 #include "sombrero.h"
 
@@ -54,9 +57,6 @@ struct structure_info {
 
 /** \endcond */
 
-static int create_object(struct smbrr_wavelet *w, unsigned int scale,
-						 struct structure *structure);
-
 static inline int stack_pop(struct stack *s, unsigned int *data)
 {
 	if (!s->pos)
@@ -98,6 +98,8 @@ static inline void structure_add_pixel(struct structure_info *info, int pixel)
 
 	sdata->s[pixel] = info->id;
 	info->structure->size++;
+	structure_moments_add(&info->structure->m, wdata->adu[pixel],
+						  pixel % sdata->width, pixel / sdata->width);
 
 	if (wdata->adu[pixel] > info->structure->max_value) {
 		info->structure->max_value = wdata->adu[pixel];
@@ -222,27 +224,22 @@ static void structure_detect_pixels(struct structure_info *info)
 	while (stack_not_empty(stack)) {
 		stack_pop(stack, &pixel);
 
-		structure_add_pixel(info, pixel);
+		/* pixels can be pushed again before they are popped and labelled */
+		if (info->sdata->s[pixel] == 1)
+			structure_add_pixel(info, pixel);
 		structure_scan_line(info, pixel);
 	}
 }
 
-/**
- * \param w Wavelet
- * \param scale Scale to be searched.
- * \return Number of structures found within this wavelet scale.
- *
- * Search this wavelet scale for any structures that could be part of an object.
- */
-int smbrr_wavelet_structure_find(struct smbrr_wavelet *w, unsigned int scale)
+/* flood fill labeller */
+static int structure_find_floodfill(struct smbrr_wavelet *w, unsigned int scale)
 {
 	struct structure_info info;
+	struct structure *table;
 	struct stack stack;
-	unsigned int size;
+	unsigned int size, capacity = 0;
 	int err;
 
-	smbrr_wavelet_cl_sync(w);
-
 	info.wdata = w->w[scale];
 	info.sdata = w->s[scale];
 
@@ -262,12 +259,15 @@ int smbrr_wavelet_structure_find(struct smbrr_wavelet *w, unsigned int scale)
 		if (info.sdata->s[info.pixel] == 1) {
 			info.id++;
 
-			/* new structure detected */
-			w->structure[scale] =
-				realloc(w->structure[scale],
-						w->num_structures[scale] * sizeof(struct structure));
-			if (w->structure[scale] == NULL)
-				goto err;
+			/* new structure detected, grow table geometrically */
+			if (w->num_structures[scale] > capacity) {
+				capacity = capacity ? capacity * 2 : 64;
+				table = realloc(w->structure[scale],
+								capacity * sizeof(struct structure));
+				if (table == NULL)
+					goto err;
+				w->structure[scale] = table;
+			}
 
 			/* fill structure pixels with ID */
 			info.structure = w->structure[scale] + w->num_structures[scale] - 1;
@@ -289,9 +289,502 @@ int smbrr_wavelet_structure_find(struct smbrr_wavelet *w, unsigned int scale)
 	return w->num_structures[scale];
 
 err:
+	stack_free(&stack);
 	return -ENOMEM;
 }
 
+/*
+ * Union-find labeller working on runs of significant pixels. Strips of rows
+ * find and merge their runs in parallel and the strip seams are merged last.
+ * Every union links to the smaller run index so the root of each structure is
+ * its first run in raster order and IDs follow the same order as the flood
+ * fill.
+ */
+#define LABEL_STRIP_ROWS 64
+
+struct label_strip {
+	struct structure_span *run; /* runs found in this strip */
+	unsigned int num_runs; /* number of runs in this strip */
+	unsigned int size; /* allocated runs */
+	unsigned int offset; /* index of the first strip run in all runs */
+	unsigned int roots; /* first structure ID rooted in this strip */
+};
+
+struct label_runs {
+	struct smbrr *data; /* coefficients to threshold or NULL */
+	struct smbrr *sdata; /* significance map */
+	float sigma; /* threshold for data */
+	struct structure_span *run; /* all runs in raster order */
+	uint32_t *parent; /* union-find parent of each run */
+	uint32_t *label; /* structure ID of each run */
+	unsigned int *row; /* first run of each row, height + 1 entries */
+};
+
+static inline uint32_t label_find(const uint32_t *parent, uint32_t r)
+{
+	while (parent[r] != r)
+		r = parent[r];
+	return r;
+}
+
+static inline void label_union(uint32_t *parent, uint32_t a, uint32_t b)
+{
+	/* path halving keeps trees shallow for the later read only finds */
+	while (parent[a] != a) {
+		parent[a] = parent[parent[a]];
+		a = parent[a];
+	}
+	while (parent[b] != b) {
+		parent[b] = parent[parent[b]];
+		b = parent[b];
+	}
+
+	if (a < b)
+		parent[b] = a;
+	else if (b < a)
+		parent[a] = b;
+}
+
+/* find the runs in rows [y0, y1), thresholding each row first if data set */
+static int label_strip_runs(struct label_runs *lr, struct label_strip *ls,
+							unsigned int y0, unsigned int y1)
+{
+	const struct data_ops *ops = lr->sdata->ops;
+	struct structure_span *run;
+	unsigned int y, max = (lr->sdata->width + 1) / 2;
+
+	for (y = y0; y < y1; y++) {
+		/* room for the most runs a row can hold */
+		if (ls->num_runs + max > ls->size) {
+			ls->size = ls->size * 2 > ls->num_runs + max ?
+						   ls->size * 2 :
+						   ls->num_runs + max;
+			run = realloc(ls->run, ls->size * sizeof(*run));
+			if (run == NULL)
+				return -ENOMEM;
+			ls->run = run;
+		}
+
+		lr->row[y] = ls->num_runs;
+		if (lr->data)
+			ls->num_runs += ops->new_significance_runs(
+				lr->data, lr->sdata, lr->sigma, y, ls->run + ls->num_runs);
+		else
+			ls->num_runs += ops->significance_runs(lr->sdata, y,
+												   ls->run + ls->num_runs);
+	}
+
+	return 0;
+}
+
+/* union the runs on row y with the 4-connected runs on the row below */
+static void label_merge_rows(struct label_runs *lr, unsigned int y)
+{
+	const struct structure_span *run = lr->run;
+	unsigned int a = lr->row[y - 1], a_end = lr->row[y];
+	unsigned int b = lr->row[y], b_end = lr->row[y + 1];
+
+	while (a < a_end && b < b_end) {
+		if (run[a].x1 < run[b].x0)
+			a++;
+		else if (run[b].x1 < run[a].x0)
+			b++;
+		else {
+			label_union(lr->parent, a, b);
+			if (run[a].x1 < run[b].x1)
+				a++;
+			else
+				b++;
+		}
+	}
+}
+
+static int structure_label_runs(struct smbrr_wavelet *w, unsigned int scale,
+								struct smbrr *data, float sigma)
+{
+	struct smbrr *sdata = w->s[scale], *wdata = w->w[scale];
+	struct structure *table, *st;
+	struct structure_span *run, *spans;
+	struct label_strip *ls;
+	struct label_runs lr;
+	unsigned int width = sdata->width, height = sdata->height;
+	unsigned int num_strips, strip, total = 0, count, i, r, x, y, p;
+	unsigned int sig_pixels = 0;
+	int ret = 0;
+
+	memset(&lr, 0, sizeof(lr));
+	lr.data = data;
+	lr.sdata = sdata;
+	lr.sigma = sigma;
+
+	num_strips = (height + LABEL_STRIP_ROWS - 1) / LABEL_STRIP_ROWS;
+	ls = calloc(num_strips, sizeof(*ls));
+	lr.row = malloc((height + 1) * sizeof(unsigned int));
+	if (ls == NULL || lr.row == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* find the runs of each strip */
+#pragma omp parallel for private(y) reduction(min : ret) schedule(dynamic, 1)
+	for (strip = 0; strip < num_strips; strip++) {
+		y = (strip + 1) * LABEL_STRIP_ROWS;
+		if (label_strip_runs(&lr, &ls[strip], strip * LABEL_STRIP_ROWS,
+							 y < height ? y : height) < 0)
+			ret = -ENOMEM;
+	}
+	if (ret < 0)
+		goto out;
+
+	for (strip = 0; strip < num_strips; strip++) {
+		ls[strip].offset = total;
+		total += ls[strip].num_runs;
+	}
+	lr.row[height] = total;
+
+	lr.run = malloc((total ? total : 1) * sizeof(*lr.run));
+	lr.parent = malloc((total ? total : 1) * sizeof(uint32_t));
+	lr.label = malloc((total ? total : 1) * sizeof(uint32_t));
+	if (lr.run == NULL || lr.parent == NULL || lr.label == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* gather the runs in raster order */
+#pragma omp parallel for private(y, r) schedule(dynamic, 1)
+	for (strip = 0; strip < num_strips; strip++) {
+		memcpy(lr.run + ls[strip].offset, ls[strip].run,
+			   ls[strip].num_runs * sizeof(*lr.run));
+		for (y = strip * LABEL_STRIP_ROWS;
+			 y < (strip + 1) * LABEL_STRIP_ROWS && y < height; y++)
+			lr.row[y] += ls[strip].offset;
+		for (r = 0; r < ls[strip].num_runs; r++)
+			lr.parent[ls[strip].offset + r] = ls[strip].offset + r;
+	}
+
+	/* merge runs within each strip */
+#pragma omp parallel for private(y) schedule(dynamic, 1)
+	for (strip = 0; strip < num_strips; strip++) {
+		for (y = strip * LABEL_STRIP_ROWS + 1;
+			 y < (strip + 1) * LABEL_STRIP_ROWS && y < height; y++)
+			label_merge_rows(&lr, y);
+	}
+
+	/* then along the strip seams */
+	for (strip = 1; strip < num_strips; strip++)
+		label_merge_rows(&lr, strip * LABEL_STRIP_ROWS);
+
+	/* count roots per strip then number them in raster order */
+#pragma omp parallel for private(r, count) schedule(dynamic, 1)
+	for (strip = 0; strip < num_strips; strip++) {
+		count = 0;
+		for (r = ls[strip].offset; r < ls[strip].offset + ls[strip].num_runs;
+			 r++)
+			count += lr.parent[r] == r;
+		ls[strip].roots = count;
+	}
+
+	for (count = 0, strip = 0; strip < num_strips; strip++) {
+		i = ls[strip].roots;
+		ls[strip].roots = count;
+		count += i;
+	}
+
+#pragma omp parallel for private(r, i) schedule(dynamic, 1)
+	for (strip = 0; strip < num_strips; strip++) {
+		i = ls[strip].roots;
+		for (r = ls[strip].offset; r < ls[strip].offset + ls[strip].num_runs;
+			 r++) {
+			if (lr.parent[r] == r)
+				lr.label[r] = i++;
+		}
+	}
+
+#pragma omp parallel for if (sdata->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (r = 0; r < total; r++) {
+		if (lr.parent[r] != r)
+			lr.label[r] = lr.label[label_find(lr.parent, r)];
+	}
+
+	w->num_structures[scale] = 0;
+
+	table = realloc(w->structure[scale],
+					(count ? count : 1) * sizeof(struct structure));
+	spans = realloc(w->spans[scale],
+					(total ? total : 1) * sizeof(struct structure_span));
+	if (table)
+		w->structure[scale] = table;
+	if (spans)
+		w->spans[scale] = spans;
+	if (table == NULL || spans == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memset(table, 0, count * sizeof(struct structure));
+
+	for (i = 0; i < count; i++) {
+		st = &table[i];
+		st->id = i;
+		st->scale = scale;
+		st->minXy.x = width;
+		st->minxY.y = height;
+	}
+
+	/* write final IDs to the significance map */
+#pragma omp parallel for private(run, x, p)                                    \
+	if (sdata->elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (r = 0; r < total; r++) {
+		run = &lr.run[r];
+		p = run->y * width;
+		for (x = run->x0; x <= run->x1; x++)
+			sdata->s[p + x] = lr.label[r] + 2;
+	}
+
+	/* accumulate bounds, size, maximum and moments in raster order */
+	for (r = 0; r < total; r++) {
+		run = &lr.run[r];
+		st = &table[lr.label[r]];
+		p = run->y * width;
+
+		st->num_spans++;
+		st->size += run->x1 - run->x0 + 1;
+		for (x = run->x0; x <= run->x1; x++) {
+			if (wdata->adu[p + x] > st->max_value) {
+				st->max_value = wdata->adu[p + x];
+				st->max_pixel = p + x;
+			}
+			structure_moments_add(&st->m, wdata->adu[p + x], x, run->y);
+		}
+
+		if (run->x0 < st->minXy.x) {
+			st->minXy.x = run->x0;
+			st->minXy.y = run->y;
+		}
+		if (run->x1 > st->maxXy.x) {
+			st->maxXy.x = run->x1;
+			st->maxXy.y = run->y;
+		}
+		if (run->y < st->minxY.y) {
+			st->minxY.x = run->x0;
+			st->minxY.y = run->y;
+		}
+		if (run->y > st->maxxY.y) {
+			st->maxxY.x = run->x0;
+			st->maxxY.y = run->y;
+		}
+	}
+
+	/* the runs become the structure spans, grouped by structure */
+	for (i = 0; i < count; i++) {
+		table[i].span = spans;
+		spans += table[i].num_spans;
+		sig_pixels += table[i].size;
+		table[i].num_spans = 0;
+	}
+
+	for (r = 0; r < total; r++) {
+		st = &table[lr.label[r]];
+		st->span[st->num_spans++] = lr.run[r];
+	}
+
+	if (data)
+		sdata->sig_pixels = sig_pixels;
+
+	w->num_structures[scale] = count;
+	ret = count;
+
+out:
+	for (strip = 0; ls && strip < num_strips; strip++)
+		free(ls[strip].run);
+	free(ls);
+	free(lr.row);
+	free(lr.run);
+	free(lr.parent);
+	free(lr.label);
+	return ret;
+}
+
+/*
+ * Record each structure as runs of pixels along rows so later passes visit
+ * structure pixels only rather than the whole bounding box. Runs of all the
+ * structures on a scale share one allocation and are in raster order.
+ */
+static int structure_build_spans(struct smbrr_wavelet *w, unsigned int scale)
+{
+	struct smbrr *sdata = w->s[scale];
+	struct structure *table = w->structure[scale], *st;
+	struct structure_span *spans, *span;
+	unsigned int count = w->num_structures[scale];
+	unsigned int width = sdata->width, height = sdata->height;
+	unsigned int x, y, i, label, total = 0;
+	const uint32_t *row;
+
+	for (i = 0; i < count; i++)
+		table[i].num_spans = 0;
+
+	/* count runs for each structure */
+	for (y = 0; y < height; y++) {
+		row = sdata->s + y * width;
+		for (x = 0; x < width; x++) {
+			label = row[x];
+			if (label < 2 || label - 2 >= count)
+				continue;
+			if (x > 0 && row[x - 1] == label)
+				continue;
+			table[label - 2].num_spans++;
+			total++;
+		}
+	}
+
+	spans = realloc(w->spans[scale],
+					(total ? total : 1) * sizeof(struct structure_span));
+	if (spans == NULL)
+		return -ENOMEM;
+	w->spans[scale] = spans;
+
+	for (i = 0; i < count; i++) {
+		table[i].span = spans;
+		spans += table[i].num_spans;
+		table[i].num_spans = 0;
+	}
+
+	/* then fill them */
+	for (y = 0; y < height; y++) {
+		row = sdata->s + y * width;
+		for (x = 0; x < width; x++) {
+			label = row[x];
+			if (label < 2 || label - 2 >= count)
+				continue;
+
+			st = &table[label - 2];
+			span = &st->span[st->num_spans++];
+			span->y = y;
+			span->x0 = x;
+			while (x + 1 < width && row[x + 1] == label)
+				x++;
+			span->x1 = x;
+		}
+	}
+
+	return 0;
+}
+
+static int structure_find_scale(struct smbrr_wavelet *w, unsigned int scale)
+{
+	int ret;
+
+	/* the union-find engine builds the spans as it labels */
+	if (w->structure_engine == SMBRR_STRUCTURE_ENGINE_UNION_FIND)
+		return structure_label_runs(w, scale, NULL, 0.0f);
+
+	ret = structure_find_floodfill(w, scale);
+	if (ret < 0)
+		return ret;
+
+	if (structure_build_spans(w, scale) < 0)
+		return -ENOMEM;
+
+	return ret;
+}
+
+/**
+ * \param w Wavelet
+ * \param scale Scale to be searched.
+ * \return Number of structures found within this wavelet scale.
+ *
+ * Search this wavelet scale for any structures that could be part of an object.
+ */
+int smbrr_wavelet_structure_find(struct smbrr_wavelet *w, unsigned int scale)
+{
+	smbrr_wavelet_cl_sync(w);
+	return structure_find_scale(w, scale);
+}
+
+/**
+ * \param w Wavelet
+ * \param scale Scale to be searched.
+ * \param sigma Significance threshold for the wavelet coefficients.
+ * \return Number of structures found within this wavelet scale.
+ *
+ * Threshold the wavelet coefficients of this scale and find structures in one
+ * pass. Each row is thresholded straight into runs of significant pixels that
+ * are then labelled with the union-find engine, giving the same significance
+ * map and structures as smbrr_significant_new() followed by
+ * smbrr_wavelet_structure_find() with SMBRR_STRUCTURE_ENGINE_UNION_FIND.
+ */
+int smbrr_wavelet_structure_find_threshold(struct smbrr_wavelet *w,
+										   unsigned int scale, float sigma)
+{
+	int ret;
+
+	if (scale >= w->num_scales - 1)
+		return -EINVAL;
+
+	smbrr_wavelet_cl_sync(w);
+	ret = structure_label_runs(w, scale, w->w[scale], sigma);
+
+#ifdef HAVE_OPENCL
+	if (g_cl_ctx && ret >= 0) {
+		struct smbrr *sdata = w->s[scale];
+
+		clEnqueueWriteBuffer(g_cl_ctx->command_queue, sdata->cl_adu, CL_TRUE, 0,
+							 sdata->elems * sizeof(uint32_t), sdata->s, 0, NULL,
+							 NULL);
+		sdata->cl_state = 2;
+	}
+#endif
+
+	return ret;
+}
+
+/**
+ * \param w Wavelet
+ * \return Total number of structures found over all scales or negative error.
+ *
+ * Search every wavelet scale for structures. Device buffers are synced once
+ * and the scales are labelled concurrently, one scale per thread.
+ */
+int smbrr_wavelet_structure_find_all(struct smbrr_wavelet *w)
+{
+	int scale, num_scales = w->num_scales - 1, ret = 0, total = 0, found;
+
+	smbrr_wavelet_cl_sync(w);
+
+#pragma omp parallel for private(found) reduction(min : ret)                  \
+	reduction(+ : total) schedule(dynamic, 1)
+	for (scale = 0; scale < num_scales; scale++) {
+		found = structure_find_scale(w, scale);
+		if (found < 0)
+			ret = found;
+		else
+			total += found;
+	}
+
+	return ret < 0 ? ret : total;
+}
+
+/**
+ * \param w Wavelet
+ * \param engine Structure labelling engine.
+ * \return 0 on success.
+ *
+ * Select the engine used to label structures at each scale. The union-find
+ * engine labels strips of rows in parallel and merges labels along strip
+ * seams, then sizes the structure table once.
+ */
+int smbrr_wavelet_set_structure_engine(struct smbrr_wavelet *w,
+									   enum smbrr_structure_engine engine)
+{
+	switch (engine) {
+	case SMBRR_STRUCTURE_ENGINE_FLOODFILL:
+	case SMBRR_STRUCTURE_ENGINE_UNION_FIND:
+		w->structure_engine = engine;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 /* find structure at pixel on scale */
 static struct structure *find_root_structure(struct smbrr_wavelet *w,
 											 unsigned int root_scale,
@@ -325,37 +818,78 @@ static void prune_structure(struct smbrr_wavelet *w, unsigned int scale,
 		structure->pruned = 1;
 }
 
-/* connect a single structure to a struct on scale + 1 */
-static int connect_structure_to_root(struct smbrr_wavelet *w,
-									 unsigned int root_scale,
-									 struct structure *structure)
+/* find the root of a single structure on scale + 1 */
+static struct structure *structure_get_root(struct smbrr_wavelet *w,
+											unsigned int root_scale,
+											struct structure *structure)
 {
 	struct structure *root;
 
 	/* ignore any pruned structures */
 	if (structure->pruned)
-		return 0;
+		return NULL;
 
 	/* find connected structure at new scale */
 	root = find_root_structure(w, root_scale, structure->max_pixel);
 	if (root == NULL)
-		return 0;
+		return NULL;
 
 	/* ignore any pruned structures */
 	if (root->pruned)
-		return 0;
+		return NULL;
+
+	return root;
+}
+
+/*
+ * Connect the structures on scale to their roots on scale + 1. Branches of
+ * every root are counted first and then filled into one compressed sparse row
+ * array for the scale pair, in ascending structure ID order.
+ */
+static int connect_scale_to_root(struct smbrr_wavelet *w, unsigned int scale)
+{
+	struct structure *structure = w->structure[scale], *root;
+	struct structure *roots = w->structure[scale + 1];
+	unsigned int i, offset = 0, *branches;
+
+	for (i = 0; i < w->num_structures[scale + 1]; i++)
+		roots[i].num_branches = 0;
+
+	/* count branches of each root */
+	for (i = 0; i < w->num_structures[scale]; i++) {
+		root = structure_get_root(w, scale + 1, &structure[i]);
+		structure[i].has_root = root != NULL;
+		if (root == NULL)
+			continue;
 
-	/* add branch and root structures */
-	structure->root = root->id;
-	structure->has_root = 1;
+		/* add branch and root structures */
+		structure[i].root = root->id;
+		root->num_branches++;
+	}
 
-	root->num_branches++;
-	root->branch =
-		realloc(root->branch, root->num_branches * sizeof(unsigned int));
-	if (root->branch == NULL)
+	branches = realloc(w->branches[scale + 1],
+					   (w->num_structures[scale] ? w->num_structures[scale] :
+												   1) *
+						   sizeof(unsigned int));
+	if (branches == NULL)
 		return -ENOMEM;
+	w->branches[scale + 1] = branches;
+
+	for (i = 0; i < w->num_structures[scale + 1]; i++) {
+		roots[i].branch = branches + offset;
+		offset += roots[i].num_branches;
+		roots[i].num_branches = 0;
+	}
+
+	/* then fill them */
+	for (i = 0; i < w->num_structures[scale]; i++) {
+		if (!structure[i].has_root)
+			continue;
+
+		root = roots + structure[i].root;
+		root->branch[root->num_branches++] = structure[i].id;
+	}
 
-	root->branch[root->num_branches - 1] = structure->id;
 	return 0;
 }
 
@@ -409,51 +943,53 @@ static struct structure *structure_is_root(struct smbrr_wavelet *w,
 										   struct structure *structure,
 										   struct structure *root)
 {
-	struct smbrr *sdata = w->s[structure->scale];
 	struct smbrr *sroot = w->s[root->scale];
-	unsigned int x, y, pixel, sid, rid;
+	struct structure_span *span;
+	unsigned int pixel = root->max_pixel, lo = 0, hi = structure->num_spans;
+	unsigned int mid, start, x, y;
 
-	sid = structure->id + 2;
-	rid = root->id + 2;
+	if (sroot->s[pixel] != root->id + 2)
+		return NULL;
 
-	for (x = structure->minXy.x; x <= structure->maxXy.x; x++) {
-		for (y = structure->minxY.y; y <= structure->maxxY.y; y++) {
-			pixel = sdata->width * y + x;
+	/* the match is limited to the structure bounds as recorded when found */
+	x = pixel % sroot->width;
+	y = pixel / sroot->width;
+	if (x < structure->minXy.x || x > structure->maxXy.x ||
+		y < structure->minxY.y || y > structure->maxxY.y)
+		return NULL;
 
-			if (sdata->s[pixel] == sid && sroot->s[pixel] == rid) {
-				if (pixel == root->max_pixel)
-					return structure;
-			}
-		}
+	/* spans are in raster order so search for the last one starting first */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		span = &structure->span[mid];
+		if (span->y * sroot->width + span->x0 <= pixel)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	if (lo == 0)
+		return NULL;
+
+	span = &structure->span[lo - 1];
+	start = span->y * sroot->width;
+	if (pixel > start + span->x1)
+		return NULL;
 
-	return NULL;
+	return structure;
 }
 
-static int object_create_data(struct smbrr_wavelet *w, struct object *object)
+/* reconstruct the object into its plane carved from the object arena */
+static void object_create_data(struct smbrr_wavelet *w, struct object *object,
+							   struct smbrr *data)
 {
-	int width, height, ret;
-
-	width = object->o.maxXy.x - object->o.minXy.x + 1;
-	height = object->o.maxxY.y - object->o.minxY.y + 1;
-
-	object->data =
-		smbrr_new(w->c[0]->type, width, height, 0, SMBRR_SOURCE_UINT8, NULL);
-	if (object->data == NULL)
-		return -ENOMEM;
-
-	ret = smbrr_wavelet_deconvolution_object(w, w->conv_type, w->mask_type,
-											 &object->o);
-
-	return ret;
+	object->data = data;
+	w->ops->atrous_deconv_object(w, &object->o);
 }
 
 static void object_get_bounds(struct smbrr_wavelet *w, struct object *object)
 {
 	struct structure *structure;
 	unsigned int minX = 2147483647, minY = 2147483647, maxX = 0, maxY = 0;
-	double x, y, x1 = (double)minX, y1 = (double)minY, x2 = (double)maxX,
-				 y2 = (double)maxY;
 	unsigned int i;
 
 	object->o.max_adu = 0.0;
@@ -471,8 +1007,7 @@ static void object_get_bounds(struct smbrr_wavelet *w, struct object *object)
 
 		/* get limits */
 		if (minX > structure->minXy.x) {
-			x2 = minX = structure->minXy.x;
-			y2 = structure->minXy.y;
+			minX = structure->minXy.x;
 			object->o.minXy = structure->minXy;
 		}
 
@@ -482,8 +1017,7 @@ static void object_get_bounds(struct smbrr_wavelet *w, struct object *object)
 		}
 
 		if (maxX < structure->maxXy.x) {
-			x1 = maxX = structure->maxXy.x;
-			y1 = structure->maxXy.y;
+			maxX = structure->maxXy.x;
 			object->o.maxXy = structure->maxXy;
 		}
 
@@ -491,12 +1025,52 @@ static void object_get_bounds(struct smbrr_wavelet *w, struct object *object)
 			maxY = structure->maxxY.y;
 			object->o.maxxY = structure->maxxY;
 		}
+	}
+}
 
-		x = x1 - x2;
-		y = y1 - y2;
+/* centroid and shape from the moment sums of the object structures */
+static void object_get_moments(struct smbrr_wavelet *w, struct object *object)
+{
+	struct structure_moments m;
+	struct structure *structure;
+	struct smbrr_object *o = &object->o;
+	double cx, cy, mxx, myy, mxy, t, major, minor;
+	unsigned int i;
 
-		object->o.pa = atan2(y, x);
+	memset(&m, 0, sizeof(m));
+	for (i = object->start_scale; i <= object->end_scale; i++) {
+		structure = w->structure[i] + object->structure[i];
+		m.i += structure->m.i;
+		m.ix += structure->m.ix;
+		m.iy += structure->m.iy;
+		m.ixx += structure->m.ixx;
+		m.iyy += structure->m.iyy;
+		m.ixy += structure->m.ixy;
 	}
+
+	if (m.i <= 0.0)
+		return;
+
+	cx = m.ix / m.i;
+	cy = m.iy / m.i;
+	mxx = m.ixx / m.i - cx * cx;
+	myy = m.iyy / m.i - cy * cy;
+	mxy = m.ixy / m.i - cx * cy;
+
+	o->structure_adu = m.i;
+	o->cx = cx;
+	o->cy = cy;
+	o->mxx = mxx;
+	o->myy = myy;
+	o->mxy = mxy;
+	o->pa = 0.5 * atan2(2.0 * mxy, mxx - myy);
+
+	/* axes are the roots of the second moment eigenvalues */
+	t = sqrt(0.25 * (mxx - myy) * (mxx - myy) + mxy * mxy);
+	major = 0.5 * (mxx + myy) + t;
+	minor = 0.5 * (mxx + myy) - t;
+	if (major > 0.0)
+		o->ellipticity = 1.0 - sqrt(minor > 0.0 ? minor / major : 0.0);
 }
 
 static void object_get_position(struct smbrr_wavelet *w, struct object *object)
@@ -513,47 +1087,32 @@ static void object_get_position(struct smbrr_wavelet *w, struct object *object)
 	object->o.pos.y = structure->max_pixel / wdata->width;
 }
 
-static void object_get_sigma(struct smbrr_wavelet *w, struct object *object)
-{
-	(void)w;
-	unsigned int i;
-	float sigma = 0.0, t;
-
-	/* get sigma */
-	for (i = 0; i < object->data->elems; i++) {
-		if (object->data->adu[i] == 0.0)
-			continue;
-		t = object->data->adu[i] - object->o.mean_adu;
-		t *= t;
-		sigma += t;
-	}
-
-	sigma /= object->o.object_area;
-	object->o.sigma_adu = sqrtf(sigma);
-}
-
-static int object_get_area(struct smbrr_wavelet *w, struct object *object)
+/* total, area, mean and sigma in one pass over the reconstructed data */
+static void object_get_area(struct smbrr_wavelet *w, struct object *object,
+							struct smbrr *data)
 {
-	int err;
+	double sum = 0.0, sum2 = 0.0, var;
 	unsigned int i;
+	float v;
 
 	/* create data for this object */
-	err = object_create_data(w, object);
-	if (err < 0)
-		return err;
+	object_create_data(w, object, data);
 
-	/* calculate total ADU and area for object */
 	for (i = 0; i < object->data->elems; i++) {
-		if (object->data->adu[i] != 0.0) {
-			object->o.object_adu += object->data->adu[i];
+		v = object->data->adu[i];
+		if (v != 0.0) {
+			sum += v;
+			sum2 += (double)v * v;
 			object->o.object_area++;
 		}
 	}
 
-	/* TODO: calculate PA based on max/min coords */
-	object->o.mean_adu = object->o.object_adu / object->o.object_area;
+	object->o.object_adu = sum;
+	object->o.mean_adu = sum / object->o.object_area;
 
-	return 0;
+	var = sum2 / object->o.object_area - (double)object->o.mean_adu *
+											  object->o.mean_adu;
+	object->o.sigma_adu = var > 0.0 ? sqrt(var) : 0.0;
 }
 
 static void object_get_type(struct smbrr_wavelet *w, struct object *object)
@@ -570,12 +1129,12 @@ static void object_get_type(struct smbrr_wavelet *w, struct object *object)
 static inline int pixel_is_stellar_object(struct smbrr_wavelet *w,
 										  unsigned int pixel)
 {
-	struct object *object = w->object_map[pixel];
+	uint32_t id = object_map_get(w, pixel);
 
-	if (!object)
+	if (!id)
 		return 0;
 
-	if (object->o.type == SMBRR_OBJECT_EXTENDED)
+	if (w->objects[id - 1].o.type == SMBRR_OBJECT_EXTENDED)
 		return 0;
 	return 1;
 }
@@ -583,32 +1142,69 @@ static inline int pixel_is_stellar_object(struct smbrr_wavelet *w,
 static inline int pixel_is_object(struct smbrr_wavelet *w, unsigned int pixel,
 								  struct object *object)
 {
-	struct object *o = w->object_map[pixel];
+	uint32_t id = object_map_get(w, pixel);
 
-	if (object == o)
+	if (id && object == &w->objects[id - 1])
 		return 1;
 	else
 		return 0;
 }
 
-static int background_cmp(const void *o1, const void *o2)
+/* per thread buffers reused across objects */
+struct object_scratch {
+	float *background; /* background samples */
+	unsigned int size; /* allocated samples */
+};
+
+/* data elements of the objects reconstructed at once when streaming */
+#define OBJECT_STREAM_ELEMS (4 * 1024 * 1024)
+
+/* objects measured in top mode beyond twice the number requested */
+#define OBJECT_TOP_MARGIN 16
+
+/* largest number of background samples before sampling on a subgrid */
+#define BACKGROUND_MAX_SAMPLES (256 * 1024)
+
+/* k-th smallest sample in linear time, reorders v */
+static void background_select(float *v, int n, int k)
 {
-	const float b1 = *(float *)o1, b2 = *(float *)o2;
+	int lo = 0, hi = n - 1, i, j;
+	float pivot, tmp;
+
+	while (lo < hi) {
+		pivot = v[lo + (hi - lo) / 2];
+		i = lo;
+		j = hi;
+
+		while (i <= j) {
+			while (v[i] < pivot)
+				i++;
+			while (v[j] > pivot)
+				j--;
+			if (i <= j) {
+				tmp = v[i];
+				v[i++] = v[j];
+				v[j--] = tmp;
+			}
+		}
 
-	if (b1 < b2)
-		return 1;
-	else if (b1 > b2)
-		return -1;
-	else
-		return 0;
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
 }
 
 static void object_get_annulus_background(struct smbrr_wavelet *w,
-										  struct object *object)
+										  struct object *object,
+										  struct object_scratch *scratch)
 {
-	unsigned int count = 0, size, bstart, bend;
-	unsigned int x, y, xstart, ystart, xend, yend, pixel, i;
-	float total = 0.0, *background;
+	unsigned int count = 0, size, bstart, bend, step = 1;
+	unsigned int x, y, xstart, ystart, xend, yend, pixel, i, lo, hi;
+	double total = 0.0;
+	float *background;
 
 	/* size of background checking area */
 	ystart = (object->o.pos.y > object->o.object_radius) ?
@@ -625,15 +1221,25 @@ static void object_get_annulus_background(struct smbrr_wavelet *w,
 	if (xend >= w->width)
 		xend = w->width - 1;
 
-	/* allocate buffer to store valid background values */
-	size = ((xend - xstart) + 1) * ((yend - ystart) + 1);
-	background = calloc(size, sizeof(float));
-	if (background == NULL)
-		return;
+	/* sample large areas on a subgrid */
+	while (((xend - xstart) / step + 1) * ((yend - ystart) / step + 1) >
+		   BACKGROUND_MAX_SAMPLES)
+		step++;
+
+	/* grow this thread's buffer to store valid background values */
+	size = ((xend - xstart) / step + 1) * ((yend - ystart) / step + 1);
+	if (size > scratch->size) {
+		background = realloc(scratch->background, size * sizeof(float));
+		if (background == NULL)
+			return;
+		scratch->background = background;
+		scratch->size = size;
+	}
+	background = scratch->background;
 
 	/* get background pixels line by line */
-	for (y = ystart; y <= yend; y++) {
-		for (x = xstart; x <= xend; x++) {
+	for (y = ystart; y <= yend; y += step) {
+		for (x = xstart; x <= xend; x += step) {
 			pixel = y * w->width + x;
 
 			/* ignore this object */
@@ -650,23 +1256,29 @@ static void object_get_annulus_background(struct smbrr_wavelet *w,
 		}
 	}
 
-	/* sort background pixels and dispose top and bottom 20% */
-	qsort(background, count, sizeof(float), background_cmp);
-
+	/* dispose of the top and bottom 20% of background pixels */
 	bstart = 0.2 * count;
 	bend = 0.8 * count;
 
-	/* only count mid pixels i.e. 20% - 80% */
-	for (i = bstart; i < bend; i++)
+	/* select the mid pixels i.e. 20% - 80% into [lo, hi) without sorting */
+	lo = count - bend;
+	hi = count - bstart;
+	if (lo < hi) {
+		background_select(background, count, lo);
+		if (hi < count)
+			background_select(background + lo, count - lo, hi - lo);
+	}
+
+	for (i = lo; i < hi; i++)
 		total += background[i];
 
-	free(background);
 	object->o.background_adu = total;
 	object->o.background_area = bend - bstart;
 }
 
 static void object_get_background(struct smbrr_wavelet *w,
-								  struct object *object)
+								  struct object *object,
+								  struct object_scratch *scratch)
 {
 	struct smbrr_object *o = &object->o;
 
@@ -680,7 +1292,7 @@ static void object_get_background(struct smbrr_wavelet *w,
 
 	/* sum background from annulus -
    * exclude objects - use mean for backgound for object pixels */
-	object_get_annulus_background(w, object);
+	object_get_annulus_background(w, object, scratch);
 }
 
 static void object_calc_snr(struct smbrr_wavelet *w, struct object *object)
@@ -714,40 +1326,203 @@ static void object_calc_snr(struct smbrr_wavelet *w, struct object *object)
 	o->error = -2.5 * log10(1.0 - 1.0 / o->snr);
 }
 
-static int object_calc_data(struct smbrr_wavelet *w)
+/*
+ * Carve the reconstructed data planes of count objects from first out of one
+ * arena. Each plane is aligned as if allocated by smbrr_new().
+ */
+static int object_arena_new(struct smbrr_wavelet *w, unsigned int first,
+							unsigned int count)
 {
 	struct object *object;
-	int err;
-	unsigned int i;
+	struct smbrr *data;
+	size_t offset = 0, *start;
+	unsigned int i, width, height;
+	float *adu;
 
-	smbrr_wavelet_cl_sync(w);
+	start = malloc((count + 1) * sizeof(size_t));
+	if (start == NULL)
+		return -ENOMEM;
 
-	/* 1st pass data */
+	for (i = 0; i < count; i++) {
+		object = &w->objects[first + i];
+		width = object->o.maxXy.x - object->o.minXy.x + 1;
+		height = object->o.maxxY.y - object->o.minxY.y + 1;
+
+		start[i] = offset;
+		offset += ((size_t)width * height + 7) & ~(size_t)7;
+	}
+	start[i] = offset;
+
+	w->object_data = calloc(count ? count : 1, sizeof(struct smbrr));
+	if (w->object_data == NULL ||
+		posix_memalign((void **)&w->object_adu, 32,
+					   (offset ? offset : 1) * sizeof(float))) {
+		free(w->object_data);
+		w->object_data = NULL;
+		free(start);
+		return -ENOMEM;
+	}
+	w->num_object_data = count;
+	adu = w->object_adu;
+
+#pragma omp parallel for private(object, data, width, height)                  \
+	schedule(dynamic, 64)
+	for (i = 0; i < count; i++) {
+		object = &w->objects[first + i];
+		data = &w->object_data[i];
+		width = object->o.maxXy.x - object->o.minXy.x + 1;
+		height = object->o.maxxY.y - object->o.minxY.y + 1;
+
+		data->adu = adu + start[i];
+		data->type = w->c[0]->type;
+		data->ops = w->c[0]->ops;
+		data->width = width;
+		data->height = data->type == SMBRR_DATA_1D_FLOAT ? 1 : height;
+		data->elems = data->width * data->height;
+		data->stride = width % 4 ? width + 4 - width % 4 : width;
+		memset(data->adu, 0, (start[i + 1] - start[i]) * sizeof(float));
+
+#ifdef HAVE_OPENCL
+		if (g_cl_ctx) {
+			cl_int err;
+			data->cl_adu =
+				clCreateBuffer(g_cl_ctx->context, CL_MEM_READ_WRITE,
+							   data->elems * sizeof(float), NULL, &err);
+			data->cl_state = 2;
+		}
+#endif
+	}
+
+	free(start);
+	return 0;
+}
+
+static void object_arena_free(struct smbrr_wavelet *w)
+{
+#ifdef HAVE_OPENCL
+	unsigned int i;
+
+	for (i = 0; i < w->num_object_data; i++) {
+		if (w->object_data[i].cl_adu)
+			clReleaseMemObject(w->object_data[i].cl_adu);
+	}
+#endif
+	free(w->object_data);
+	free(w->object_adu);
+	w->object_data = NULL;
+	w->object_adu = NULL;
+	w->num_object_data = 0;
+}
+
+/* map each pixel to an object, 16 bit entries when object IDs fit */
+static int object_map_new(struct smbrr_wavelet *w)
+{
+	unsigned int size;
+
+	size = w->num_objects < UINT16_MAX ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	free(w->object_map);
+	w->object_map = calloc(w->width * w->height, size);
+	if (w->object_map == NULL)
+		return -ENOMEM;
+
+	w->object_map_size = size;
+	return 0;
+}
+
+/* measure the bounds of every object and reset the object map */
+static int object_calc_bounds(struct smbrr_wavelet *w)
+{
+	struct object *object;
+	int err;
+	unsigned int i;
+
+	smbrr_wavelet_cl_sync(w);
+
+	if (w->conv_type != SMBRR_CONV_ATROUS)
+		return -EINVAL;
+	err = deconv_mask_set_2d(w, w->mask_type);
+	if (err < 0)
+		return err;
+
+#pragma omp parallel for private(object) schedule(dynamic, 64)
 	for (i = 0; i < w->num_objects; i++) {
 		object = &w->objects[i];
-
 		object_get_bounds(w, object);
+		object_get_moments(w, object);
+	}
 
-		err = object_get_area(w, object);
-		if (err < 0)
-			return err;
+	/* object map is only needed once objects are reconstructed */
+	return object_map_new(w);
+}
 
-		object_get_position(w, object);
+/* reconstruct and measure count objects from first into the arena */
+static void object_calc_area(struct smbrr_wavelet *w, unsigned int first,
+							 unsigned int count)
+{
+	struct object *object;
+	unsigned int i;
 
-		object_get_sigma(w, object);
+#pragma omp parallel for private(object) schedule(dynamic, 10)
+	for (i = 0; i < count; i++) {
+		object = &w->objects[first + i];
+
+		object_get_area(w, object, &w->object_data[i]);
+
+		object_get_position(w, object);
 
 		object_get_type(w, object);
 	}
+}
 
-	/* 2nd pass - these calues depend on completed 1st pass values */
-#pragma omp parallel for private(object) schedule(dynamic, 10)
-	for (i = 0; i < w->num_objects; i++) {
-		object = &w->objects[i];
+/* background depends on the object map of every object */
+static void object_calc_background(struct smbrr_wavelet *w, unsigned int first,
+								   unsigned int count)
+{
+	struct object_scratch scratch;
+	struct object *object;
+	unsigned int i;
 
-		object_get_background(w, object);
+#pragma omp parallel private(object, scratch)
+	{
+		scratch.background = NULL;
+		scratch.size = 0;
+
+#pragma omp for schedule(dynamic, 10)
+		for (i = first; i < first + count; i++) {
+			object = &w->objects[i];
+
+			/* objects dropped by top mode are not measured */
+			if (object->pruned)
+				continue;
 
-		object_calc_snr(w, object);
+			object_get_background(w, object, &scratch);
+
+			object_calc_snr(w, object);
+		}
+
+		free(scratch.background);
 	}
+}
+
+static int object_calc_data(struct smbrr_wavelet *w)
+{
+	int err;
+
+	err = object_calc_bounds(w);
+	if (err < 0)
+		return err;
+
+	object_arena_free(w);
+	err = object_arena_new(w, 0, w->num_objects);
+	if (err < 0)
+		return err;
+
+	/* 1st pass data */
+	object_calc_area(w, 0, w->num_objects);
+
+	/* 2nd pass - these calues depend on completed 1st pass values */
+	object_calc_background(w, 0, w->num_objects);
 
 	return 0;
 }
@@ -816,85 +1591,82 @@ static int object_cmp(const void *o1, const void *o2)
  * single low resolution root structure and several branches from higher
  * resolution scales. TODO: add more logic here to detect more object types.
  */
-static int create_object(struct smbrr_wavelet *w, unsigned int scale,
+static int create_object(struct smbrr_wavelet *w, struct structure **stack,
 						 struct structure *structure)
 {
 	struct object *object;
 	struct structure *root = NULL, *closest_branch, *branch;
-	int err;
-	unsigned int i, bscale = scale - 1, rscale = scale + 1;
+	unsigned int i, scale, bscale, rscale, pos = 0;
+
+	/* walk the structure tree depth first, branches in order */
+	stack[pos++] = structure;
+	while (pos) {
+		structure = stack[--pos];
+		scale = structure->scale;
+		bscale = scale - 1;
+		rscale = scale + 1;
+
+		/* make sure we are not part of an object already */
+		if (structure->merged)
+			continue;
 
-	/* make sure we are not part of an object already */
-	if (structure->merged)
-		return 0;
+		/* ignore pruned structures */
+		if (structure->pruned)
+			continue;
 
-	/* ignore pruned structures */
-	if (structure->pruned)
-		return 0;
+		/* disconnected structures do not form objects */
+		if (structure->num_branches == 0 && !structure->has_root)
+			continue;
 
-	/* disconnected structures do not form objects */
-	if (structure->num_branches == 0 && !structure->has_root)
-		return 0;
+		/* do we need to allocate new object */
+		if (structure->has_root) {
+			root = w->structure[rscale] + structure->root;
+			object = &w->objects[root->object_id];
+		} else {
+			object = new_object(w, scale, structure);
+			if (object == NULL)
+				return -EINVAL;
+			object->end_scale = scale;
+		}
 
-	/* do we need to allocate new object */
-	if (structure->has_root) {
-		root = w->structure[rscale] + structure->root;
-		object = &w->objects[root->object_id];
-	} else {
-		object = new_object(w, scale, structure);
-		if (object == NULL)
-			return -EINVAL;
-		object->end_scale = scale;
-	}
-
-	/* assign structure to object */
-	object->structure[scale] = structure->id;
-	structure->object_id = object->o.id;
-	structure->merged = 1;
-	object->start_scale = scale;
-
-	/* is this the highest resolution for this structure and object ? */
-	if (structure->num_branches == 0)
-		return 0;
+		/* assign structure to object */
+		object->structure[scale] = structure->id;
+		structure->object_id = object->o.id;
+		structure->merged = 1;
+		object->start_scale = scale;
 
-	/* Get the closest branch to this structure based on the distance between
-   * the maximum pixel positions. Then check if the closest branch contains
-   * the maximum pixel for root structure. */
-	closest_branch = structure_get_closest_branch(w, scale, structure);
-	if (closest_branch != NULL)
-		closest_branch = structure_is_root(w, closest_branch, structure);
+		/* is this the highest resolution for this structure and object ? */
+		if (structure->num_branches == 0)
+			continue;
 
-	/* determine if object terminates here of other branches */
-	/* object spans to next scale with 1 or more branches */
-	for (i = 0; i < structure->num_branches; i++) {
-		branch = w->structure[bscale] + structure->branch[i];
+		/* Get the closest branch to this structure based on the distance
+		 * between the maximum pixel positions. Then check if the closest
+		 * branch contains the maximum pixel for root structure. */
+		closest_branch = structure_get_closest_branch(w, scale, structure);
+		if (closest_branch != NULL)
+			closest_branch = structure_is_root(w, closest_branch, structure);
+
+		/* object spans to next scale with 1 or more branches, push them in
+		 * reverse so they are visited in order */
+		for (i = structure->num_branches; i > 0; i--) {
+			branch = w->structure[bscale] + structure->branch[i - 1];
 
-		/* dont create new object if branch is closest */
-		if (branch != closest_branch)
-			branch->has_root = 0;
+			/* dont create new object if branch is closest */
+			if (branch != closest_branch)
+				branch->has_root = 0;
 
-		/* create a new object with branch at new scale */
-		err = create_object(w, bscale, branch);
-		if (err < 0)
-			return err;
+			stack[pos++] = branch;
+		}
 	}
 
 	return 0;
 }
 
-static int prune_objects(struct smbrr_wavelet *w)
+/* drop the count objects flagged as pruned, keeping the order of the rest */
+static int object_remove_pruned(struct smbrr_wavelet *w, unsigned int count)
 {
 	struct object *object, *base, *nobject;
-	unsigned int i, count = 0;
-
-	for (i = 0; i < w->num_objects; i++) {
-		object = &w->objects[i];
-
-		if (object->start_scale == object->end_scale) {
-			object->pruned = 1;
-			count++;
-		}
-	}
+	unsigned int i;
 
 	if (count == 0)
 		return 0;
@@ -921,25 +1693,30 @@ static int prune_objects(struct smbrr_wavelet *w)
 	return 0;
 }
 
-/**
- * \param w Wavelet
- * \param start_scale Starting wavelet scale.
- * \param end_scale Last wavelet scale.
- * \return Number of Objects found within this wavelet scale range.
- *
- * Search the wavelet scales for any objects.
- */
-int smbrr_wavelet_structure_connect(struct smbrr_wavelet *w,
-									unsigned int start_scale,
-									unsigned int end_scale)
+static int prune_objects(struct smbrr_wavelet *w)
 {
-	struct structure *structure;
-	int err = 0, ret;
-	unsigned int scale, i, start = start_scale, end = end_scale;
+	struct object *object;
+	unsigned int i, count = 0;
 
-	/* make sure we dont check scales after last */
-	if (end_scale > w->num_scales - 1)
-		return 0;
+	for (i = 0; i < w->num_objects; i++) {
+		object = &w->objects[i];
+
+		if (object->start_scale == object->end_scale) {
+			object->pruned = 1;
+			count++;
+		}
+	}
+
+	return object_remove_pruned(w, count);
+}
+
+/* connect structures between scales into pruned objects */
+static int object_connect(struct smbrr_wavelet *w, unsigned int start,
+						  unsigned int end)
+{
+	struct structure *structure, **stack;
+	int err = 0;
+	unsigned int scale, i, total;
 
 	smbrr_wavelet_cl_sync(w);
 
@@ -953,18 +1730,21 @@ int smbrr_wavelet_structure_connect(struct smbrr_wavelet *w,
 			prune_structure(w, scale, &structure[i]);
 	}
 
-	/* connect structures at each scale */
+	/* connect structures at each scale, scale pairs are independent */
+#pragma omp parallel for reduction(min : err) schedule(dynamic, 1)
 	for (scale = start; scale < end; scale++) {
-		/* get first structure at this scale */
-		structure = w->structure[scale];
-
-		/* connect each structure */
-		for (i = 0; i < w->num_structures[scale]; i++) {
-			err = connect_structure_to_root(w, scale + 1, &structure[i]);
-			if (err < 0)
-				return err;
-		}
+		if (connect_scale_to_root(w, scale) < 0)
+			err = -ENOMEM;
 	}
+	if (err < 0)
+		return err;
+
+	/* each structure is pushed at most once when building the object trees */
+	for (scale = start, total = 0; scale <= end; scale++)
+		total += w->num_structures[scale];
+	stack = malloc((total ? total : 1) * sizeof(*stack));
+	if (stack == NULL)
+		return -ENOMEM;
 
 	/* create new objects and deblend connected structures */
 	for (scale = end;; scale--) {
@@ -973,17 +1753,57 @@ int smbrr_wavelet_structure_connect(struct smbrr_wavelet *w,
 
 		/* connect each structure */
 		for (i = 0; i < w->num_structures[scale]; i++) {
-			err = create_object(w, scale, structure + i);
-			if (err < 0)
+			err = create_object(w, stack, structure + i);
+			if (err < 0) {
+				free(stack);
 				return err;
+			}
 		}
 
 		if (scale == start)
 			break;
 	}
+	free(stack);
 
 	/* prune objects */
-	ret = prune_objects(w);
+	return prune_objects(w);
+}
+
+/* sort and index measured objects */
+static int object_catalogue(struct smbrr_wavelet *w)
+{
+	unsigned int i;
+
+	/* sort objects into ascending order of total adu */
+	for (i = 0; i < w->num_objects; i++)
+		w->objects_sorted[i] = &w->objects[i];
+
+	qsort(w->objects_sorted, w->num_objects, sizeof(struct object *),
+		  object_cmp);
+
+	/* index object positions for region and neighbour queries */
+	return object_grid_build(w);
+}
+
+/**
+ * \param w Wavelet
+ * \param start_scale Starting wavelet scale.
+ * \param end_scale Last wavelet scale.
+ * \return Number of Objects found within this wavelet scale range.
+ *
+ * Search the wavelet scales for any objects.
+ */
+int smbrr_wavelet_structure_connect(struct smbrr_wavelet *w,
+									unsigned int start_scale,
+									unsigned int end_scale)
+{
+	int ret;
+
+	/* make sure we dont check scales after last */
+	if (end_scale > w->num_scales - 1)
+		return 0;
+
+	ret = object_connect(w, start_scale, end_scale);
 	if (ret < 0)
 		return ret;
 
@@ -992,16 +1812,508 @@ int smbrr_wavelet_structure_connect(struct smbrr_wavelet *w,
 	if (ret < 0)
 		return ret;
 
-	/* sort objects into ascending order of total adu */
+	/* calculate total adu for each object */
+	object_calc_data2(w);
+
+	ret = object_catalogue(w);
+	if (ret < 0)
+		return ret;
+
+	return w->num_objects;
+}
+
+/* objects from first whose data planes fit in the stream budget, at least 1 */
+static unsigned int object_stream_batch(struct smbrr_wavelet *w,
+										unsigned int first)
+{
+	struct object *object;
+	size_t elems = 0;
+	unsigned int i;
+
+	for (i = first; i < w->num_objects; i++) {
+		object = &w->objects[i];
+		elems += (size_t)(object->o.maxXy.x - object->o.minXy.x + 1) *
+				 (object->o.maxxY.y - object->o.minxY.y + 1);
+		if (elems > OBJECT_STREAM_ELEMS && i > first)
+			break;
+	}
+
+	return i - first;
+}
+
+/* detach the data planes of a batch before its arena is freed */
+static void object_stream_detach(struct smbrr_wavelet *w, unsigned int first,
+								 unsigned int count)
+{
+	unsigned int i;
+
+	for (i = first; i < first + count; i++)
+		w->objects[i].data = NULL;
+	object_arena_free(w);
+}
+
+/* measure bounds and area of every object in batches, keeping no data */
+static int object_stream_area(struct smbrr_wavelet *w)
+{
+	unsigned int first, count;
+	int ret;
+
+	ret = object_calc_bounds(w);
+	if (ret < 0)
+		return ret;
+	object_arena_free(w);
+
+	for (first = 0; first < w->num_objects; first += count) {
+		count = object_stream_batch(w, first);
+		ret = object_arena_new(w, first, count);
+		if (ret < 0)
+			return ret;
+
+		object_calc_area(w, first, count);
+		object_stream_detach(w, first, count);
+	}
+
+	return 0;
+}
+
+/**
+ * \param w Wavelet
+ * \param start_scale Starting wavelet scale.
+ * \param end_scale Last wavelet scale.
+ * \param cb Callback called for each measured object.
+ * \param priv Private data passed to cb.
+ * \param with_data Pass the reconstructed object data to cb when non zero.
+ * \return Number of objects found, a negative error or the first negative
+ * value returned by cb.
+ *
+ * Search the wavelet scales for objects like smbrr_wavelet_structure_connect()
+ * but hand each object to cb once it is measured instead of keeping the
+ * reconstructed data of every object. Objects are reconstructed and measured
+ * in batches bounded by OBJECT_STREAM_ELEMS data elements. The data passed to
+ * cb is only valid during the call and is freed once cb returns, objects are
+ * still available afterwards and their data is rebuilt on demand by
+ * smbrr_wavelet_object_get_data().
+ *
+ * Object backgrounds exclude pixels of every other object so all objects are
+ * reconstructed once before the first callback and objects whose data is
+ * requested are reconstructed again.
+ */
+int smbrr_wavelet_structure_connect_stream(struct smbrr_wavelet *w,
+										   unsigned int start_scale,
+										   unsigned int end_scale,
+										   int (*cb)(struct smbrr_wavelet *w,
+													 struct smbrr_object *object,
+													 struct smbrr *data,
+													 void *priv),
+										   void *priv, int with_data)
+{
+	struct object *object;
+	unsigned int first, count, i;
+	int ret;
+
+	if (cb == NULL)
+		return -EINVAL;
+
+	/* make sure we dont check scales after last */
+	if (end_scale > w->num_scales - 1)
+		return 0;
+
+	ret = object_connect(w, start_scale, end_scale);
+	if (ret < 0)
+		return ret;
+
+	/* 1st pass in batches, fills the object map */
+	ret = object_stream_area(w);
+	if (ret < 0)
+		return ret;
+
+	/* 2nd pass in batches, each batch is handed to cb and released */
+	for (first = 0; first < w->num_objects; first += count) {
+		count = object_stream_batch(w, first);
+
+		if (with_data) {
+			ret = object_arena_new(w, first, count);
+			if (ret < 0)
+				return ret;
+
+#pragma omp parallel for schedule(dynamic, 10)
+			for (i = 0; i < count; i++)
+				object_create_data(w, &w->objects[first + i],
+								   &w->object_data[i]);
+		}
+
+		object_calc_background(w, first, count);
+
+		for (i = first; i < first + count; i++) {
+			object = &w->objects[i];
+			object_calc_mag_delta(w, object);
+
+			ret = cb(w, &object->o, object->data, priv);
+			if (ret < 0) {
+				object_stream_detach(w, first, count);
+				return ret;
+			}
+		}
+
+		object_stream_detach(w, first, count);
+	}
+
+	ret = object_catalogue(w);
+	if (ret < 0)
+		return ret;
+
+	return w->num_objects;
+}
+
+/* cheap brightness estimate, peak structure value times its size */
+static inline float object_rank(struct smbrr_wavelet *w, struct object *object)
+{
+	struct structure *structure =
+		w->structure[object->o.scale] + object->structure[object->o.scale];
+
+	return object->o.max_adu * structure->size;
+}
+
+/* sift heap entry i down, the root has the lowest rank */
+static void object_heap_down(const float *rank, unsigned int *heap,
+							 unsigned int size, unsigned int i)
+{
+	unsigned int child, t;
+
+	while ((child = 2 * i + 1) < size) {
+		if (child + 1 < size && rank[heap[child + 1]] < rank[heap[child]])
+			child++;
+		if (rank[heap[child]] >= rank[heap[i]])
+			break;
+
+		t = heap[i];
+		heap[i] = heap[child];
+		heap[child] = t;
+		i = child;
+	}
+}
+
+/*
+ * Flag all but the size objects with the highest rank as pruned, bounds must
+ * be known. The first object is always kept as the magnitude reference.
+ */
+static int object_select_candidates(struct smbrr_wavelet *w, unsigned int size)
+{
+	unsigned int *heap, i;
+	float *rank;
+
+	if (size >= w->num_objects)
+		return 0;
+
+	heap = malloc(size * sizeof(*heap));
+	rank = malloc(w->num_objects * sizeof(*rank));
+	if (heap == NULL || rank == NULL) {
+		free(heap);
+		free(rank);
+		return -ENOMEM;
+	}
+
 	for (i = 0; i < w->num_objects; i++)
-		w->objects_sorted[i] = &w->objects[i];
+		rank[i] = object_rank(w, &w->objects[i]);
 
-	qsort(w->objects_sorted, w->num_objects, sizeof(struct object *),
-		  object_cmp);
+	for (i = 0; i < size; i++)
+		heap[i] = i;
+	for (i = size / 2; i > 0; i--)
+		object_heap_down(rank, heap, size, i - 1);
 
-	/* calculate total adu for each object */
+	/* replace the lowest candidate whenever a higher rank turns up */
+	for (i = size; i < w->num_objects; i++) {
+		if (rank[i] <= rank[heap[0]])
+			continue;
+
+		heap[0] = i;
+		object_heap_down(rank, heap, size, 0);
+	}
+
+	for (i = 1; i < w->num_objects; i++)
+		w->objects[i].pruned = 1;
+	for (i = 0; i < size; i++)
+		w->objects[heap[i]].pruned = 0;
+
+	free(heap);
+	free(rank);
+	return 0;
+}
+
+/*
+ * Reconstruction only maps the peak structure span pixels inside the peak
+ * structure bounds that are labelled with its id on one of the object scales,
+ * so the object map of every object is built from those spans without
+ * reconstructing them.
+ */
+static void object_map_spans(struct smbrr_wavelet *w)
+{
+	struct structure *s;
+	struct structure_span *span;
+	struct object *object;
+	unsigned int i, j, x, x0, x1, pixel, scale, id;
+
+#pragma omp parallel for private(object, s, span, j, x, x0, x1, pixel, scale, \
+									 id) schedule(dynamic, 64)
+	for (i = 0; i < w->num_objects; i++) {
+		object = &w->objects[i];
+		s = w->structure[object->o.scale] + object->structure[object->o.scale];
+		id = s->id + 2;
+
+		for (j = 0; j < s->num_spans; j++) {
+			span = &s->span[j];
+			if (span->y < s->minxY.y || span->y > s->maxxY.y)
+				continue;
+
+			x0 = span->x0 > s->minXy.x ? span->x0 : s->minXy.x;
+			x1 = span->x1 < s->maxXy.x ? span->x1 : s->maxXy.x;
+
+			for (x = x0; x <= x1; x++) {
+				pixel = span->y * w->width + x;
+
+				for (scale = object->start_scale; scale <= object->end_scale;
+					 scale++) {
+					if (w->s[scale]->s[pixel] == id) {
+						object_map_insert(w, object, pixel);
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+/* reconstruct and measure one object, keeping no data */
+static int object_measure(struct smbrr_wavelet *w, struct object *object)
+{
+	struct smbrr *data;
+	unsigned int width, height;
+
+	width = object->o.maxXy.x - object->o.minXy.x + 1;
+	height = object->o.maxxY.y - object->o.minxY.y + 1;
+	data = smbrr_new(w->c[0]->type, width, height, 0, SMBRR_SOURCE_UINT8, NULL);
+	if (data == NULL)
+		return -ENOMEM;
+
+	object_get_area(w, object, data);
+	object_get_position(w, object);
+	object_get_type(w, object);
+
+	object->data = NULL;
+	smbrr_free(data);
+	return 0;
+}
+
+/* measure the objects that are not pruned */
+static int object_calc_candidates(struct smbrr_wavelet *w)
+{
+	unsigned int i;
+	int err = 0, ret;
+
+#pragma omp parallel for private(ret) reduction(min : err)                     \
+	schedule(dynamic, 10)
+	for (i = 0; i < w->num_objects; i++) {
+		if (w->objects[i].pruned)
+			continue;
+
+		ret = object_measure(w, &w->objects[i]);
+		if (ret < err)
+			err = ret;
+	}
+
+	return err;
+}
+
+/*
+ * Backgrounds skip the point sources inside the annulus of each candidate, so
+ * pruned objects whose peak structure falls inside a point source annulus are
+ * measured too for their type. Objects further away are never looked at.
+ */
+static int object_calc_neighbours(struct smbrr_wavelet *w)
+{
+	struct smbrr_coord *box;
+	struct structure *s;
+	struct object *object;
+	unsigned char *near;
+	unsigned int i, j, n = 0;
+	float radius;
+	int err = 0, ret;
+
+	box = malloc(2 * w->num_objects * sizeof(*box));
+	near = calloc(w->num_objects, sizeof(*near));
+	if (box == NULL || near == NULL) {
+		free(box);
+		free(near);
+		return -ENOMEM;
+	}
+
+	/* annulus bounds as used by object_get_annulus_background() */
+	for (i = 0; i < w->num_objects; i++) {
+		object = &w->objects[i];
+		if (object->pruned || object->o.type == SMBRR_OBJECT_EXTENDED)
+			continue;
+
+		radius = sqrtf((float)object->o.object_area / M_PI) * 10.0;
+		box[n].x = (object->o.pos.x > radius) ? object->o.pos.x - radius : 0;
+		box[n].y = (object->o.pos.y > radius) ? object->o.pos.y - radius : 0;
+		box[n + 1].x = object->o.pos.x + radius;
+		box[n + 1].y = object->o.pos.y + radius;
+		n += 2;
+	}
+
+#pragma omp parallel for private(object, s, j) schedule(dynamic, 64)
+	for (i = 0; i < w->num_objects; i++) {
+		object = &w->objects[i];
+		if (!object->pruned)
+			continue;
+
+		s = w->structure[object->o.scale] + object->structure[object->o.scale];
+		for (j = 0; j < n; j += 2) {
+			if (s->maxXy.x >= box[j].x && s->minXy.x <= box[j + 1].x &&
+				s->maxxY.y >= box[j].y && s->minxY.y <= box[j + 1].y) {
+				near[i] = 1;
+				break;
+			}
+		}
+	}
+
+#pragma omp parallel for private(ret) reduction(min : err)                     \
+	schedule(dynamic, 10)
+	for (i = 0; i < w->num_objects; i++) {
+		if (!near[i])
+			continue;
+
+		ret = object_measure(w, &w->objects[i]);
+		if (ret < err)
+			err = ret;
+	}
+
+	free(box);
+	free(near);
+	return err;
+}
+
+/* flag all but the count measured objects with most adu as pruned */
+static unsigned int object_mark_brightest(struct smbrr_wavelet *w,
+										  unsigned int count)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < w->num_objects; i++) {
+		if (!w->objects[i].pruned)
+			w->objects_sorted[n++] = &w->objects[i];
+	}
+	qsort(w->objects_sorted, n, sizeof(struct object *), object_cmp);
+	for (i = count; i < n; i++)
+		w->objects_sorted[i]->pruned = 1;
+
+	return count < n ? count : n;
+}
+
+/* drop the objects flagged by object_mark_brightest(), the map follows */
+static int object_keep_brightest(struct smbrr_wavelet *w, unsigned int count)
+{
+	uint32_t *remap, id;
+	unsigned int i, n = 0, pixel;
+
+	if (count == w->num_objects)
+		return 0;
+
+	remap = malloc(w->num_objects * sizeof(*remap));
+	if (remap == NULL)
+		return -ENOMEM;
+	for (i = 0; i < w->num_objects; i++)
+		remap[i] = w->objects[i].pruned ? 0 : ++n;
+
+	for (pixel = 0; pixel < w->width * w->height; pixel++) {
+		id = object_map_get(w, pixel);
+		if (!id)
+			continue;
+
+		if (w->object_map_size == sizeof(uint16_t))
+			((uint16_t *)w->object_map)[pixel] = remap[id - 1];
+		else
+			((uint32_t *)w->object_map)[pixel] = remap[id - 1];
+	}
+	free(remap);
+
+	return object_remove_pruned(w, w->num_objects - count);
+}
+
+/**
+ * \param w Wavelet
+ * \param start_scale Starting wavelet scale.
+ * \param end_scale Last wavelet scale.
+ * \param count Number of brightest objects to find.
+ * \return Number of objects found, at most count, or a negative error.
+ *
+ * Search the wavelet scales for the count brightest objects only. Objects are
+ * ranked on their peak structure value times its size with a bounded heap and
+ * only twice count candidates plus a margin are reconstructed and measured, so
+ * the cost follows count rather than the number of objects in the field. The
+ * count candidates with most adu are kept, no object data is kept and it is
+ * rebuilt on demand by smbrr_wavelet_object_get_data().
+ *
+ * Backgrounds exclude point sources through an object map built from the peak
+ * structure spans of every object, the same pixels a full connect maps. Only
+ * the other objects inside the background annulus of a candidate are
+ * reconstructed for their type.
+ */
+int smbrr_wavelet_structure_connect_top(struct smbrr_wavelet *w,
+										unsigned int start_scale,
+										unsigned int end_scale,
+										unsigned int count)
+{
+	unsigned int size;
+	int ret;
+
+	if (count == 0)
+		return -EINVAL;
+
+	/* make sure we dont check scales after last */
+	if (end_scale > w->num_scales - 1)
+		return 0;
+
+	ret = object_connect(w, start_scale, end_scale);
+	if (ret < 0)
+		return ret;
+
+	/* bounds and moments give the peak structure and rank of each object */
+	ret = object_calc_bounds(w);
+	if (ret < 0)
+		return ret;
+	object_arena_free(w);
+
+	size = count < w->num_objects ? count : w->num_objects;
+	ret = object_select_candidates(w, 2 * size + OBJECT_TOP_MARGIN);
+	if (ret < 0)
+		return ret;
+
+	object_map_spans(w);
+
+	ret = object_calc_candidates(w);
+	if (ret < 0)
+		return ret;
+
+	/* backgrounds need the type of every object near a candidate */
+	ret = object_calc_neighbours(w);
+	if (ret < 0)
+		return ret;
+
+	count = object_mark_brightest(w, count);
+	object_calc_background(w, 0, w->num_objects);
+
+	/* magnitudes are relative to the first object of the full set */
 	object_calc_data2(w);
 
+	ret = object_keep_brightest(w, count);
+	if (ret < 0)
+		return ret;
+
+	ret = object_catalogue(w);
+	if (ret < 0)
+		return ret;
+
 	return w->num_objects;
 }
 
@@ -1029,56 +2341,134 @@ struct smbrr_object *smbrr_wavelet_object_get(struct smbrr_wavelet *w,
 void smbrr_wavelet_object_free_all(struct smbrr_wavelet *w)
 {
 	struct object *object;
-	struct structure *structure;
-	unsigned int i, j;
+	unsigned int i;
 
+	/* object data is either carved from the arena or allocated on demand */
 	for (i = 0; i < w->num_objects; i++) {
 		object = &w->objects[i];
-		smbrr_free(object->data);
+		if (object->data < w->object_data ||
+			object->data >= w->object_data + w->num_object_data)
+			smbrr_free(object->data);
 	}
+	object_arena_free(w);
+	object_grid_free(w);
 	free(&w->objects[0]);
 	free(&w->objects_sorted[0]);
 
 	for (i = 0; i < w->num_scales - 1; i++) {
-		for (j = 0; j < w->num_structures[i]; j++) {
-			structure = w->structure[i] + j;
-			free(structure->branch);
-		}
 		free(w->structure[i]);
+		free(w->spans[i]);
+		free(w->branches[i]);
 	}
 }
 
+/* allocate and reconstruct the data of an object with known bounds */
+static int object_new_data(struct smbrr_wavelet *w, struct object *object)
+{
+	struct smbrr *data;
+	int width, height;
+
+	width = object->o.maxXy.x - object->o.minXy.x + 1;
+	height = object->o.maxxY.y - object->o.minxY.y + 1;
+
+	data = smbrr_new(w->c[0]->type, width, height, 0, SMBRR_SOURCE_UINT8, NULL);
+	if (data == NULL)
+		return -ENOMEM;
+
+	object_create_data(w, object, data);
+	return 0;
+}
+
+/**
+ * \param w Wavelet.
+ * \param objects Objects to reconstruct or NULL for every object.
+ * \param count Number of objects, ignored when objects is NULL.
+ * \return 0 on success or a negative error.
+ *
+ * Reconstruct the data of several objects at once. Objects that already have
+ * data or are listed twice are only reconstructed once and the rest are
+ * reconstructed in parallel, each from the spans of its structures. Pixels in
+ * the object map go to the object starting at the lowest scale and then to the
+ * first object whatever the thread order, so the map matches a serial pass.
+ */
+int smbrr_wavelet_object_get_data_batch(struct smbrr_wavelet *w,
+										struct smbrr_object **objects,
+										unsigned int count)
+{
+	struct object *object;
+	unsigned int *list, i, n = 0;
+	uint8_t *seen;
+	int err = 0;
+
+	if (objects == NULL)
+		count = w->num_objects;
+
+	list = malloc((count ? count : 1) * sizeof(*list));
+	seen = calloc(w->num_objects ? w->num_objects : 1, sizeof(*seen));
+	if (list == NULL || seen == NULL) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	/* objects still missing data, each listed once */
+	for (i = 0; i < count; i++) {
+		object = objects ? (struct object *)objects[i] : &w->objects[i];
+		if (object < w->objects || object >= w->objects + w->num_objects) {
+			err = -EINVAL;
+			goto out;
+		}
+
+		if (object->data || seen[object - w->objects])
+			continue;
+		seen[object - w->objects] = 1;
+		list[n++] = object - w->objects;
+	}
+
+	if (n == 0)
+		goto out;
+
+	if (w->conv_type != SMBRR_CONV_ATROUS) {
+		err = -EINVAL;
+		goto out;
+	}
+	err = deconv_mask_set_2d(w, w->mask_type);
+	if (err < 0)
+		goto out;
+	smbrr_wavelet_cl_sync(w);
+
+#pragma omp parallel for reduction(min : err) schedule(dynamic, 16)
+	for (i = 0; i < n; i++) {
+		if (object_new_data(w, &w->objects[list[i]]) < 0)
+			err = -ENOMEM;
+	}
+
+out:
+	free(list);
+	free(seen);
+	return err;
+}
+
 /**
  * \param w Wavelet.
  * \param object Object
  * \param data Data
+ * \return 0 on success or a negative error.
  *
- * Free all objects, object datas and structures.
+ * Get the reconstructed data of an object, reconstructing it if needed.
  */
 int smbrr_wavelet_object_get_data(struct smbrr_wavelet *w,
 								  struct smbrr_object *object,
 								  struct smbrr **data)
 {
 	struct object *o = (struct object *)object;
-	int width, height, ret;
-
-	if (o->data) {
-		*data = o->data;
-		return 0;
-	}
-
-	width = object->maxXy.x - object->minXy.x + 1;
-	height = object->maxxY.y - object->minxY.y + 1;
-
-	o->data =
-		smbrr_new(w->c[0]->type, width, height, 0, SMBRR_SOURCE_UINT8, NULL);
-	if (o->data == NULL)
-		return -ENOMEM;
+	int ret;
 
-	ret = smbrr_wavelet_deconvolution_object(w, w->conv_type, w->mask_type,
-											 object);
+	ret = smbrr_wavelet_object_get_data_batch(w, &object, 1);
+	if (ret < 0)
+		return ret;
 
-	return ret;
+	*data = o->data;
+	return 0;
 }
 
 /**
@@ -1092,6 +2482,7 @@ int smbrr_wavelet_object_get_data(struct smbrr_wavelet *w,
 struct smbrr_object *smbrr_wavelet_get_object_at_posn(struct smbrr_wavelet *w,
 													  int x, int y)
 {
+	uint32_t id;
 	int pixel;
 
 	if (x < 0 || y < 0)
@@ -1102,8 +2493,9 @@ struct smbrr_object *smbrr_wavelet_get_object_at_posn(struct smbrr_wavelet *w,
 		return NULL;
 
 	pixel = uy * w->width + ux;
+	id = object_map_get(w, pixel);
 
-	return &w->object_map[pixel]->o;
+	return id ? &w->objects[id - 1].o : NULL;
 }
 
 /**
@@ -1116,13 +2508,17 @@ struct smbrr_object *smbrr_wavelet_get_object_at_posn(struct smbrr_wavelet *w,
 struct smbrr_object *smbrr_wavelet_get_object_at_offset(struct smbrr_wavelet *w,
 														int offset)
 {
+	uint32_t id;
+
 	if (offset < 0)
 		return NULL;
 	unsigned int uoffset = offset;
 	if (uoffset >= w->width * w->height)
 		return NULL;
 
-	return &w->object_map[uoffset]->o;
+	id = object_map_get(w, uoffset);
+
+	return id ? &w->objects[id - 1].o : NULL;
 }
 
 unsigned int smbrr_wavelet_get_num_structures(struct smbrr_wavelet *w,
@@ -22,74 +22,23 @@
 #include <string.h>
 
 #include "config.h"
+#include "histogram.h"
 #include "local.h"
 #include "ops.h"
 #include "sombrero.h"
 
-static const struct data_ops *get_1d_ops(void)
-{
-#ifdef HAVE_OPENCL
-	if (g_cl_ctx)
-		return &data_ops_1d_opencl;
-#endif
-	unsigned int cpu_flags = cpu_get_flags();
-
-#if defined HAVE_AVX512
-	if (cpu_flags & CPU_X86_AVX512)
-		return &data_ops_1d_avx512;
-#endif
-#if defined HAVE_FMA
-	if (cpu_flags & CPU_X86_FMA)
-		return &data_ops_1d_fma;
-#endif
-#if defined HAVE_AVX2
-	if (cpu_flags & CPU_X86_AVX2)
-		return &data_ops_1d_avx2;
-#endif
-#if defined HAVE_AVX
-	if (cpu_flags & CPU_X86_AVX)
-		return &data_ops_1d_avx;
-#endif
-#if defined HAVE_SSE42
-	if (cpu_flags & CPU_X86_SSE4_2)
-		return &data_ops_1d_sse42;
-#endif
-
-	/* default C implementation */
-	return &data_ops_1d;
-}
-
-static const struct data_ops *get_2d_ops(void)
+/*
+ * Zero new data using the same static OpenMP partition as the data_ops
+ * kernels. Pages are placed on the NUMA node of the thread that first touches
+ * them, so each thread later works on node local memory.
+ */
+static void data_first_touch(float *adu, unsigned int elems)
 {
-#ifdef HAVE_OPENCL
-	if (g_cl_ctx)
-		return &data_ops_2d_opencl;
-#endif
-	unsigned int cpu_flags = cpu_get_flags();
-
-#if defined HAVE_AVX512
-	if (cpu_flags & CPU_X86_AVX512)
-		return &data_ops_2d_avx512;
-#endif
-#if defined HAVE_FMA
-	if (cpu_flags & CPU_X86_FMA)
-		return &data_ops_2d_fma;
-#endif
-#if defined HAVE_AVX2
-	if (cpu_flags & CPU_X86_AVX2)
-		return &data_ops_2d_avx2;
-#endif
-#if defined HAVE_AVX
-	if (cpu_flags & CPU_X86_AVX)
-		return &data_ops_2d_avx;
-#endif
-#if defined HAVE_SSE42
-	if (cpu_flags & CPU_X86_SSE4_2)
-		return &data_ops_2d_sse42;
-#endif
+	int i;
 
-	/* default C implementation */
-	return &data_ops_2d;
+#pragma omp parallel for if (elems >= SMBRR_OMP_MIN_ELEMS) schedule(static)
+	for (i = 0; i < elems; i++)
+		adu[i] = 0.0f;
 }
 
 /*
@@ -120,28 +69,28 @@ struct smbrr *smbrr_new(enum smbrr_data_type type, unsigned int width,
 	case SMBRR_DATA_1D_UINT32:
 		bytes = sizeof(uint32_t);
 		size = width * bytes;
-		ops = get_1d_ops();
+		ops = backend_get_1d_ops();
 		elems = width;
 		height_ = 1;
 		break;
 	case SMBRR_DATA_2D_UINT32:
 		bytes = sizeof(uint32_t);
 		size = width * height * bytes;
-		ops = get_2d_ops();
+		ops = backend_get_2d_ops();
 		elems = width * height;
 		height_ = height;
 		break;
 	case SMBRR_DATA_1D_FLOAT:
 		bytes = sizeof(float);
 		size = width * bytes;
-		ops = get_1d_ops();
+		ops = backend_get_1d_ops();
 		elems = width;
 		height_ = 1;
 		break;
 	case SMBRR_DATA_2D_FLOAT:
 		bytes = sizeof(float);
 		size = width * height * bytes;
-		ops = get_2d_ops();
+		ops = backend_get_2d_ops();
 		elems = width * height;
 		height_ = height;
 		break;
@@ -158,7 +107,7 @@ struct smbrr *smbrr_new(enum smbrr_data_type type, unsigned int width,
 		free(s);
 		return NULL;
 	}
-	bzero(s->adu, size);
+	data_first_touch(s->adu, size / bytes);
 
 	s->type = type;
 	s->ops = ops;
@@ -255,6 +204,60 @@ struct smbrr *smbrr_new(enum smbrr_data_type type, unsigned int width,
 	return s;
 }
 
+/*
+ * \param type New data type, 1D or 2D float
+ * \param width element context width in pixels
+ * \param height element context height in pixels
+ * \param stride element context stride in pixels. width += %4
+ * \param adu Source data ADU type
+ * \param src_data source data raw data
+ * \param gain CCD amplifier gain in photo-electrons per ADU
+ * \param bias Image bias in ADUs
+ * \param readout Readout noise in RMS electrons.
+ * \return Pointer to new data or NULL on failure
+ *
+ * Create a new smbrr data from source raw data with Anscombe variance
+ * stabilisation applied during conversion. This is equivalent to smbrr_new()
+ * followed by smbrr_anscombe() but makes a single pass over the data.
+ */
+struct smbrr *smbrr_new_anscombe(enum smbrr_data_type type, unsigned int width,
+								 unsigned int height, unsigned int stride,
+								 enum smbrr_source_type adu,
+								 const void *src_data, float gain, float bias,
+								 float readout)
+{
+	struct smbrr *s;
+
+	if (src_data == NULL || gain <= 0.0f)
+		return NULL;
+
+	switch (type) {
+	case SMBRR_DATA_1D_FLOAT:
+	case SMBRR_DATA_2D_FLOAT:
+		break;
+	default:
+		return NULL;
+	}
+
+	s = smbrr_new(type, width, height, stride, adu, NULL);
+	if (s == NULL)
+		return NULL;
+
+	if (s->ops->anscombe_convert(s, adu, src_data, gain, bias, readout) < 0) {
+		smbrr_free(s);
+		return NULL;
+	}
+
+#ifdef HAVE_OPENCL
+	if (g_cl_ctx) {
+		clEnqueueWriteBuffer(g_cl_ctx->command_queue, s->cl_adu, CL_TRUE, 0,
+							 s->elems * sizeof(float), s->adu, 0, NULL, NULL);
+	}
+#endif
+
+	return s;
+}
+
 /**
  * \param src Source data
  * \param x_start X pixel offset for region start
@@ -264,7 +267,8 @@ struct smbrr *smbrr_new(enum smbrr_data_type type, unsigned int width,
  * \return Pointer to new data or NULL on failure
  *
  * Create a new 2D smbrr data from a smaller source data region. This is useful
- * for faster 2D processing and reconstructing smaller regions of interest.
+ * for faster 2D processing and reconstructing smaller regions of interest. The
+ * region must lie within the source data.
  */
 struct smbrr *smbrr_new_from_area(struct smbrr *src, unsigned int x_start,
 								  unsigned int y_start, unsigned int x_end,
@@ -279,6 +283,8 @@ struct smbrr *smbrr_new_from_area(struct smbrr *src, unsigned int x_start,
 
 	if (width <= 0 || height <= 0)
 		return NULL;
+	if (x_end > src->width || y_end > src->height)
+		return NULL;
 
 	switch (src->type) {
 	case SMBRR_DATA_2D_UINT32:
@@ -298,13 +304,13 @@ struct smbrr *smbrr_new_from_area(struct smbrr *src, unsigned int x_start,
 	/* make ADU memory aligned on 32 bytes for SIMD */
 	size = width * height * bytes;
 	err = posix_memalign((void **)&s->adu, 32, size);
-	if (err < 0) {
+	if (err) {
 		free(s);
 		return NULL;
 	}
-	bzero(s->adu, size);
+	data_first_touch(s->adu, size / bytes);
 
-	s->ops = get_2d_ops();
+	s->ops = backend_get_2d_ops();
 	s->elems = width * height;
 	s->width = width;
 	s->height = height;
@@ -331,8 +337,9 @@ struct smbrr *smbrr_new_from_area(struct smbrr *src, unsigned int x_start,
 
 	/* copy each row from src data to new data */
 	for (i = y_start; i < y_end; i++) {
-		unsigned int offset = i * s->width + x_start;
-		memcpy(s->adu + i * width, src->adu + offset, width * sizeof(float));
+		unsigned int offset = i * src->width + x_start;
+		memcpy(s->adu + (i - y_start) * width, src->adu + offset,
+			   width * sizeof(float));
 	}
 
 	return s;
@@ -381,9 +388,9 @@ struct smbrr *smbrr_new_from_section(struct smbrr *src, unsigned int start,
 		free(s);
 		return NULL;
 	}
-	bzero(s->adu, size);
+	data_first_touch(s->adu, size / bytes);
 
-	s->ops = get_1d_ops();
+	s->ops = backend_get_1d_ops();
 	s->elems = width;
 	s->width = width;
 	s->height = 1;
@@ -480,6 +487,68 @@ int smbrr_get_data(struct smbrr *s, enum smbrr_source_type adu, void **buf)
 	return s->ops->get(s, adu, buf);
 }
 
+/*
+ * \param s element context
+ * \param adu output ADU type, either UINT8 or UINT16
+ * \param stretch intensity stretch
+ * \param clip_low lower clipping percentile
+ * \param clip_high upper clipping percentile
+ * \param range maximum output value or 0 for full ADU range
+ * \param buf Pointer to output buffer.
+ * \return 0 on success.
+ *
+ * Export data pixels to buf as 8 or 16 bit display data. The data is clipped
+ * between the percentiles, stretched and scaled to range in a single pass
+ * without modifying or copying the element context. Percentiles are found
+ * from a histogram of the data and are only calculated when clipping inside
+ * the data limits.
+ */
+int smbrr_export(struct smbrr *s, enum smbrr_source_type adu,
+				 enum smbrr_stretch stretch, float clip_low, float clip_high,
+				 float range, void *buf)
+{
+	struct histogram h;
+	float min, max, low, high;
+	int ret;
+
+	if (s->type != SMBRR_DATA_1D_FLOAT && s->type != SMBRR_DATA_2D_FLOAT)
+		return -EINVAL;
+	if (clip_low < 0.0f || clip_high > 100.0f || clip_low >= clip_high)
+		return -EINVAL;
+
+	switch (adu) {
+	case SMBRR_SOURCE_UINT8:
+		if (range <= 0.0f || range > 255.0f)
+			range = 255.0f;
+		break;
+	case SMBRR_SOURCE_UINT16:
+		if (range <= 0.0f || range > 65535.0f)
+			range = 65535.0f;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	smbrr_cl_sync(s);
+	s->ops->find_limits(s, &min, &max);
+
+	if (clip_low > 0.0f || clip_high < 100.0f) {
+		ret = histogram_init(&h, HISTOGRAM_BINS, min, max);
+		if (ret < 0)
+			return ret;
+
+		histogram_add(&h, s->adu, s->elems);
+		low = histogram_get_percentile(&h, clip_low);
+		high = histogram_get_percentile(&h, clip_high);
+		histogram_free(&h);
+	} else {
+		low = min;
+		high = max;
+	}
+
+	return s->ops->quantise(s, adu, stretch, low, high, range, buf);
+}
+
 void smbrr_cl_sync(struct smbrr *s)
 {
 #ifdef HAVE_OPENCL
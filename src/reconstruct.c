@@ -110,6 +110,7 @@ int smbrr_reconstruct(struct smbrr *O,
 {
 	struct smbrr *R , *O0, *O1;
 	struct smbrr_wavelet *wr0, *wr1;
+	struct smbrr_expr *e;
 	float alpha, thresh, thresh_delta, thresh_old = 1.0e6;
 	int ret = -ENOMEM, tries = 10;
 
@@ -128,6 +129,10 @@ int smbrr_reconstruct(struct smbrr *O,
 	if (wr1 == NULL)
 		goto err_wr1;
 
+	e = smbrr_expr_new();
+	if (e == NULL)
+		goto err_expr;
+
 	smbrr_wavelet_convolution(wr1, SMBRR_CONV_ATROUS, mask);
 	smbrr_wavelet_new_significant(wr1, sigma_clip);
 
@@ -152,13 +157,17 @@ int smbrr_reconstruct(struct smbrr *O,
 
 		/* step 3 - calculate new data O - add correction to O */
 		/* O(n+1) = O(n) + alpha * R after which O is O(n+1) */
-		smbrr_mult_add(O1, O0, R, alpha);
-
 		/* step 4 - Set all pixels in O(n+1) < 0 to = 0 */
-		smbrr_zero_negative(O1);
+		/* steps 3 to 5 are fused into a single pass over O0, R and O1 */
+		smbrr_expr_reset(e);
+		smbrr_expr_load(e, O0);
+		smbrr_expr_mult_add(e, R, alpha);
+		smbrr_expr_zero_negative(e);
+		smbrr_expr_store(e, O1);
+		smbrr_expr_store(e, O0);
+		smbrr_expr_eval(e);
 
 		/* step 5 - wr 1 is residual, O1 is image */
-		smbrr_copy(O0, O1);
 		smbrr_wavelet_convolution(wr1, SMBRR_CONV_ATROUS, mask);
 		smbrr_wavelet_new_significant(wr1, sigma_clip);
 	}
@@ -166,6 +175,8 @@ int smbrr_reconstruct(struct smbrr *O,
 	smbrr_copy(O, O1);
 	ret = 0;
 
+	smbrr_expr_free(e);
+err_expr:
 	smbrr_wavelet_free(wr1);
 err_wr1:
 	smbrr_wavelet_free(wr0);
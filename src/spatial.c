@@ -0,0 +1,411 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Copyright (C) 2026 Liam Girdwood
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "local.h"
+#include "sombrero.h"
+
+/* grid cells are sized for a couple of objects each */
+#define GRID_OBJECTS_PER_CELL 2
+#define GRID_MIN_CELL_SIZE 8
+
+/* positions before a catalogue match is split across threads */
+#define GRID_MATCH_OMP_MIN 1024
+
+static inline unsigned int grid_cell(const struct object_grid *g,
+									 const struct smbrr_coord *pos)
+{
+	return (pos->y / g->cell_size) * g->nx + pos->x / g->cell_size;
+}
+
+/* cells [c0, c1] covering coordinates [lo, hi] or 0 if none */
+static int grid_range(const struct object_grid *g, float lo, float hi,
+					  unsigned int n, int *c0, int *c1)
+{
+	float size = g->cell_size;
+
+	if (hi < 0.0f || lo >= n * size || lo > hi)
+		return 0;
+
+	*c0 = lo > 0.0f ? (int)(lo / size) : 0;
+	*c1 = hi < n * size ? (int)(hi / size) : (int)n - 1;
+	return 1;
+}
+
+/**
+ * \param g Object grid
+ * \param x X coordinate
+ * \param y Y coordinate
+ * \param radius Radius in pixels
+ * \return 1 if cells [cx0, cx1] x [cy0, cy1] cover the circle, 0 if no cell
+ * does.
+ */
+int object_grid_range(const struct object_grid *g, float x, float y,
+					  float radius, int *cx0, int *cy0, int *cx1, int *cy1)
+{
+	return grid_range(g, x - radius, x + radius, g->nx, cx0, cx1) &&
+		   grid_range(g, y - radius, y + radius, g->ny, cy0, cy1);
+}
+
+static inline float grid_dist2(const struct smbrr_object *o, float x, float y)
+{
+	float dx = o->pos.x - x, dy = o->pos.y - y;
+
+	return dx * dx + dy * dy;
+}
+
+/**
+ * \param w Wavelet
+ * \return 0 on success or -ENOMEM.
+ *
+ * Index object positions on a uniform grid. Objects are bucketed by a
+ * counting sort so each cell holds its objects contiguously in index order.
+ */
+int object_grid_build(struct smbrr_wavelet *w)
+{
+	struct object_grid *g = &w->grid;
+	unsigned int i, c, cells, size;
+
+	object_grid_free(w);
+	if (w->num_objects == 0)
+		return 0;
+
+	size = ceil(sqrt(GRID_OBJECTS_PER_CELL * (double)w->width * w->height /
+					 w->num_objects));
+	g->cell_size = size < GRID_MIN_CELL_SIZE ? GRID_MIN_CELL_SIZE : size;
+	g->nx = (w->width + g->cell_size - 1) / g->cell_size;
+	g->ny = (w->height + g->cell_size - 1) / g->cell_size;
+	cells = g->nx * g->ny;
+
+	g->cell = calloc(cells + 1, sizeof(*g->cell));
+	g->object = malloc(w->num_objects * sizeof(*g->object));
+	if (g->cell == NULL || g->object == NULL) {
+		object_grid_free(w);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < w->num_objects; i++)
+		g->cell[grid_cell(g, &w->objects[i].o.pos)]++;
+
+	/* cell ends, then filled backwards so each cell ends at its start */
+	for (c = 1; c < cells; c++)
+		g->cell[c] += g->cell[c - 1];
+
+	for (i = w->num_objects; i > 0; i--) {
+		c = grid_cell(g, &w->objects[i - 1].o.pos);
+		g->object[--g->cell[c]] = i - 1;
+	}
+	g->cell[cells] = w->num_objects;
+
+	return 0;
+}
+
+void object_grid_free(struct smbrr_wavelet *w)
+{
+	free(w->grid.cell);
+	free(w->grid.object);
+	memset(&w->grid, 0, sizeof(w->grid));
+}
+
+/* insert object into the k nearest sorted by distance, return count */
+static unsigned int grid_nearest_insert(struct smbrr_object **objects,
+										float *dist, unsigned int found,
+										unsigned int k,
+										struct smbrr_object *o, float d)
+{
+	unsigned int i;
+
+	if (found == k) {
+		if (d >= dist[k - 1])
+			return found;
+		found--;
+	}
+
+	for (i = found; i > 0 && dist[i - 1] > d; i--) {
+		dist[i] = dist[i - 1];
+		objects[i] = objects[i - 1];
+	}
+	dist[i] = d;
+	objects[i] = o;
+
+	return found + 1;
+}
+
+/* distance from (x,y) to the nearest grid cell outside the ring box */
+static float grid_ring_dist(const struct object_grid *g, float x, float y,
+							int cx0, int cy0, int cx1, int cy1)
+{
+	float d = INFINITY, size = g->cell_size;
+
+	if (cx0 > 0)
+		d = fminf(d, x - cx0 * size);
+	if (cy0 > 0)
+		d = fminf(d, y - cy0 * size);
+	if (cx1 < (int)g->nx - 1)
+		d = fminf(d, (cx1 + 1) * size - x);
+	if (cy1 < (int)g->ny - 1)
+		d = fminf(d, (cy1 + 1) * size - y);
+
+	return d > 0.0f ? d : 0.0f;
+}
+
+/* nearest object within radius of (x,y) or NULL */
+static struct smbrr_object *grid_match(struct smbrr_wavelet *w, float x,
+									   float y, float radius)
+{
+	const struct object_grid *g = &w->grid;
+	struct smbrr_object *o, *best = NULL;
+	float d, best_dist = radius * radius;
+	int cx, cy, cx0, cx1, cy0, cy1;
+	unsigned int i;
+
+	if (!object_grid_range(g, x, y, radius, &cx0, &cy0, &cx1, &cy1))
+		return NULL;
+
+	for (cy = cy0; cy <= cy1; cy++) {
+		for (cx = cx0; cx <= cx1; cx++) {
+			unsigned int c = cy * g->nx + cx;
+
+			for (i = g->cell[c]; i < g->cell[c + 1]; i++) {
+				o = &w->objects[g->object[i]].o;
+				d = grid_dist2(o, x, y);
+				if (d < best_dist || (d == best_dist && best == NULL)) {
+					best_dist = d;
+					best = o;
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+/**
+ * \param w Wavelet
+ * \param x0 Minimum X coordinate
+ * \param y0 Minimum Y coordinate
+ * \param x1 Maximum X coordinate
+ * \param y1 Maximum Y coordinate
+ * \param objects Array to store matching objects or NULL.
+ * \param size Number of entries in objects.
+ * \return Number of objects in the box.
+ *
+ * Find objects whose position lies within the inclusive box (x0,y0)-(x1,y1).
+ * At most size objects are stored, the return value may be larger.
+ */
+int smbrr_wavelet_object_find_box(struct smbrr_wavelet *w, int x0, int y0,
+								  int x1, int y1,
+								  struct smbrr_object **objects,
+								  unsigned int size)
+{
+	const struct object_grid *g = &w->grid;
+	struct smbrr_object *o;
+	int cx, cy, cx0, cx1, cy0, cy1, count = 0;
+	unsigned int i;
+
+	if (g->cell == NULL)
+		return 0;
+
+	if (!grid_range(g, x0, x1, g->nx, &cx0, &cx1) ||
+		!grid_range(g, y0, y1, g->ny, &cy0, &cy1))
+		return 0;
+
+	for (cy = cy0; cy <= cy1; cy++) {
+		for (cx = cx0; cx <= cx1; cx++) {
+			unsigned int c = cy * g->nx + cx;
+
+			for (i = g->cell[c]; i < g->cell[c + 1]; i++) {
+				o = &w->objects[g->object[i]].o;
+				if ((int)o->pos.x < x0 || (int)o->pos.x > x1 ||
+					(int)o->pos.y < y0 || (int)o->pos.y > y1)
+					continue;
+				if (objects && count < size)
+					objects[count] = o;
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * \param w Wavelet
+ * \param x X coordinate
+ * \param y Y coordinate
+ * \param radius Search radius in pixels.
+ * \param objects Array to store matching objects or NULL.
+ * \param size Number of entries in objects.
+ * \return Number of objects within radius or -EINVAL for a negative radius.
+ *
+ * Find objects whose position lies within radius of (x,y). At most size
+ * objects are stored, the return value may be larger.
+ */
+int smbrr_wavelet_object_find_radius(struct smbrr_wavelet *w, float x, float y,
+									 float radius,
+									 struct smbrr_object **objects,
+									 unsigned int size)
+{
+	const struct object_grid *g = &w->grid;
+	struct smbrr_object *o;
+	float r2 = radius * radius;
+	int cx, cy, cx0, cx1, cy0, cy1, count = 0;
+	unsigned int i;
+
+	if (radius < 0.0f)
+		return -EINVAL;
+	if (g->cell == NULL)
+		return 0;
+
+	if (!object_grid_range(g, x, y, radius, &cx0, &cy0, &cx1, &cy1))
+		return 0;
+
+	for (cy = cy0; cy <= cy1; cy++) {
+		for (cx = cx0; cx <= cx1; cx++) {
+			unsigned int c = cy * g->nx + cx;
+
+			for (i = g->cell[c]; i < g->cell[c + 1]; i++) {
+				o = &w->objects[g->object[i]].o;
+				if (grid_dist2(o, x, y) > r2)
+					continue;
+				if (objects && count < size)
+					objects[count] = o;
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * \param w Wavelet
+ * \param x X coordinate
+ * \param y Y coordinate
+ * \param k Number of objects to find.
+ * \param objects Array of k entries to store objects.
+ * \return Number of objects found, less than k only when there are fewer
+ * objects, or -ENOMEM.
+ *
+ * Find the k objects nearest to (x,y), stored in ascending order of
+ * distance. Grid cells are searched in rings around (x,y) until no unvisited
+ * cell can hold a nearer object.
+ */
+int smbrr_wavelet_object_find_nearest(struct smbrr_wavelet *w, float x,
+									  float y, unsigned int k,
+									  struct smbrr_object **objects)
+{
+	const struct object_grid *g = &w->grid;
+	struct smbrr_object *o;
+	unsigned int i, found = 0;
+	int r, cx, cy, qx, qy, cx0, cx1, cy0, cy1;
+	float *dist, d;
+
+	if (k == 0 || g->cell == NULL)
+		return 0;
+
+	dist = malloc(k * sizeof(*dist));
+	if (dist == NULL)
+		return -ENOMEM;
+
+	qx = x > 0.0f ? (int)(x / g->cell_size) : 0;
+	qy = y > 0.0f ? (int)(y / g->cell_size) : 0;
+	qx = qx < (int)g->nx ? qx : (int)g->nx - 1;
+	qy = qy < (int)g->ny ? qy : (int)g->ny - 1;
+
+	for (r = 0;; r++) {
+		cx0 = qx - r;
+		cx1 = qx + r;
+		cy0 = qy - r;
+		cy1 = qy + r;
+
+		/* visit cells on the border of the ring */
+		for (cy = cy0 > 0 ? cy0 : 0; cy <= cy1 && cy < (int)g->ny; cy++) {
+			for (cx = cx0 > 0 ? cx0 : 0; cx <= cx1 && cx < (int)g->nx; cx++) {
+				unsigned int c = cy * g->nx + cx;
+
+				if (cy != cy0 && cy != cy1 && cx != cx0 && cx != cx1)
+					continue;
+
+				for (i = g->cell[c]; i < g->cell[c + 1]; i++) {
+					o = &w->objects[g->object[i]].o;
+					found = grid_nearest_insert(objects, dist, found, k, o,
+												grid_dist2(o, x, y));
+				}
+			}
+		}
+
+		/* ring covers the whole grid */
+		if (cx0 <= 0 && cy0 <= 0 && cx1 >= (int)g->nx - 1 &&
+			cy1 >= (int)g->ny - 1)
+			break;
+
+		/* no unvisited cell can be nearer than the k-th object */
+		if (found == k) {
+			d = grid_ring_dist(g, x, y, cx0, cy0, cx1, cy1);
+			if (dist[k - 1] <= d * d)
+				break;
+		}
+	}
+
+	free(dist);
+	return found;
+}
+
+/**
+ * \param w Wavelet
+ * \param x X coordinates of external catalogue.
+ * \param y Y coordinates of external catalogue.
+ * \param count Number of catalogue positions.
+ * \param radius Match radius in pixels.
+ * \param match Array of count entries to store the nearest object to each
+ * position or NULL when there is no object within radius.
+ * \return Number of matched positions or -EINVAL for invalid arguments.
+ *
+ * Cross match an external catalogue against the detected objects. Positions
+ * are matched independently so an object can match several positions.
+ */
+int smbrr_wavelet_object_match(struct smbrr_wavelet *w, const float *x,
+							   const float *y, unsigned int count,
+							   float radius, struct smbrr_object **match)
+{
+	int i, matched = 0;
+
+	if (x == NULL || y == NULL || match == NULL || radius < 0.0f)
+		return -EINVAL;
+
+	if (w->grid.cell == NULL) {
+		memset(match, 0, count * sizeof(*match));
+		return 0;
+	}
+
+#pragma omp parallel for reduction(+ : matched)                                \
+	if (count >= GRID_MATCH_OMP_MIN) schedule(static)
+	for (i = 0; i < count; i++) {
+		match[i] = grid_match(w, x[i], y[i], radius);
+		if (match[i])
+			matched++;
+	}
+
+	return matched;
+}
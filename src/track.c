@@ -0,0 +1,486 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Copyright (C) 2026 Liam Girdwood
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "local.h"
+#include "sombrero.h"
+
+/* default weight of a flux change against distance and missed frames */
+#define TRACK_FLUX_WEIGHT 0.5f
+#define TRACK_MAX_MISSED 5
+
+/* smoothing gain of the velocity and flux estimates */
+#define TRACK_GAIN 0.5f
+
+/* tracks before matching is split across threads */
+#define TRACK_OMP_MIN 1024
+
+#define TRACK_NO_CLAIM UINT64_MAX
+
+static int tracker_grow(struct smbrr_tracker *t, unsigned int tracks)
+{
+	struct smbrr_track *track;
+	int *candidate;
+	unsigned int size;
+
+	if (tracks <= t->max_tracks)
+		return 0;
+
+	size = t->max_tracks ? t->max_tracks : 64;
+	while (size < tracks)
+		size *= 2;
+
+	track = realloc(t->track, size * sizeof(*track));
+	if (track == NULL)
+		return -ENOMEM;
+	t->track = track;
+
+	candidate = realloc(t->candidate, size * sizeof(*candidate));
+	if (candidate == NULL)
+		return -ENOMEM;
+	t->candidate = candidate;
+
+	t->max_tracks = size;
+	return 0;
+}
+
+static int tracker_claim_new(struct smbrr_tracker *t, unsigned int objects)
+{
+	uint64_t *claim;
+
+	if (objects == 0)
+		return 0;
+
+	if (objects > t->max_objects) {
+		claim = realloc(t->claim, 2 * objects * sizeof(*claim));
+		if (claim == NULL)
+			return -ENOMEM;
+		t->claim = claim;
+		t->max_objects = objects;
+	}
+
+	memset(t->claim, 0xff, 2 * objects * sizeof(*t->claim));
+	return 0;
+}
+
+/*
+ * Scores are non negative so their float bits order like the scores. The
+ * track index in the low word makes the lowest track win equal scores.
+ */
+static void track_claim(uint64_t *claim, float score, unsigned int track)
+{
+	uint32_t bits;
+	uint64_t v, cur;
+
+	memcpy(&bits, &score, sizeof(bits));
+	v = (uint64_t)bits << 32 | track;
+
+	cur = __atomic_load_n(claim, __ATOMIC_RELAXED);
+	while (v < cur) {
+		if (__atomic_compare_exchange_n(claim, &cur, v, 1, __ATOMIC_RELAXED,
+										__ATOMIC_RELAXED))
+			break;
+	}
+}
+
+static inline int track_claimed(const uint64_t *claim, unsigned int track)
+{
+	return *claim != TRACK_NO_CLAIM && (uint32_t)*claim == track;
+}
+
+/*
+ * Best object for a track around its predicted position (px,py) in wavelet
+ * coordinates, skipping objects already taken. Lower scores are better, the
+ * score is the squared distance in radii plus the weighted squared log flux
+ * ratio.
+ */
+static int track_best(struct smbrr_tracker *t, struct smbrr_wavelet *w,
+					  const struct smbrr_track *track, float px, float py,
+					  const uint64_t *taken, float *score)
+{
+	const struct object_grid *g = &w->grid;
+	const struct smbrr_object *o;
+	float r2 = t->radius * t->radius, dx, dy, d, l, best_score = INFINITY;
+	int cx, cy, cx0, cx1, cy0, cy1, best = -1;
+	unsigned int i, c, id;
+
+	if (g->cell == NULL ||
+		!object_grid_range(g, px, py, t->radius, &cx0, &cy0, &cx1, &cy1))
+		return -1;
+
+	for (cy = cy0; cy <= cy1; cy++) {
+		for (cx = cx0; cx <= cx1; cx++) {
+			c = cy * g->nx + cx;
+
+			for (i = g->cell[c]; i < g->cell[c + 1]; i++) {
+				id = g->object[i];
+				if (taken && taken[id] != TRACK_NO_CLAIM)
+					continue;
+
+				o = &w->objects[id].o;
+				dx = o->pos.x - px;
+				dy = o->pos.y - py;
+				d = dx * dx + dy * dy;
+				if (d > r2)
+					continue;
+
+				d /= r2;
+				if (t->flux_weight > 0.0f && track->flux > 0.0f &&
+					o->object_adu > 0.0f) {
+					l = logf(o->object_adu / track->flux);
+					d += t->flux_weight * l * l;
+				}
+
+				if (d < best_score || (d == best_score && (int)id < best)) {
+					best_score = d;
+					best = id;
+				}
+			}
+		}
+	}
+
+	*score = best_score;
+	return best;
+}
+
+/* track is predicted inside the detected area */
+static inline int track_in_area(const struct smbrr_track *track,
+								struct smbrr_wavelet *w, int x_start,
+								int y_start)
+{
+	float px = track->x + track->vx - x_start;
+	float py = track->y + track->vy - y_start;
+
+	return px >= 0.0f && py >= 0.0f && px < w->width && py < w->height;
+}
+
+/*
+ * Match tracks to objects in two passes. Each track proposes its best object
+ * and each object keeps its best proposal, then tracks that lost propose
+ * their best object nobody claimed in the first pass. Both passes only visit
+ * grid cells around each track so matching is linear in the track count.
+ */
+static void tracker_match(struct smbrr_tracker *t, struct smbrr_wavelet *w,
+						  int x_start, int y_start)
+{
+	uint64_t *claim = t->claim, *claim2 = t->claim + w->num_objects;
+	struct smbrr_track *track;
+	float px, py, score;
+	int i, c;
+
+#pragma omp parallel for private(track, px, py, score, c)                      \
+	if (t->num_tracks >= TRACK_OMP_MIN) schedule(dynamic, 64)
+	for (i = 0; i < t->num_tracks; i++) {
+		track = &t->track[i];
+		t->candidate[i] = -1;
+		if (!track_in_area(track, w, x_start, y_start))
+			continue;
+
+		px = track->x + track->vx - x_start;
+		py = track->y + track->vy - y_start;
+		c = track_best(t, w, track, px, py, NULL, &score);
+		if (c >= 0)
+			track_claim(&claim[c], score, i);
+		t->candidate[i] = c;
+	}
+
+#pragma omp parallel for private(track, px, py, score, c)                      \
+	if (t->num_tracks >= TRACK_OMP_MIN) schedule(dynamic, 64)
+	for (i = 0; i < t->num_tracks; i++) {
+		c = t->candidate[i];
+		if (c < 0 || track_claimed(&claim[c], i))
+			continue;
+
+		track = &t->track[i];
+		px = track->x + track->vx - x_start;
+		py = track->y + track->vy - y_start;
+		c = track_best(t, w, track, px, py, claim, &score);
+		if (c >= 0)
+			track_claim(&claim2[c], score, i);
+		t->candidate[i] = c;
+	}
+
+	for (i = 0; i < t->num_tracks; i++) {
+		c = t->candidate[i];
+		if (c >= 0 && !track_claimed(&claim[c], i) &&
+			!track_claimed(&claim2[c], i))
+			t->candidate[i] = -1;
+	}
+}
+
+static int tracker_update(struct smbrr_tracker *t, struct smbrr_wavelet *w,
+						  int x_start, int y_start)
+{
+	struct smbrr_track *track;
+	struct smbrr_object *o;
+	unsigned int i, j, id;
+	float x, y;
+	int c, err;
+
+	err = tracker_claim_new(t, w->num_objects);
+	if (err < 0)
+		return err;
+
+	tracker_match(t, w, x_start, y_start);
+
+	/* matched objects are marked in the second claim array */
+	if (w->num_objects)
+		memset(t->claim + w->num_objects, 0xff,
+			   w->num_objects * sizeof(*t->claim));
+
+	for (i = 0, j = 0; i < t->num_tracks; i++) {
+		track = &t->track[i];
+		c = t->candidate[i];
+
+		if (c >= 0) {
+			o = &w->objects[c].o;
+			x = o->pos.x + x_start;
+			y = o->pos.y + y_start;
+			track->vx += TRACK_GAIN * (x - track->x - track->vx);
+			track->vy += TRACK_GAIN * (y - track->y - track->vy);
+			track->x = x;
+			track->y = y;
+			track->flux += TRACK_GAIN * (o->object_adu - track->flux);
+			track->missed = 0;
+			track->object = o;
+			t->claim[w->num_objects + c] = i;
+		} else {
+			/* coast on the predicted position */
+			if (track_in_area(track, w, x_start, y_start))
+				track->missed++;
+			track->x += track->vx;
+			track->y += track->vy;
+			track->object = NULL;
+		}
+		track->age++;
+
+		if (track->missed <= t->max_missed)
+			t->track[j++] = *track;
+	}
+	t->num_tracks = j;
+
+	/* unmatched objects start new tracks, brightest first */
+	for (i = 0; i < w->num_objects; i++) {
+		o = smbrr_wavelet_object_get(w, i);
+		id = (struct object *)o - w->objects;
+		if (t->claim[w->num_objects + id] != TRACK_NO_CLAIM)
+			continue;
+
+		err = tracker_grow(t, t->num_tracks + 1);
+		if (err < 0)
+			return err;
+
+		track = &t->track[t->num_tracks++];
+		memset(track, 0, sizeof(*track));
+		track->id = t->next_id++;
+		track->x = o->pos.x + x_start;
+		track->y = o->pos.y + y_start;
+		track->flux = o->object_adu;
+		track->object = o;
+	}
+
+	return t->num_tracks;
+}
+
+/**
+ * \param radius Match radius in pixels around predicted positions.
+ * \return Pointer to the new tracker or NULL on failure.
+ *
+ * Create an object tracker. Objects of each frame are matched to tracks from
+ * the previous frame within radius of each track's predicted position.
+ */
+struct smbrr_tracker *smbrr_tracker_new(float radius)
+{
+	struct smbrr_tracker *t;
+
+	if (!(radius > 0.0f))
+		return NULL;
+
+	t = calloc(1, sizeof(*t));
+	if (t == NULL)
+		return NULL;
+
+	t->radius = radius;
+	t->flux_weight = TRACK_FLUX_WEIGHT;
+	t->max_missed = TRACK_MAX_MISSED;
+	t->next_id = 1;
+	return t;
+}
+
+/**
+ * \param t tracker
+ *
+ * Free tracker.
+ */
+void smbrr_tracker_free(struct smbrr_tracker *t)
+{
+	if (t == NULL)
+		return;
+
+	free(t->track);
+	free(t->candidate);
+	free(t->claim);
+	free(t);
+}
+
+/**
+ * \param t tracker
+ *
+ * Drop all tracks. Track IDs continue from the last ID so they are never
+ * reused by a tracker.
+ */
+void smbrr_tracker_reset(struct smbrr_tracker *t)
+{
+	t->num_tracks = 0;
+	t->width = t->height = 0;
+}
+
+/**
+ * \param t tracker
+ * \param flux_weight Weight of the squared log flux ratio against the squared
+ * distance in match radii.
+ * \param max_missed Consecutive missed frames before a track is dropped.
+ * \return 0 on success, -EINVAL for a negative flux weight.
+ *
+ * Set how objects are scored against tracks and how long unmatched tracks
+ * coast on their predicted position.
+ */
+int smbrr_tracker_set_matching(struct smbrr_tracker *t, float flux_weight,
+							   unsigned int max_missed)
+{
+	if (flux_weight < 0.0f)
+		return -EINVAL;
+
+	t->flux_weight = flux_weight;
+	t->max_missed = max_missed;
+	return 0;
+}
+
+/**
+ * \param t tracker
+ * \param w wavelet with connected objects of the next frame
+ * \return Number of live tracks or -ENOMEM.
+ *
+ * Match the objects of the next frame to the tracks. Matched tracks take the
+ * object position and update their velocity and flux, unmatched tracks coast
+ * on their predicted position and unmatched objects start new tracks. The
+ * track object pointers are valid until the objects of w are freed.
+ */
+int smbrr_tracker_update(struct smbrr_tracker *t, struct smbrr_wavelet *w)
+{
+	t->width = w->width;
+	t->height = w->height;
+
+	return tracker_update(t, w, 0, 0);
+}
+
+/**
+ * \param t tracker
+ * \param w wavelet with connected objects of an area of the next frame
+ * \param x_start Frame X coordinate of the area origin.
+ * \param y_start Frame Y coordinate of the area origin.
+ * \return Number of live tracks or -ENOMEM.
+ *
+ * Like smbrr_tracker_update() for objects detected in an area of the frame,
+ * such as the area from smbrr_tracker_predict_area(). Only tracks predicted
+ * inside the area are matched or count a missed frame, other tracks coast.
+ */
+int smbrr_tracker_update_area(struct smbrr_tracker *t, struct smbrr_wavelet *w,
+							  unsigned int x_start, unsigned int y_start)
+{
+	return tracker_update(t, w, x_start, y_start);
+}
+
+/**
+ * \param t tracker
+ * \param margin Margin in pixels around the predicted positions.
+ * \param start Area start coordinate.
+ * \param end Area end coordinate, exclusive.
+ * \return 0 on success, -ENODATA when there are no tracks or no full frame
+ * update.
+ *
+ * Get the frame area holding the predicted position of every track plus
+ * margin, clipped to the frame of the last smbrr_tracker_update(). The area
+ * can be passed to smbrr_new_from_area() to redetect only around the tracks.
+ */
+int smbrr_tracker_predict_area(struct smbrr_tracker *t, unsigned int margin,
+							   struct smbrr_coord *start,
+							   struct smbrr_coord *end)
+{
+	float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+	float x, y;
+	unsigned int i;
+
+	if (t->num_tracks == 0 || t->width == 0)
+		return -ENODATA;
+
+	for (i = 0; i < t->num_tracks; i++) {
+		x = t->track[i].x + t->track[i].vx;
+		y = t->track[i].y + t->track[i].vy;
+		x0 = fminf(x0, x);
+		y0 = fminf(y0, y);
+		x1 = fmaxf(x1, x);
+		y1 = fmaxf(y1, y);
+	}
+
+	x0 = floorf(x0) - margin;
+	y0 = floorf(y0) - margin;
+	x1 = floorf(x1) + margin + 1;
+	y1 = floorf(y1) + margin + 1;
+
+	start->x = x0 > 0.0f ? x0 : 0;
+	start->y = y0 > 0.0f ? y0 : 0;
+	end->x = x1 < t->width ? x1 : t->width;
+	end->y = y1 < t->height ? y1 : t->height;
+
+	if (end->x <= start->x || end->y <= start->y)
+		return -ENODATA;
+
+	return 0;
+}
+
+/**
+ * \param t tracker
+ * \return Number of live tracks.
+ */
+unsigned int smbrr_tracker_get_num_tracks(struct smbrr_tracker *t)
+{
+	return t->num_tracks;
+}
+
+/**
+ * \param t tracker
+ * \param index Track index, tracks are in order of creation.
+ * \param track Track to fill.
+ * \return 0 on success, -EINVAL for an invalid index.
+ */
+int smbrr_tracker_get_track(struct smbrr_tracker *t, unsigned int index,
+							struct smbrr_track *track)
+{
+	if (index >= t->num_tracks)
+		return -EINVAL;
+
+	*track = t->track[index];
+	return 0;
+}
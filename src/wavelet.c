@@ -28,72 +28,6 @@
 #include "ops.h"
 #include "sombrero.h"
 
-static const struct convolution_ops *get_1d_conv_ops(void)
-{
-#ifdef HAVE_OPENCL
-	if (g_cl_ctx)
-		return &conv_ops_1d_opencl;
-#endif
-	unsigned int cpu_flags = cpu_get_flags();
-
-#if defined HAVE_AVX512
-	if (cpu_flags & CPU_X86_AVX512)
-		return &conv_ops_1d_avx512;
-#endif
-#if defined HAVE_FMA
-	if (cpu_flags & CPU_X86_FMA)
-		return &conv_ops_1d_fma;
-#endif
-#if defined HAVE_AVX2
-	if (cpu_flags & CPU_X86_AVX2)
-		return &conv_ops_1d_avx2;
-#endif
-#if defined HAVE_AVX
-	if (cpu_flags & CPU_X86_AVX)
-		return &conv_ops_1d_avx;
-#endif
-#if defined HAVE_SSE42
-	if (cpu_flags & CPU_X86_SSE4_2)
-		return &conv_ops_1d_sse42;
-#endif
-
-	/* default C implementation */
-	return &conv_ops_1d;
-}
-
-static const struct convolution_ops *get_2d_conv_ops(void)
-{
-#ifdef HAVE_OPENCL
-	if (g_cl_ctx)
-		return &conv_ops_2d_opencl;
-#endif
-	unsigned int cpu_flags = cpu_get_flags();
-
-#if defined HAVE_AVX512
-	if (cpu_flags & CPU_X86_AVX512)
-		return &conv_ops_2d_avx512;
-#endif
-#if defined HAVE_FMA
-	if (cpu_flags & CPU_X86_FMA)
-		return &conv_ops_2d_fma;
-#endif
-#if defined HAVE_AVX2
-	if (cpu_flags & CPU_X86_AVX2)
-		return &conv_ops_2d_avx2;
-#endif
-#if defined HAVE_AVX
-	if (cpu_flags & CPU_X86_AVX)
-		return &conv_ops_2d_avx;
-#endif
-#if defined HAVE_SSE42
-	if (cpu_flags & CPU_X86_SSE4_2)
-		return &conv_ops_2d_sse42;
-#endif
-
-	/* default C implementation */
-	return &conv_ops_2d;
-}
-
 /**
 * \param src Image
 * \param num_scales Number of wavelet scales.
@@ -119,12 +53,12 @@ struct smbrr_wavelet *smbrr_wavelet_new(struct smbrr *src,
 	case SMBRR_DATA_1D_FLOAT:
 		wtype = src->type;
 		stype = SMBRR_DATA_1D_UINT32;
-		ops = get_1d_conv_ops();
+		ops = backend_get_1d_conv_ops();
 		break;
 	case SMBRR_DATA_2D_FLOAT:
 		wtype = src->type;
 		stype = SMBRR_DATA_2D_UINT32;
-		ops = get_2d_conv_ops();
+		ops = backend_get_2d_conv_ops();
 		break;
 	default:
 		return NULL;
@@ -139,10 +73,6 @@ struct smbrr_wavelet *smbrr_wavelet_new(struct smbrr *src,
 	w->num_scales = num_scales;
 	w->ops = ops;
 
-	w->object_map = calloc(w->height * w->width, sizeof(struct object *));
-	if (w->object_map == NULL)
-		goto m_err;
-
 	for (i = 0; i < num_scales; i++) {
 		w->c[i] = smbrr_new(wtype, w->width, w->height, src->stride, 0, NULL);
 		if (w->c[i] == NULL)
@@ -180,7 +110,6 @@ c_err:
 	for (--i; i >= 0; i--)
 		smbrr_free(w->c[i]);
 
-m_err:
 	free(w);
 	return NULL;
 }
@@ -87,6 +87,8 @@ run_test "test_atrous" "test_at-" "$IMAGE" "test_at"
 run_test "test_structures" "test_st-" "$IMAGE" "test_st"
 run_test "test_objects" "test_ob-" "-i" "$IMAGE" "-o" "test_ob"
 run_test "test_reconstruct" "test_re_reconstructed" "-i" "$IMAGE" "-o" "test_re_reconstructed.bmp"
+run_test "test_data_ops" "none" "$IMAGE"
+run_test "test_object_ops" "none" "$IMAGE"
 run_test "test_packages.sh" "none"
 
 echo "============================================================"
@@ -0,0 +1,891 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../examples/bmp.h"
+#include "../examples/fits.h"
+#include "sombrero.h"
+
+/* export must match the legacy copy, normalise and get_data path */
+static int test_export_linear(struct smbrr *image)
+{
+	struct smbrr *copy;
+	unsigned char *ref, *out;
+	int bytes, ret = 0, i;
+
+	bytes = smbrr_get_bytes(image);
+	ref = calloc(1, bytes);
+	out = calloc(1, bytes);
+	copy = smbrr_new_copy(image);
+	if (ref == NULL || out == NULL || copy == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	smbrr_normalise(copy, 0.0, 250.0);
+	smbrr_get_data(copy, SMBRR_SOURCE_UINT8, (void **)&ref);
+
+	ret = smbrr_export(image, SMBRR_SOURCE_UINT8, SMBRR_STRETCH_LINEAR, 0.0,
+					   100.0, 250.0, out);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < bytes; i++) {
+		if (ref[i] != out[i]) {
+			fprintf(stderr, "export linear mismatch at %d: %d != %d\n", i,
+					out[i], ref[i]);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+out:
+	smbrr_free(copy);
+	free(ref);
+	free(out);
+	return ret;
+}
+
+/* stretched output must be monotonic in the input pixel value */
+static int test_export_stretch(struct smbrr *image, enum smbrr_stretch stretch)
+{
+	unsigned short *out;
+	float min, max, vmin, vmax;
+	int x, y, width, height, stride, ret;
+	int omin = -1, omax = -1;
+
+	width = smbrr_get_width(image);
+	height = smbrr_get_height(image);
+	stride = smbrr_get_stride(image);
+	smbrr_find_limits(image, &min, &max);
+
+	out = calloc(stride * height, sizeof(*out));
+	if (out == NULL)
+		return -ENOMEM;
+
+	ret = smbrr_export(image, SMBRR_SOURCE_UINT16, stretch, 0.0, 100.0, 0.0,
+					   out);
+	if (ret < 0)
+		goto out;
+
+	vmin = max;
+	vmax = min;
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			float v = smbrr_get_adu_at_posn(image, x, y);
+			int o = out[y * stride + x];
+
+			if (v < vmin) {
+				vmin = v;
+				omin = o;
+			}
+			if (v > vmax) {
+				vmax = v;
+				omax = o;
+			}
+		}
+	}
+
+	fprintf(stdout, "stretch %d: min %f -> %d max %f -> %d\n", stretch, vmin,
+			omin, vmax, omax);
+	if (omin != 0 || omax < 65534)
+		ret = -EINVAL;
+
+out:
+	free(out);
+	return ret;
+}
+
+/* percentile clipping saturates no more than the requested fraction */
+static int test_export_clip(struct smbrr *image)
+{
+	unsigned char *out;
+	int x, y, width, height, stride, ret, high = 0;
+
+	width = smbrr_get_width(image);
+	height = smbrr_get_height(image);
+	stride = smbrr_get_stride(image);
+
+	out = calloc(stride * height, 1);
+	if (out == NULL)
+		return -ENOMEM;
+
+	ret = smbrr_export(image, SMBRR_SOURCE_UINT8, SMBRR_STRETCH_LINEAR, 0.0,
+					   99.0, 0.0, out);
+	if (ret < 0)
+		goto out;
+
+	for (y = 0; y < height; y++)
+		for (x = 0; x < width; x++)
+			if (out[y * stride + x] == 255)
+				high++;
+
+	fprintf(stdout, "clip 99%%: %d of %d pixels saturated\n", high,
+			width * height);
+
+	/* quantised data and histogram binning make the clip approximate */
+	if (high <= 1 || high > width * height / 50)
+		ret = -EINVAL;
+
+	/* invalid percentiles are rejected */
+	if (smbrr_export(image, SMBRR_SOURCE_UINT8, SMBRR_STRETCH_LINEAR, 50.0,
+					 10.0, 0.0, out) != -EINVAL)
+		ret = -EINVAL;
+
+out:
+	free(out);
+	return ret;
+}
+
+/* fused ingest matches smbrr_new() + smbrr_anscombe() and inverts cleanly */
+static int test_anscombe(struct smbrr *image, const void *data, int width,
+						 int height, int stride, enum smbrr_source_type depth)
+{
+	struct smbrr *fused, *ref;
+	float gain = 2.0, bias = 0.0, readout = 3.0, a, b, err = 0.0, rerr = 0.0;
+	int x, y, ret = 0;
+
+	fused = smbrr_new_anscombe(SMBRR_DATA_2D_FLOAT, width, height, stride,
+							   depth, data, gain, bias, readout);
+	ref = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, stride, depth, data);
+	if (fused == NULL || ref == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	smbrr_anscombe(ref, gain, bias, readout);
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			a = smbrr_get_adu_at_posn(fused, x, y);
+			b = smbrr_get_adu_at_posn(ref, x, y);
+			if (fabsf(a - b) > err)
+				err = fabsf(a - b);
+		}
+	}
+
+	smbrr_anscombe_inverse(fused, gain, bias, readout);
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			a = smbrr_get_adu_at_posn(fused, x, y);
+			b = smbrr_get_adu_at_posn(image, x, y);
+			if (fabsf(a - b) > rerr)
+				rerr = fabsf(a - b);
+		}
+	}
+
+	fprintf(stdout, "anscombe: ingest error %f inverse error %f\n", err, rerr);
+	if (err > 1.0e-4 || rerr > 1.0e-2)
+		ret = -EINVAL;
+
+out:
+	smbrr_free(fused);
+	smbrr_free(ref);
+	return ret;
+}
+
+/* fused expression matches the equivalent sequence of data operations */
+static int test_expr(struct smbrr *image)
+{
+	struct smbrr *ref, *out, *b;
+	struct smbrr_expr *e;
+	float a, r, err = 0.0;
+	int x, y, width, height, ret = 0;
+
+	width = smbrr_get_width(image);
+	height = smbrr_get_height(image);
+
+	e = smbrr_expr_new();
+	ref = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, 0, 0, NULL);
+	out = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, 0, 0, NULL);
+	b = smbrr_new_copy(image);
+	if (e == NULL || ref == NULL || out == NULL || b == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* b is a shifted copy so the sum has negative pixels to clear */
+	smbrr_add_value(b, -100.0);
+
+	/* ref = |max(image + b * 0.5 - 20, 0) * 2| */
+	smbrr_mult_add(ref, image, b, 0.5);
+	smbrr_add_value(ref, -20.0);
+	smbrr_zero_negative(ref);
+	smbrr_mult_value(ref, 2.0);
+	smbrr_abs(ref);
+
+	smbrr_expr_load(e, image);
+	smbrr_expr_mult_add(e, b, 0.5);
+	smbrr_expr_add_value(e, -20.0);
+	smbrr_expr_zero_negative(e);
+	smbrr_expr_mult_value(e, 2.0);
+	smbrr_expr_abs(e);
+	smbrr_expr_store(e, out);
+	smbrr_expr_eval(e);
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			a = smbrr_get_adu_at_posn(out, x, y);
+			r = smbrr_get_adu_at_posn(ref, x, y);
+			if (fabsf(a - r) > err)
+				err = fabsf(a - r);
+		}
+	}
+
+	fprintf(stdout, "expr: fused error %f\n", err);
+	if (err > 1.0e-3)
+		ret = -EINVAL;
+
+	/* operands must all be the same size */
+	smbrr_free(b);
+	b = smbrr_new(SMBRR_DATA_2D_FLOAT, width / 2, height / 2, 0, 0, NULL);
+	if (b == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (smbrr_expr_add(e, b) != -EINVAL)
+		ret = -EINVAL;
+
+	/* scalar only expressions have no elements to evaluate */
+	smbrr_expr_reset(e);
+	smbrr_expr_add_value(e, 1.0);
+	smbrr_expr_mult_value(e, 2.0);
+	smbrr_expr_zero_negative(e);
+	smbrr_expr_abs(e);
+	if (smbrr_expr_eval(e) != -EINVAL)
+		ret = -EINVAL;
+
+out:
+	smbrr_expr_free(e);
+	smbrr_free(ref);
+	smbrr_free(out);
+	smbrr_free(b);
+	return ret;
+}
+
+/* an area away from the origin copies the matching source rows */
+static int test_new_from_area(struct smbrr *image)
+{
+	unsigned int width, height, x0, y0, x1, y1, x, y;
+	struct smbrr *area;
+	int ret = 0;
+
+	width = smbrr_get_width(image);
+	height = smbrr_get_height(image);
+	x0 = width / 3;
+	y0 = height / 4;
+	x1 = x0 + width / 3;
+	y1 = y0 + height / 2;
+
+	if (smbrr_new_from_area(image, x0, y0, width + 1, y1) != NULL ||
+		smbrr_new_from_area(image, x0, y0, x1, height + 1) != NULL ||
+		smbrr_new_from_area(image, x0, y0, x0, y1) != NULL)
+		return -EINVAL;
+
+	area = smbrr_new_from_area(image, x0, y0, x1, y1);
+	if (area == NULL)
+		return -ENOMEM;
+
+	if (smbrr_get_width(area) != (int)(x1 - x0) ||
+		smbrr_get_height(area) != (int)(y1 - y0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (y = y0; y < y1; y++)
+		for (x = x0; x < x1; x++) {
+			if (smbrr_get_adu_at_posn(area, x - x0, y - y0) !=
+				smbrr_get_adu_at_posn(image, x, y)) {
+				fprintf(stderr, "area pixel %u,%u differs\n", x, y);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+
+out:
+	smbrr_free(area);
+	return ret;
+}
+
+/* every available CPU backend matches the scalar wavelet convolution */
+static int test_backend(const void *data, int width, int height, int stride,
+						enum smbrr_source_type depth)
+{
+	enum smbrr_backend list[8];
+	struct smbrr *image, *scale, *ref = NULL;
+	struct smbrr_wavelet *w;
+	float a, b, err;
+	int i, n, x, y, ret = 0;
+
+	n = smbrr_backend_list(list, 8);
+	if (n < 1 || list[0] != SMBRR_BACKEND_SCALAR)
+		return -EINVAL;
+
+	if (smbrr_backend_set((enum smbrr_backend)99) != -EINVAL)
+		return -EINVAL;
+
+	/* forced OpenCL runs on the CPU until a context exists */
+	if (smbrr_backend_set(SMBRR_BACKEND_OPENCL) == 0 &&
+		!smbrr_backend_available(SMBRR_BACKEND_OPENCL) &&
+		smbrr_backend_get() == SMBRR_BACKEND_OPENCL)
+		ret = -EINVAL;
+	smbrr_backend_set(SMBRR_BACKEND_AUTO);
+
+	for (i = 0; i < n && ret == 0; i++) {
+		if (list[i] == SMBRR_BACKEND_OPENCL)
+			continue;
+
+		if (smbrr_backend_set(list[i]) < 0 || smbrr_backend_get() != list[i]) {
+			ret = -EINVAL;
+			break;
+		}
+
+		image = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, stride, depth,
+						  data);
+		w = image ? smbrr_wavelet_new(image, 5) : NULL;
+		if (w == NULL) {
+			smbrr_free(image);
+			ret = -ENOMEM;
+			break;
+		}
+
+		smbrr_wavelet_convolution(w, SMBRR_CONV_ATROUS,
+								  SMBRR_WAVELET_MASK_LINEAR);
+		scale = smbrr_wavelet_get_scale(w, 4);
+
+		err = 0.0;
+		if (ref == NULL) {
+			ref = smbrr_new_copy(scale);
+			if (ref == NULL)
+				ret = -ENOMEM;
+		} else {
+			for (y = 0; y < height; y++) {
+				for (x = 0; x < width; x++) {
+					a = smbrr_get_adu_at_posn(scale, x, y);
+					b = smbrr_get_adu_at_posn(ref, x, y);
+					if (fabsf(a - b) > err)
+						err = fabsf(a - b);
+				}
+			}
+		}
+
+		fprintf(stdout, "backend %s: error %f\n",
+				smbrr_backend_name(list[i]), err);
+		if (err > 1.0e-2)
+			ret = -EINVAL;
+
+		smbrr_wavelet_free(w);
+		smbrr_free(image);
+	}
+
+	smbrr_backend_set(SMBRR_BACKEND_AUTO);
+	smbrr_free(ref);
+	return ret;
+}
+
+static unsigned int count_significant(struct smbrr *sig, uint32_t *buf)
+{
+	unsigned int i, count = 0;
+
+	smbrr_get_data(sig, SMBRR_SOURCE_UINT32, (void **)&buf);
+	for (i = 0; i < smbrr_get_size(sig); i++)
+		count += buf[i] ? 1 : 0;
+
+	return count;
+}
+
+/* unit Gaussian deviate from a repeatable generator */
+static float gauss(unsigned int *seed)
+{
+	float u1, u2;
+
+	*seed = *seed * 1103515245 + 12345;
+	u1 = ((*seed >> 8) + 1.0f) / 16777217.0f;
+	*seed = *seed * 1103515245 + 12345;
+	u2 = (*seed >> 8) / 16777216.0f;
+	return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+/* MAD engine finds the expected noise tail on every scale of pure noise */
+static int test_clip_engine_mad(void)
+{
+	struct smbrr_clip_coeff coeff;
+	struct smbrr_wavelet *w = NULL;
+	struct smbrr *noise;
+	unsigned int count, i, seed = 1, size = 256;
+	float *adu;
+	uint32_t *buf;
+	int scale, ret = 0;
+
+	adu = malloc(size * size * sizeof(*adu));
+	buf = calloc(size * size, sizeof(*buf));
+	if (adu == NULL || buf == NULL) {
+		free(adu);
+		free(buf);
+		return -ENOMEM;
+	}
+
+	/* Gaussian noise with sigma 10 */
+	for (i = 0; i < size * size; i++)
+		adu[i] = 100.0f + 10.0f * gauss(&seed);
+
+	noise = smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, size,
+					  SMBRR_SOURCE_FLOAT, adu);
+	if (noise == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	w = smbrr_wavelet_new(noise, 5);
+	if (w == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (smbrr_wavelet_set_clip_engine(w, (enum smbrr_clip_engine)99) !=
+		-EINVAL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	smbrr_wavelet_convolution(w, SMBRR_CONV_ATROUS, SMBRR_WAVELET_MASK_BICUBIC);
+	smbrr_wavelet_set_clip_engine(w, SMBRR_CLIP_ENGINE_MAD);
+
+	/* 3 sigma leaves about 0.13% of each scale above the threshold */
+	for (i = 0; i < SMBRR_MAX_SCALES - 1; i++)
+		coeff.coeff[i] = 3.0f;
+	smbrr_wavelet_ksigma_clip_custom(w, &coeff, 0.001);
+
+	for (scale = 0; scale < 4; scale++) {
+		count = count_significant(smbrr_wavelet_get_significant(w, scale), buf);
+		fprintf(stdout, "mad scale %d: %u significant\n", scale, count);
+		if (count < 30 || count > 270)
+			ret = -EINVAL;
+	}
+
+out:
+	smbrr_wavelet_free(w);
+	smbrr_free(noise);
+	free(adu);
+	free(buf);
+	return ret;
+}
+
+/* noise mesh follows a left to right noise gradient */
+static int test_noise_mesh(void)
+{
+	struct smbrr_clip_coeff coeff;
+	struct smbrr_wavelet *w = NULL;
+	struct smbrr *noise, *map = NULL;
+	unsigned int left, right, i, x, y, dx, dy, seed = 7, size = 256;
+	float *adu, r2;
+	double sum;
+	uint32_t *buf;
+	int ret = 0;
+
+	adu = malloc(size * size * sizeof(*adu));
+	buf = calloc(size * size, sizeof(*buf));
+	if (adu == NULL || buf == NULL) {
+		free(adu);
+		free(buf);
+		return -ENOMEM;
+	}
+
+	/* sigma rises from 5 to 20 across the frame */
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++)
+			adu[y * size + x] = 100.0f + (5.0f + 15.0f * x / (size - 1)) *
+											 gauss(&seed);
+
+	noise = smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, size,
+					  SMBRR_SOURCE_FLOAT, adu);
+	map = smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, 0, 0, NULL);
+	if (noise == NULL || map == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (smbrr_noise_map(noise, map, 1) != -EINVAL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = smbrr_noise_map(noise, map, 32);
+	if (ret < 0)
+		goto out;
+
+	smbrr_get_data(map, SMBRR_SOURCE_FLOAT, (void **)&adu);
+	fprintf(stdout, "noise map: left %f centre %f right %f\n",
+			adu[128 * size + 16], adu[128 * size + 128], adu[128 * size + 240]);
+	if (fabsf(adu[128 * size + 16] - 5.9f) > 2.0f ||
+		fabsf(adu[128 * size + 128] - 12.5f) > 2.0f ||
+		fabsf(adu[128 * size + 240] - 19.1f) > 2.0f) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	w = smbrr_wavelet_new(noise, 5);
+	if (w == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	smbrr_wavelet_convolution(w, SMBRR_CONV_ATROUS, SMBRR_WAVELET_MASK_LINEAR);
+	smbrr_wavelet_set_noise_mesh(w, 32);
+
+	for (i = 0; i < SMBRR_MAX_SCALES - 1; i++)
+		coeff.coeff[i] = 3.0f;
+	smbrr_wavelet_ksigma_clip_custom(w, &coeff, 0.001);
+
+	/* both halves keep a similar noise tail */
+	smbrr_get_data(smbrr_wavelet_get_significant(w, 0), SMBRR_SOURCE_UINT32,
+				   (void **)&buf);
+	left = right = 0;
+	for (y = 0; y < size; y++)
+		for (x = 0; x < size; x++) {
+			if (x < size / 2)
+				left += buf[y * size + x] ? 1 : 0;
+			else
+				right += buf[y * size + x] ? 1 : 0;
+		}
+
+	fprintf(stdout, "noise mesh: left %u right %u significant\n", left, right);
+	if (left < 10 || right < 10 || left > 3 * right || right > 3 * left) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* bright sources every 16 pixels do not inflate a flat noise map */
+	for (i = 0; i < size * size; i++)
+		adu[i] = 100.0f + 10.0f * gauss(&seed);
+	for (y = 8; y < size; y += 16)
+		for (x = 8; x < size; x += 16)
+			for (dy = 0; dy < 7; dy++)
+				for (dx = 0; dx < 7; dx++) {
+					r2 = (dx - 3.0f) * (dx - 3.0f) + (dy - 3.0f) * (dy - 3.0f);
+					adu[(y + dy - 3) * size + x + dx - 3] +=
+						1000.0f * expf(-0.5f * r2);
+				}
+
+	smbrr_free(noise);
+	noise = smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, size,
+					  SMBRR_SOURCE_FLOAT, adu);
+	if (noise == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = smbrr_noise_map(noise, map, 32);
+	if (ret < 0)
+		goto out;
+
+	smbrr_get_data(map, SMBRR_SOURCE_FLOAT, (void **)&adu);
+	for (i = 0, sum = 0.0; i < size * size; i++)
+		sum += adu[i];
+	sum /= size * size;
+
+	fprintf(stdout, "noise map with sources: %f\n", sum);
+	if (fabs(sum - 10.0) > 1.5)
+		ret = -EINVAL;
+
+out:
+	smbrr_wavelet_free(w);
+	smbrr_free(map);
+	smbrr_free(noise);
+	free(adu);
+	free(buf);
+	return ret;
+}
+
+/* warm started clipping matches a full clip and resets on a scene change */
+static int test_noise_state(struct smbrr *image)
+{
+	struct smbrr_noise_state *state;
+	struct smbrr_wavelet *w;
+	unsigned int full[4], count;
+	uint32_t *buf;
+	int scale, warm, ret = 0;
+
+	w = smbrr_wavelet_new(image, 5);
+	state = smbrr_noise_state_new();
+	buf = calloc(smbrr_get_size(image), sizeof(*buf));
+	if (w == NULL || state == NULL || buf == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	smbrr_wavelet_convolution(w, SMBRR_CONV_ATROUS, SMBRR_WAVELET_MASK_LINEAR);
+	smbrr_wavelet_ksigma_clip(w, SMBRR_CLIP_NORMAL, 0.001);
+	for (scale = 0; scale < 4; scale++)
+		full[scale] =
+			count_significant(smbrr_wavelet_get_significant(w, scale), buf);
+
+	/* first frame is fully clipped, second frame reuses every scale */
+	warm = smbrr_wavelet_ksigma_clip_state(w, SMBRR_CLIP_NORMAL, 0.001, state);
+	if (warm != 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	warm = smbrr_wavelet_ksigma_clip_state(w, SMBRR_CLIP_NORMAL, 0.001, state);
+	fprintf(stdout, "noise state: %d warm scales\n", warm);
+	if (warm != 4) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (scale = 0; scale < 4; scale++) {
+		count = count_significant(smbrr_wavelet_get_significant(w, scale), buf);
+		if (count != full[scale]) {
+			fprintf(stderr, "noise state scale %d: %u vs %u\n", scale, count,
+					full[scale]);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	/* brighter scene changes the noise on every scale */
+	for (scale = 0; scale < 4; scale++)
+		smbrr_mult_value(smbrr_wavelet_get_wavelet(w, scale), 4.0f);
+	warm = smbrr_wavelet_ksigma_clip_state(w, SMBRR_CLIP_NORMAL, 0.001, state);
+	if (warm != 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* state older than max age is refreshed */
+	smbrr_noise_state_set_tolerance(state, 0.05f, 0);
+	warm = smbrr_wavelet_ksigma_clip_state(w, SMBRR_CLIP_NORMAL, 0.001, state);
+	if (warm != 0)
+		ret = -EINVAL;
+
+out:
+	smbrr_noise_state_free(state);
+	smbrr_wavelet_free(w);
+	free(buf);
+	return ret;
+}
+
+/* FDR keeps pure noise clean and finds sources with few false pixels */
+static int test_fdr_clip(void)
+{
+	struct smbrr_wavelet *w = NULL;
+	struct smbrr *noise = NULL;
+	unsigned int i, x, y, dx, dy, seed = 3, size = 256;
+	unsigned int count, fp, pass, shifted;
+	float *adu, r2;
+	uint32_t *buf;
+	int ret = 0;
+
+	adu = malloc(size * size * sizeof(*adu));
+	buf = calloc(size * size, sizeof(*buf));
+	if (adu == NULL || buf == NULL) {
+		free(adu);
+		free(buf);
+		return -ENOMEM;
+	}
+
+	/* pass 0 is noise only, pass 1 adds sources every 32 pixels */
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < size * size; i++)
+			adu[i] = 100.0f + 10.0f * gauss(&seed);
+
+		for (y = 16; pass && y < size; y += 32)
+			for (x = 16; x < size; x += 32)
+				for (dy = 0; dy < 7; dy++)
+					for (dx = 0; dx < 7; dx++) {
+						r2 = (dx - 3.0f) * (dx - 3.0f) + (dy - 3.0f) * (dy - 3.0f);
+						adu[(y + dy - 3) * size + x + dx - 3] +=
+							200.0f * expf(-0.5f * r2);
+					}
+
+		noise = smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, size,
+						  SMBRR_SOURCE_FLOAT, adu);
+		w = noise ? smbrr_wavelet_new(noise, 5) : NULL;
+		if (w == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		smbrr_wavelet_convolution(w, SMBRR_CONV_ATROUS,
+								  SMBRR_WAVELET_MASK_BICUBIC);
+		if (smbrr_wavelet_fdr_clip(w, 0.0f) != -EINVAL) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		ret = smbrr_wavelet_fdr_clip(w, 0.05f);
+		if (ret < 0)
+			goto out;
+
+		/* significant pixels away from any source are false */
+		smbrr_get_data(smbrr_wavelet_get_significant(w, 0),
+					   SMBRR_SOURCE_UINT32, (void **)&buf);
+		count = fp = 0;
+		for (y = 0; y < size; y++)
+			for (x = 0; x < size; x++) {
+				if (!buf[y * size + x])
+					continue;
+				count++;
+				dx = (x + 16) % 32;
+				dy = (y + 16) % 32;
+				if (!pass || !((dx <= 4 || dx >= 28) && (dy <= 4 || dy >= 28)))
+					fp++;
+			}
+
+		fprintf(stdout, "fdr pass %u: %u significant %u false\n", pass, count,
+				fp);
+		if (pass == 0 && count > 5)
+			ret = -EINVAL;
+		if (pass == 1 && (count < 64 || fp > count / 10))
+			ret = -EINVAL;
+
+		/* p-values are taken above the median of a plane with an offset */
+		if (pass == 1 && ret == 0) {
+			smbrr_add_value(smbrr_wavelet_get_wavelet(w, 0), 50.0f);
+			ret = smbrr_wavelet_fdr_clip(w, 0.05f);
+			if (ret < 0)
+				goto out;
+
+			smbrr_get_data(smbrr_wavelet_get_significant(w, 0),
+						   SMBRR_SOURCE_UINT32, (void **)&buf);
+			for (i = 0, shifted = 0; i < size * size; i++)
+				shifted += buf[i] != 0;
+
+			fprintf(stdout, "fdr offset: %u significant\n", shifted);
+			if (shifted * 100 < count * 99 || shifted * 100 > count * 101)
+				ret = -EINVAL;
+		}
+
+		smbrr_wavelet_free(w);
+		smbrr_free(noise);
+		w = NULL;
+		noise = NULL;
+		if (ret < 0)
+			break;
+	}
+
+out:
+	smbrr_wavelet_free(w);
+	smbrr_free(noise);
+	free(adu);
+	free(buf);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct smbrr *image;
+	struct bitmap *bmp = NULL;
+	const void *data;
+	int ret, width, height, stride;
+	enum smbrr_source_type depth;
+	char *ifile;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <input.bmp>\n", argv[0]);
+		return -EINVAL;
+	}
+
+	ifile = argv[1];
+
+	if (strstr(ifile, ".fit") != NULL) {
+		ret = fits_load(ifile, &data, &width, &height, &depth, &stride);
+		if (ret < 0)
+			return ret;
+	} else {
+		ret = bmp_load(ifile, &bmp, &data);
+		if (ret < 0)
+			return ret;
+
+		height = bmp_height(bmp);
+		width = bmp_width(bmp);
+		depth = bmp_depth(bmp);
+		stride = bmp_stride(bmp);
+	}
+
+	image = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, stride, depth, data);
+	if (image == NULL)
+		return -EINVAL;
+
+	ret = test_export_linear(image);
+	if (ret < 0) {
+		fprintf(stderr, "export linear failed\n");
+		goto out;
+	}
+
+	ret = test_export_stretch(image, SMBRR_STRETCH_ASINH);
+	if (ret < 0) {
+		fprintf(stderr, "export asinh failed\n");
+		goto out;
+	}
+
+	ret = test_export_stretch(image, SMBRR_STRETCH_LOG);
+	if (ret < 0) {
+		fprintf(stderr, "export log failed\n");
+		goto out;
+	}
+
+	ret = test_export_clip(image);
+	if (ret < 0) {
+		fprintf(stderr, "export clip failed\n");
+		goto out;
+	}
+
+	ret = test_anscombe(image, data, width, height, stride, depth);
+	if (ret < 0) {
+		fprintf(stderr, "anscombe failed\n");
+		goto out;
+	}
+
+	ret = test_expr(image);
+	if (ret < 0) {
+		fprintf(stderr, "expr failed\n");
+		goto out;
+	}
+
+	ret = test_new_from_area(image);
+	if (ret < 0) {
+		fprintf(stderr, "new from area failed\n");
+		goto out;
+	}
+
+	ret = test_backend(data, width, height, stride, depth);
+	if (ret < 0) {
+		fprintf(stderr, "backend failed\n");
+		goto out;
+	}
+
+	ret = test_clip_engine_mad();
+	if (ret < 0) {
+		fprintf(stderr, "clip engine mad failed\n");
+		goto out;
+	}
+
+	ret = test_noise_mesh();
+	if (ret < 0) {
+		fprintf(stderr, "noise mesh failed\n");
+		goto out;
+	}
+
+	ret = test_noise_state(image);
+	if (ret < 0) {
+		fprintf(stderr, "noise state failed\n");
+		goto out;
+	}
+
+	ret = test_fdr_clip();
+	if (ret < 0) {
+		fprintf(stderr, "fdr clip failed\n");
+		goto out;
+	}
+
+out:
+	free(bmp);
+	smbrr_free(image);
+	return ret;
+}
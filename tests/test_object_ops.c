@@ -0,0 +1,1111 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../examples/bmp.h"
+#include "../examples/fits.h"
+#include "sombrero.h"
+
+/* unit Gaussian deviate from a repeatable generator */
+static float gauss(unsigned int *seed)
+{
+	float u1, u2;
+
+	*seed = *seed * 1103515245 + 12345;
+	u1 = ((*seed >> 8) + 1.0f) / 16777217.0f;
+	*seed = *seed * 1103515245 + 12345;
+	u2 = (*seed >> 8) / 16777216.0f;
+	return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+/* wavelet with the structures of every scale found, ready to connect */
+static struct smbrr_wavelet *object_wavelet_new(struct smbrr *image,
+												unsigned int scales)
+{
+	struct smbrr_wavelet *w;
+
+	w = smbrr_wavelet_new(image, scales);
+	if (w == NULL)
+		return NULL;
+
+	smbrr_wavelet_convolution(w, SMBRR_CONV_ATROUS, SMBRR_WAVELET_MASK_LINEAR);
+	smbrr_wavelet_ksigma_clip(w, SMBRR_CLIP_VGENTLE, 0.001);
+	smbrr_wavelet_structure_find_all(w);
+	return w;
+}
+
+static int test_structure_union_find(void)
+{
+	static const unsigned int expect[] = { 151, 1, 1, 1, 211, 71, 4, 1 };
+	struct smbrr_wavelet *w = NULL;
+	struct smbrr *image = NULL, *pattern = NULL;
+	struct smbrr_structure st;
+	unsigned int width = 200, height = 150, i, x, y, pass;
+	float *adu;
+	uint32_t *buf;
+	int ret = 0;
+
+	adu = calloc(width * height, sizeof(*adu));
+	buf = calloc(width * height, sizeof(*buf));
+	if (adu == NULL || buf == NULL) {
+		free(adu);
+		free(buf);
+		return -ENOMEM;
+	}
+
+	/* comb, only joined by its spine */
+	for (x = 60; x <= 100; x++)
+		adu[10 * width + x] = 1.0f;
+	for (x = 60; x <= 100; x += 4)
+		for (y = 11; y <= 20; y++)
+			adu[y * width + x] = 1.0f;
+
+	/* diagonal pixels are not 4-connected */
+	for (i = 0; i < 3; i++)
+		adu[(30 + i) * width + 150 + i] = 1.0f;
+
+	/* U whose arms cross both strip seams and join at the bottom */
+	for (y = 40; y <= 140; y++)
+		adu[y * width + 20] = adu[y * width + 30] = 1.0f;
+	for (x = 21; x < 30; x++)
+		adu[140 * width + x] = 1.0f;
+	adu[139 * width + 30] = 5.0f;
+
+	/* inverted U across the second seam */
+	for (x = 120; x <= 130; x++)
+		adu[110 * width + x] = 1.0f;
+	for (y = 111; y <= 140; y++)
+		adu[y * width + 120] = adu[y * width + 130] = 1.0f;
+
+	/* block and a single pixel in the corner */
+	adu[140 * width + 180] = adu[140 * width + 181] = 1.0f;
+	adu[141 * width + 180] = adu[141 * width + 181] = 1.0f;
+	adu[width * height - 1] = 1.0f;
+
+	image = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, 0, 0, NULL);
+	pattern = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, width,
+						SMBRR_SOURCE_FLOAT, adu);
+	w = image ? smbrr_wavelet_new(image, 2) : NULL;
+	if (pattern == NULL || w == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (smbrr_wavelet_set_structure_engine(w, 2) != -EINVAL) {
+		ret = -EINVAL;
+		goto out;
+	}
+	smbrr_wavelet_set_structure_engine(w, SMBRR_STRUCTURE_ENGINE_UNION_FIND);
+
+	/* second pass finds structures again over the first results */
+	for (pass = 0; pass < 2; pass++) {
+		smbrr_copy(smbrr_wavelet_get_wavelet(w, 0), pattern);
+		smbrr_significant_new(smbrr_wavelet_get_wavelet(w, 0),
+							  smbrr_wavelet_get_significant(w, 0), 0.5f);
+
+		ret = smbrr_wavelet_structure_find(w, 0);
+		if (ret != sizeof(expect) / sizeof(expect[0])) {
+			fprintf(stderr, "union-find found %d structures\n", ret);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		for (i = 0; i < ret; i++) {
+			smbrr_wavelet_get_structure(w, 0, i, &st);
+			if (st.id != i || st.size != expect[i]) {
+				fprintf(stderr, "structure %u id %u size %u expected %u\n", i,
+						st.id, st.size, expect[i]);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+
+		smbrr_wavelet_get_structure(w, 0, 4, &st);
+		if (st.pos.x != 30 || st.pos.y != 139 || st.max_value != 5.0f) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		/* significance map holds the structure ID + 2 */
+		smbrr_get_data(smbrr_wavelet_get_significant(w, 0),
+					   SMBRR_SOURCE_UINT32, (void **)&buf);
+		if (buf[100 * width + 30] != 6 || buf[130 * width + 130] != 7 ||
+			buf[0] != 0) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	smbrr_wavelet_free(w);
+	smbrr_free(pattern);
+	smbrr_free(image);
+	free(adu);
+	free(buf);
+	return ret;
+}
+
+/* structures found concurrently match structures found one scale at a time */
+static int test_structure_find_all(struct smbrr *image)
+{
+	struct smbrr_wavelet *w[2] = { NULL, NULL };
+	struct smbrr_structure a, b;
+	unsigned int scale, i, n, scales = 6;
+	int ret = 0, total = 0;
+
+	for (i = 0; i < 2; i++) {
+		w[i] = smbrr_wavelet_new(image, scales);
+		if (w[i] == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		smbrr_wavelet_convolution(w[i], SMBRR_CONV_ATROUS,
+								  SMBRR_WAVELET_MASK_LINEAR);
+		smbrr_wavelet_ksigma_clip(w[i], SMBRR_CLIP_VGENTLE, 0.001);
+	}
+
+	for (scale = 0; scale < scales - 1; scale++) {
+		ret = smbrr_wavelet_structure_find(w[0], scale);
+		if (ret < 0)
+			goto out;
+		total += ret;
+	}
+
+	ret = smbrr_wavelet_structure_find_all(w[1]);
+	fprintf(stdout, "find all: %d structures\n", ret);
+	if (ret != total) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (scale = 0; scale < scales - 1; scale++) {
+		n = smbrr_wavelet_get_num_structures(w[0], scale);
+		if (n != smbrr_wavelet_get_num_structures(w[1], scale)) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		for (i = 0; i < n; i++) {
+			smbrr_wavelet_get_structure(w[0], scale, i, &a);
+			smbrr_wavelet_get_structure(w[1], scale, i, &b);
+			if (a.size != b.size || a.pos.x != b.pos.x || a.pos.y != b.pos.y) {
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+	ret = 0;
+
+out:
+	smbrr_wavelet_free(w[0]);
+	smbrr_wavelet_free(w[1]);
+	return ret;
+}
+
+struct stream_count {
+	unsigned int objects;
+	unsigned int bad;
+	unsigned int stop;
+};
+
+static int stream_object(struct smbrr_wavelet *w, struct smbrr_object *object,
+						 struct smbrr *data, void *priv)
+{
+	struct stream_count *sc = priv;
+	float *adu, total = 0.0f;
+	unsigned int i, n;
+
+	(void)w;
+	sc->objects++;
+	if (sc->stop && sc->objects == sc->stop)
+		return -EINTR;
+
+	/* cutout holds exactly the measured object */
+	if (data == NULL) {
+		sc->bad++;
+		return 0;
+	}
+	n = smbrr_get_size(data);
+	adu = malloc(n * sizeof(*adu));
+	if (adu == NULL)
+		return -ENOMEM;
+
+	smbrr_get_data(data, SMBRR_SOURCE_FLOAT, (void **)&adu);
+	for (i = 0; i < n; i++)
+		total += adu[i];
+	if (fabsf(total - object->object_adu) > 1e-3f * fabsf(object->object_adu))
+		sc->bad++;
+
+	free(adu);
+	return 0;
+}
+
+/* streamed objects are measured exactly as the materialised catalogue */
+static int test_structure_connect_stream(struct smbrr *image)
+{
+	struct smbrr_wavelet *w[2] = { NULL, NULL };
+	struct stream_count sc = { 0, 0, 0 };
+	unsigned int i, scales = 6;
+	int ret = 0, objects;
+
+	for (i = 0; i < 2; i++) {
+		w[i] = object_wavelet_new(image, scales);
+		if (w[i] == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	objects = smbrr_wavelet_structure_connect(w[0], 0, scales - 2);
+	ret = smbrr_wavelet_structure_connect_stream(w[1], 0, scales - 2,
+												 stream_object, &sc, 1);
+	fprintf(stdout, "stream: %d objects %u streamed\n", ret, sc.objects);
+	if (ret != objects || sc.objects != objects || sc.bad) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (i = 0; i < objects; i++) {
+		if (memcmp(smbrr_wavelet_object_get(w[0], i),
+				   smbrr_wavelet_object_get(w[1], i),
+				   sizeof(struct smbrr_object))) {
+			fprintf(stderr, "stream object %u differs\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	/* a negative callback return stops the stream */
+	smbrr_wavelet_free(w[1]);
+	w[1] = object_wavelet_new(image, scales);
+	if (w[1] == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	sc.objects = 0;
+	sc.stop = 5;
+	ret = smbrr_wavelet_structure_connect_stream(w[1], 0, scales - 2,
+												 stream_object, &sc, 0);
+	ret = ret == -EINTR && sc.objects == sc.stop ? 0 : -EINVAL;
+
+out:
+	smbrr_wavelet_free(w[0]);
+	smbrr_wavelet_free(w[1]);
+	return ret;
+}
+
+static int stream_skip(struct smbrr_wavelet *w, struct smbrr_object *object,
+					   struct smbrr *data, void *priv)
+{
+	(void)w;
+	(void)object;
+	(void)data;
+	(void)priv;
+	return 0;
+}
+
+/* batched reconstruction rebuilds the cutouts of a streamed catalogue */
+static int test_object_get_data_batch(struct smbrr *image)
+{
+	struct smbrr_wavelet *w[2] = { NULL, NULL };
+	struct smbrr_object **subset = NULL, *a, *b;
+	struct smbrr *da, *db;
+	float *fa = NULL, *fb = NULL;
+	unsigned int i, n, scales = 6;
+	int ret = 0, objects;
+
+	for (i = 0; i < 2; i++) {
+		w[i] = object_wavelet_new(image, scales);
+		if (w[i] == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	objects = smbrr_wavelet_structure_connect(w[0], 0, scales - 2);
+	ret = smbrr_wavelet_structure_connect_stream(w[1], 0, scales - 2,
+												 stream_skip, NULL, 0);
+	if (objects <= 0 || ret != objects) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	subset = malloc((objects / 3 + 2) * sizeof(*subset));
+	fa = malloc(smbrr_get_size(image) * sizeof(*fa));
+	fb = malloc(smbrr_get_size(image) * sizeof(*fb));
+	if (subset == NULL || fa == NULL || fb == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* objects of another wavelet are refused */
+	a = smbrr_wavelet_object_get(w[0], 0);
+	if (smbrr_wavelet_object_get_data_batch(w[1], &a, 1) != -EINVAL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* every third object with the first listed twice, then the rest */
+	for (i = 0, n = 0; i < objects; i += 3)
+		subset[n++] = smbrr_wavelet_object_get(w[1], i);
+	subset[n++] = subset[0];
+	ret = smbrr_wavelet_object_get_data_batch(w[1], subset, n);
+	if (ret < 0)
+		goto out;
+	ret = smbrr_wavelet_object_get_data_batch(w[1], NULL, 0);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < objects; i++) {
+		a = smbrr_wavelet_object_get(w[0], i);
+		b = smbrr_wavelet_object_get(w[1], i);
+		smbrr_wavelet_object_get_data(w[0], a, &da);
+		smbrr_wavelet_object_get_data(w[1], b, &db);
+
+		n = smbrr_get_size(da);
+		smbrr_get_data(da, SMBRR_SOURCE_FLOAT, (void **)&fa);
+		smbrr_get_data(db, SMBRR_SOURCE_FLOAT, (void **)&fb);
+		if (n != smbrr_get_size(db) || memcmp(fa, fb, n * sizeof(*fa))) {
+			fprintf(stderr, "batch object %u differs\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+	fprintf(stdout, "batch: %d objects reconstructed\n", objects);
+	ret = 0;
+
+out:
+	smbrr_wavelet_free(w[0]);
+	smbrr_wavelet_free(w[1]);
+	free(subset);
+	free(fa);
+	free(fb);
+	return ret;
+}
+
+/* equal values or both NaN */
+static int same_float(float a, float b)
+{
+	return a == b || (isnan(a) && isnan(b));
+}
+
+/* top mode keeps the brightest objects of a full connect */
+static int test_structure_connect_top(struct smbrr *image)
+{
+	struct smbrr_wavelet *w[2] = { NULL, NULL };
+	struct smbrr_object *a, *b;
+	unsigned int i, scales = 6, count = 100;
+	int ret = 0, objects, mapped;
+
+	for (i = 0; i < 2; i++) {
+		w[i] = object_wavelet_new(image, scales);
+		if (w[i] == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	objects = smbrr_wavelet_structure_connect(w[0], 0, scales - 2);
+	ret = smbrr_wavelet_structure_connect_top(w[1], 0, scales - 2, count);
+	fprintf(stdout, "top: %d of %d objects\n", ret, objects);
+	if (objects < (int)count || ret != (int)count) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		a = smbrr_wavelet_object_get(w[0], i);
+		b = smbrr_wavelet_object_get(w[1], i);
+		if (a->pos.x != b->pos.x || a->pos.y != b->pos.y ||
+			a->object_adu != b->object_adu ||
+			a->object_area != b->object_area || a->type != b->type ||
+			a->background_adu != b->background_adu ||
+			a->background_area != b->background_area ||
+			!same_float(a->snr, b->snr) ||
+			a->mag_delta != b->mag_delta) {
+			fprintf(stderr, "top object %u differs\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		/* the map follows the objects kept, peaks can lie under another */
+		mapped =
+			smbrr_wavelet_get_object_at_posn(w[0], a->pos.x, a->pos.y) == a;
+		if ((smbrr_wavelet_get_object_at_posn(w[1], b->pos.x, b->pos.y) == b) !=
+			mapped) {
+			fprintf(stderr, "top object %u not mapped\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	smbrr_wavelet_free(w[0]);
+	smbrr_wavelet_free(w[1]);
+	return ret;
+}
+
+/* thresholding straight to runs matches the significance map then labelling */
+static int test_structure_find_threshold(struct smbrr *image)
+{
+	struct smbrr_wavelet *w[2] = { NULL, NULL };
+	struct smbrr_structure a, b;
+	struct smbrr *W;
+	uint32_t *sa = NULL, *sb = NULL;
+	unsigned int scale, i, n, scales = 4;
+	float sigma;
+	int ret = 0;
+
+	for (i = 0; i < 2; i++) {
+		w[i] = smbrr_wavelet_new(image, scales);
+		if (w[i] == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		smbrr_wavelet_convolution(w[i], SMBRR_CONV_ATROUS,
+								  SMBRR_WAVELET_MASK_LINEAR);
+	}
+	smbrr_wavelet_set_structure_engine(w[0],
+									   SMBRR_STRUCTURE_ENGINE_UNION_FIND);
+
+	if (smbrr_wavelet_structure_find_threshold(w[1], scales - 1, 1.0f) !=
+		-EINVAL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	sa = calloc(smbrr_get_size(image), sizeof(*sa));
+	sb = calloc(smbrr_get_size(image), sizeof(*sb));
+	if (sa == NULL || sb == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (scale = 0; scale < scales - 1; scale++) {
+		W = smbrr_wavelet_get_wavelet(w[0], scale);
+		sigma = 3.0f * smbrr_get_sigma(W, smbrr_get_mean(W));
+
+		smbrr_significant_new(W, smbrr_wavelet_get_significant(w[0], scale),
+							  sigma);
+		ret = smbrr_wavelet_structure_find(w[0], scale);
+		if (ret < 0)
+			goto out;
+		if (smbrr_wavelet_structure_find_threshold(w[1], scale, sigma) != ret) {
+			ret = -EINVAL;
+			goto out;
+		}
+		fprintf(stdout, "find threshold: scale %u %d structures\n", scale,
+				ret);
+
+		n = ret;
+		for (i = 0; i < n; i++) {
+			smbrr_wavelet_get_structure(w[0], scale, i, &a);
+			smbrr_wavelet_get_structure(w[1], scale, i, &b);
+			if (a.size != b.size || a.pos.x != b.pos.x || a.pos.y != b.pos.y) {
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+
+		/* both give the same labelled significance map */
+		smbrr_get_data(smbrr_wavelet_get_significant(w[0], scale),
+					   SMBRR_SOURCE_UINT32, (void **)&sa);
+		smbrr_get_data(smbrr_wavelet_get_significant(w[1], scale),
+					   SMBRR_SOURCE_UINT32, (void **)&sb);
+		if (memcmp(sa, sb, smbrr_get_size(image) * sizeof(*sa))) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	smbrr_wavelet_free(w[0]);
+	smbrr_wavelet_free(w[1]);
+	free(sa);
+	free(sb);
+	return ret;
+}
+
+/* trimmed annulus background of point sources on a flat noisy sky */
+static int test_object_background(void)
+{
+	struct smbrr_wavelet *w = NULL;
+	struct smbrr *image = NULL;
+	struct smbrr_object *o;
+	unsigned int i, x, y, dx, dy, seed = 7, size = 256, scales = 5, points;
+	float *adu, r2, mean;
+	int ret = 0, objects;
+
+	adu = malloc(size * size * sizeof(*adu));
+	if (adu == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < size * size; i++)
+		adu[i] = 100.0f + 5.0f * gauss(&seed);
+
+	for (y = 40; y < size - 32; y += 48)
+		for (x = 40; x < size - 32; x += 48)
+			for (dy = 0; dy < 9; dy++)
+				for (dx = 0; dx < 9; dx++) {
+					r2 = (dx - 4.0f) * (dx - 4.0f) + (dy - 4.0f) * (dy - 4.0f);
+					adu[(y + dy - 4) * size + x + dx - 4] +=
+						2000.0f * expf(-0.5f * r2);
+				}
+
+	image = smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, size,
+					  SMBRR_SOURCE_FLOAT, adu);
+	w = image ? object_wavelet_new(image, scales) : NULL;
+	if (w == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	objects = smbrr_wavelet_structure_connect(w, 0, scales - 2);
+	if (objects <= 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* every measured point source sees the sky level */
+	for (i = 0, points = 0; i < objects; i++) {
+		o = smbrr_wavelet_object_get(w, i);
+		if (o->type != SMBRR_OBJECT_POINT || o->background_area == 0)
+			continue;
+
+		mean = o->background_adu / o->background_area;
+		if (fabsf(mean - 100.0f) > 2.0f) {
+			fprintf(stderr, "object %u background %f\n", i, mean);
+			ret = -EINVAL;
+			goto out;
+		}
+		/* the ID map resolves the brightest pixel back to an object */
+		if (smbrr_wavelet_get_object_at_posn(w, o->pos.x, o->pos.y) == NULL) {
+			fprintf(stderr, "object %u not in map\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+		points++;
+	}
+
+	if (smbrr_wavelet_get_object_at_posn(w, size, 0) != NULL ||
+		smbrr_wavelet_get_object_at_posn(w, -1, 0) != NULL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	fprintf(stdout, "background: %d objects %u point sources\n", objects,
+			points);
+	if (points == 0)
+		ret = -EINVAL;
+
+out:
+	smbrr_wavelet_free(w);
+	smbrr_free(image);
+	free(adu);
+	return ret;
+}
+
+/* grid queries agree with a brute force scan of the catalogue */
+static int test_object_spatial(struct smbrr *image)
+{
+	struct smbrr_wavelet *w;
+	struct smbrr_object **found = NULL, **match = NULL, *o;
+	float *cx = NULL, *cy = NULL, qx, qy, r = 40.0f, dx, dy, d, dk;
+	unsigned int i, j, q, k = 8, scales = 6;
+	int ret = 0, objects, n, count;
+
+	w = object_wavelet_new(image, scales);
+	if (w == NULL)
+		return -ENOMEM;
+
+	objects = smbrr_wavelet_structure_connect(w, 0, scales - 2);
+	if (objects <= 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	found = calloc(objects, sizeof(*found));
+	match = calloc(objects, sizeof(*match));
+	cx = calloc(objects, sizeof(*cx));
+	cy = calloc(objects, sizeof(*cy));
+	if (found == NULL || match == NULL || cx == NULL || cy == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (q = 0; q < 16; q++) {
+		qx = (q * 97) % smbrr_get_width(image);
+		qy = (q * 61) % smbrr_get_height(image);
+
+		/* box and radius counts */
+		for (i = 0, count = 0; i < objects; i++) {
+			o = smbrr_wavelet_object_get(w, i);
+			if (o->pos.x >= qx - r && o->pos.x <= qx + r && o->pos.y >= qy - r &&
+				o->pos.y <= qy + r)
+				count++;
+		}
+		n = smbrr_wavelet_object_find_box(w, qx - r, qy - r, qx + r, qy + r,
+										  found, objects);
+		if (n != count) {
+			fprintf(stderr, "box %u: %d != %d\n", q, n, count);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		for (i = 0, count = 0; i < objects; i++) {
+			o = smbrr_wavelet_object_get(w, i);
+			dx = o->pos.x - qx;
+			dy = o->pos.y - qy;
+			if (dx * dx + dy * dy <= r * r)
+				count++;
+		}
+		n = smbrr_wavelet_object_find_radius(w, qx, qy, r, found, objects);
+		if (n != count) {
+			fprintf(stderr, "radius %u: %d != %d\n", q, n, count);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		/* each neighbour is nearer than all but its predecessors */
+		n = smbrr_wavelet_object_find_nearest(w, qx, qy, k, found);
+		if (n != (objects < k ? objects : k)) {
+			ret = -EINVAL;
+			goto out;
+		}
+		for (j = 0; j < n; j++) {
+			dx = found[j]->pos.x - qx;
+			dy = found[j]->pos.y - qy;
+			dk = dx * dx + dy * dy;
+			for (i = 0, count = 0; i < objects; i++) {
+				o = smbrr_wavelet_object_get(w, i);
+				dx = o->pos.x - qx;
+				dy = o->pos.y - qy;
+				d = dx * dx + dy * dy;
+				if (d < dk)
+					count++;
+			}
+			if (count > j) {
+				fprintf(stderr, "nearest %u: %u has %d nearer\n", q, j, count);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+
+	/* an offset copy of the catalogue matches back to itself */
+	for (i = 0; i < objects; i++) {
+		o = smbrr_wavelet_object_get(w, i);
+		cx[i] = o->pos.x + 0.25f;
+		cy[i] = o->pos.y - 0.25f;
+	}
+	n = smbrr_wavelet_object_match(w, cx, cy, objects, 0.5f, match);
+	for (i = 0; i < objects; i++) {
+		if (match[i] != smbrr_wavelet_object_get(w, i)) {
+			fprintf(stderr, "match %u failed\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+	fprintf(stdout, "spatial: %d objects %d matched\n", objects, n);
+	if (n != objects)
+		ret = -EINVAL;
+
+out:
+	free(found);
+	free(match);
+	free(cx);
+	free(cy);
+	smbrr_wavelet_free(w);
+	return ret;
+}
+
+/* synthetic frame of sky with point sources at (x[i], y[i]) */
+static struct smbrr *track_frame(float *adu, unsigned int size,
+								 unsigned int seed, const float *x,
+								 const float *y, unsigned int count)
+{
+	unsigned int i, px, py, dx, dy;
+	float r2;
+
+	for (i = 0; i < size * size; i++)
+		adu[i] = 100.0f + 5.0f * gauss(&seed);
+
+	for (i = 0; i < count; i++) {
+		px = x[i];
+		py = y[i];
+		for (dy = 0; dy < 9; dy++)
+			for (dx = 0; dx < 9; dx++) {
+				r2 = (dx - 4.0f) * (dx - 4.0f) + (dy - 4.0f) * (dy - 4.0f);
+				adu[(py + dy - 4) * size + px + dx - 4] +=
+					(1000.0f + 200.0f * i) * expf(-0.5f * r2);
+			}
+	}
+
+	return smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, size, SMBRR_SOURCE_FLOAT,
+					 adu);
+}
+
+static int track_detect(struct smbrr *image, struct smbrr_wavelet **w)
+{
+	unsigned int scales = 5;
+
+	*w = object_wavelet_new(image, scales);
+	if (*w == NULL)
+		return -ENOMEM;
+
+	return smbrr_wavelet_structure_connect(*w, 0, scales - 2);
+}
+
+/* moving sources keep their track IDs and a new source gets a new ID */
+static int test_object_track(void)
+{
+	struct smbrr_tracker *t;
+	struct smbrr_wavelet *w = NULL;
+	struct smbrr *image = NULL, *area = NULL;
+	struct smbrr_coord start, end;
+	struct smbrr_track track;
+	float *adu, x[10], y[10], dx, dy;
+	unsigned int i, j, frame, id[10], size = 160, count = 9, frames = 6;
+	int ret = 0, tracks;
+
+	adu = malloc(size * size * sizeof(*adu));
+	t = smbrr_tracker_new(6.0f);
+	if (adu == NULL || t == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < 10; i++) {
+		x[i] = 30 + 40 * (i % 3);
+		y[i] = 30 + 40 * (i / 3);
+		id[i] = 0;
+	}
+	x[9] = 120.0f;
+	y[9] = 20.0f;
+
+	for (frame = 0; frame < frames; frame++) {
+		/* a tenth source appears on the third frame */
+		if (frame == 2)
+			count = 10;
+
+		image = track_frame(adu, size, 11 + frame, x, y, count);
+		if (image == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		/* last frame is only redetected around the predicted tracks */
+		if (frame == frames - 1) {
+			ret = smbrr_tracker_predict_area(t, 12, &start, &end);
+			if (ret < 0)
+				goto out;
+			area = smbrr_new_from_area(image, start.x, start.y, end.x, end.y);
+			if (area == NULL) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			ret = track_detect(area, &w);
+			if (ret >= 0)
+				ret = smbrr_tracker_update_area(t, w, start.x, start.y);
+		} else {
+			ret = track_detect(image, &w);
+			if (ret >= 0)
+				ret = smbrr_tracker_update(t, w);
+		}
+		if (ret < 0)
+			goto out;
+		tracks = ret;
+
+		/* every source is on a track that has kept its ID */
+		for (i = 0; i < count; i++) {
+			for (j = 0; j < tracks; j++) {
+				smbrr_tracker_get_track(t, j, &track);
+				dx = track.x - x[i];
+				dy = track.y - y[i];
+				if (track.object && dx * dx + dy * dy <= 2.0f)
+					break;
+			}
+			if (j == tracks) {
+				fprintf(stderr, "frame %u source %u not tracked\n", frame, i);
+				ret = -EINVAL;
+				goto out;
+			}
+			if (id[i] == 0)
+				id[i] = track.id;
+			if (track.id != id[i]) {
+				fprintf(stderr, "frame %u source %u id %u != %u\n", frame, i,
+						track.id, id[i]);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+
+		smbrr_wavelet_free(w);
+		smbrr_free(area);
+		smbrr_free(image);
+		w = NULL;
+		area = image = NULL;
+
+		for (i = 0; i < 10; i++) {
+			x[i] += 2.0f;
+			y[i] += 1.0f;
+		}
+	}
+
+	ret = 0;
+	for (i = 0; i < 9; i++) {
+		if (id[9] == id[i])
+			ret = -EINVAL;
+	}
+	fprintf(stdout, "track: %u tracks new source id %u\n",
+			smbrr_tracker_get_num_tracks(t), id[9]);
+
+out:
+	smbrr_wavelet_free(w);
+	smbrr_free(area);
+	smbrr_free(image);
+	smbrr_tracker_free(t);
+	free(adu);
+	return ret;
+}
+
+/* object nearest to x, y by centroid */
+static struct smbrr_object *moment_nearest(struct smbrr_wavelet *w,
+										   int objects, float x, float y)
+{
+	struct smbrr_object *o, *best = NULL;
+	float d, dmin = 1e30f;
+	int i;
+
+	for (i = 0; i < objects; i++) {
+		o = smbrr_wavelet_object_get(w, i);
+		d = (o->cx - x) * (o->cx - x) + (o->cy - y) * (o->cy - y);
+		if (d < dmin) {
+			dmin = d;
+			best = o;
+		}
+	}
+
+	return best;
+}
+
+/* both labelling engines give the same structures and sub-pixel moments */
+static int test_object_moments(void)
+{
+	struct smbrr_wavelet *w[2] = { NULL, NULL };
+	struct smbrr *frame = NULL;
+	struct smbrr_object *a[2], *b[2];
+	struct smbrr_structure sa, sb;
+	unsigned int x, y, i, n, scale, seed = 7, size = 128, scales = 5;
+	float *adu, u, v, pa = (float)M_PI / 6.0f, dpa;
+	int ret = 0, objects, engine;
+
+	adu = malloc(size * size * sizeof(*adu));
+	if (adu == NULL)
+		return -ENOMEM;
+
+	/* an elongated source at 30 degrees and a round source */
+	for (y = 0; y < size; y++) {
+		for (x = 0; x < size; x++) {
+			u = (x - 40.3f) * cosf(pa) + (y - 60.6f) * sinf(pa);
+			v = -(x - 40.3f) * sinf(pa) + (y - 60.6f) * cosf(pa);
+			adu[y * size + x] =
+				100.0f + 5.0f * gauss(&seed) +
+				2000.0f * expf(-0.5f * (u * u / 16.0f + v * v / 4.0f));
+
+			u = x - 90.0f;
+			v = y - 40.0f;
+			adu[y * size + x] += 2000.0f * expf(-0.5f * (u * u + v * v) / 6.25f);
+		}
+	}
+
+	frame = smbrr_new(SMBRR_DATA_2D_FLOAT, size, size, size, SMBRR_SOURCE_FLOAT,
+					  adu);
+	if (frame == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (engine = SMBRR_STRUCTURE_ENGINE_FLOODFILL;
+		 engine <= SMBRR_STRUCTURE_ENGINE_UNION_FIND; engine++) {
+		w[engine] = smbrr_wavelet_new(frame, scales);
+		if (w[engine] == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		smbrr_wavelet_convolution(w[engine], SMBRR_CONV_ATROUS,
+								  SMBRR_WAVELET_MASK_LINEAR);
+		smbrr_wavelet_ksigma_clip(w[engine], SMBRR_CLIP_VGENTLE, 0.001);
+		smbrr_wavelet_set_structure_engine(w[engine], engine);
+		smbrr_wavelet_structure_find_all(w[engine]);
+		objects = smbrr_wavelet_structure_connect(w[engine], 0, scales - 2);
+		if (objects <= 0) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		a[engine] = moment_nearest(w[engine], objects, 40.3f, 60.6f);
+		b[engine] = moment_nearest(w[engine], objects, 90.0f, 40.0f);
+		fprintf(stdout,
+				"moments: engine %d %.3f,%.3f pa %.4f e %.4f, %.3f,%.3f e %.4f\n",
+				engine, a[engine]->cx, a[engine]->cy, a[engine]->pa,
+				a[engine]->ellipticity, b[engine]->cx, b[engine]->cy,
+				b[engine]->ellipticity);
+
+		dpa = fabsf(a[engine]->pa - pa);
+		if (fabsf(a[engine]->cx - 40.3f) > 0.1f ||
+			fabsf(a[engine]->cy - 60.6f) > 0.1f ||
+			fminf(dpa, (float)M_PI - dpa) > 0.02f ||
+			a[engine]->ellipticity < 0.2f ||
+			fabsf(b[engine]->cx - 90.0f) > 0.1f ||
+			fabsf(b[engine]->cy - 40.0f) > 0.1f ||
+			b[engine]->ellipticity > 0.02f) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	/* each pixel is counted once by either engine */
+	for (scale = 0; scale < scales - 1; scale++) {
+		n = smbrr_wavelet_get_num_structures(w[0], scale);
+		if (n != smbrr_wavelet_get_num_structures(w[1], scale)) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		for (i = 0; i < n; i++) {
+			smbrr_wavelet_get_structure(w[0], scale, i, &sa);
+			smbrr_wavelet_get_structure(w[1], scale, i, &sb);
+			if (sa.size != sb.size) {
+				fprintf(stderr, "moments: scale %u structure %u size %u vs %u\n",
+						scale, i, sa.size, sb.size);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+
+	/* engines only differ in the order pixels are summed */
+	if (fabsf(a[0]->cx - a[1]->cx) > 1e-3f ||
+		fabsf(a[0]->cy - a[1]->cy) > 1e-3f ||
+		fabsf(a[0]->pa - a[1]->pa) > 1e-3f ||
+		fabsf(a[0]->ellipticity - a[1]->ellipticity) > 1e-3f ||
+		fabsf(b[0]->cx - b[1]->cx) > 1e-3f ||
+		fabsf(b[0]->cy - b[1]->cy) > 1e-3f ||
+		fabsf(b[0]->ellipticity - b[1]->ellipticity) > 1e-3f)
+		ret = -EINVAL;
+
+out:
+	smbrr_wavelet_free(w[0]);
+	smbrr_wavelet_free(w[1]);
+	smbrr_free(frame);
+	free(adu);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct smbrr *image;
+	struct bitmap *bmp = NULL;
+	const void *data;
+	int ret, width, height, stride;
+	enum smbrr_source_type depth;
+	char *ifile;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <input.bmp>\n", argv[0]);
+		return -EINVAL;
+	}
+
+	ifile = argv[1];
+
+	if (strstr(ifile, ".fit") != NULL) {
+		ret = fits_load(ifile, &data, &width, &height, &depth, &stride);
+		if (ret < 0)
+			return ret;
+	} else {
+		ret = bmp_load(ifile, &bmp, &data);
+		if (ret < 0)
+			return ret;
+
+		height = bmp_height(bmp);
+		width = bmp_width(bmp);
+		depth = bmp_depth(bmp);
+		stride = bmp_stride(bmp);
+	}
+
+	image = smbrr_new(SMBRR_DATA_2D_FLOAT, width, height, stride, depth, data);
+	if (image == NULL)
+		return -EINVAL;
+
+	ret = test_structure_union_find();
+	if (ret < 0) {
+		fprintf(stderr, "structure union-find failed\n");
+		goto out;
+	}
+
+	ret = test_structure_find_all(image);
+	if (ret < 0) {
+		fprintf(stderr, "structure find all failed\n");
+		goto out;
+	}
+
+	ret = test_structure_find_threshold(image);
+	if (ret < 0) {
+		fprintf(stderr, "structure find threshold failed\n");
+		goto out;
+	}
+
+	ret = test_structure_connect_stream(image);
+	if (ret < 0) {
+		fprintf(stderr, "structure connect stream failed\n");
+		goto out;
+	}
+
+	ret = test_structure_connect_top(image);
+	if (ret < 0) {
+		fprintf(stderr, "structure connect top failed\n");
+		goto out;
+	}
+
+	ret = test_object_get_data_batch(image);
+	if (ret < 0) {
+		fprintf(stderr, "object data batch failed\n");
+		goto out;
+	}
+
+	ret = test_object_background();
+	if (ret < 0) {
+		fprintf(stderr, "object background failed\n");
+		goto out;
+	}
+
+	ret = test_object_spatial(image);
+	if (ret < 0) {
+		fprintf(stderr, "object spatial index failed\n");
+		goto out;
+	}
+
+	ret = test_object_track();
+	if (ret < 0) {
+		fprintf(stderr, "object tracking failed\n");
+		goto out;
+	}
+
+	ret = test_object_moments();
+	if (ret < 0) {
+		fprintf(stderr, "object moments failed\n");
+		goto out;
+	}
+
+out:
+	free(bmp);
+	smbrr_free(image);
+	return ret;
+}
@@ -72,11 +72,8 @@ static int run_pipeline(const char *ifile, const char *ofile, int use_opencl,
 	if (ret < 0)
 		return ret;
 
-	for (int i = 0; i < scales - 1; i++) {
-		int structures = smbrr_wavelet_structure_find(w, i);
-		if (structures < 0)
-			return -EINVAL;
-	}
+	if (smbrr_wavelet_structure_find_all(w) < 0)
+		return -EINVAL;
 
 	int objects = smbrr_wavelet_structure_connect(w, 0, scales - 2);
 	if (objects < 0)